@@ -0,0 +1,127 @@
+#include "AgentRegistry.h"
+#include "SymbolTable.h"
+#include <stdexcept>
+
+// Gives the user a wallet if they do not have one yet
+Wallet& AgentRegistry::add(int user)
+{
+    if (user < 0) throw std::invalid_argument{"AgentRegistry::add: no such user"};
+    if (agentOfUser.size() <= static_cast<size_t>(user)) agentOfUser.resize(user + 1, -1);
+    if (agentOfUser[user] < 0)
+    {
+        agentOfUser[user] = static_cast<int32_t>(wallets.size());
+        wallets.emplace_back();
+    }
+    return wallets[agentOfUser[user]];
+}
+
+Wallet* AgentRegistry::find(int user)
+{
+    int32_t agent = agentOf(static_cast<uint32_t>(user));
+    return agent < 0 ? nullptr : &wallets[agent];
+}
+
+const Wallet* AgentRegistry::find(int user) const
+{
+    int32_t agent = agentOf(static_cast<uint32_t>(user));
+    return agent < 0 ? nullptr : &wallets[agent];
+}
+
+int32_t AgentRegistry::agentOf(uint32_t user) const
+{
+    return user < agentOfUser.size() ? agentOfUser[user] : -1;
+}
+
+// Holds what the order would spend, recording it so release can give it back
+bool AgentRegistry::reserve(const OrderBookEntry& order, uint64_t orderId)
+{
+    int32_t agent = agentOf(order.userId);
+    int currency;
+    Decimal amount;
+    if (agent < 0 || !Wallet::orderCost(order, currency, amount)) return false;
+    if (!wallets[agent].reserve(currency, amount)) return false;
+    if (orderId != 0)
+    {
+        if (holdOfOrder.size() <= orderId) holdOfOrder.resize(orderId + 1, 0);
+        if (holdOfOrder[orderId] != 0) release(orderId);  // An id holds once; a second reserve replaces the first
+        holdOfOrder[orderId] = static_cast<uint32_t>(holds.size() + 1);
+    }
+    holds.push_back(Hold{order.timestamp, agent, currency, amount, orderId});
+    return true;
+}
+
+size_t AgentRegistry::reserve(std::span<const OrderBookEntry> orders, std::vector<uint8_t>& accepted, uint64_t firstId)
+{
+    accepted.assign(orders.size(), 0);
+    holds.reserve(holds.size() + orders.size());
+    size_t held = 0;
+    for (size_t i = 0; i < orders.size(); ++i)
+    {
+        if (reserve(orders[i], firstId != 0 ? firstId + held : 0))
+        {
+            accepted[i] = 1;
+            ++held;
+        }
+    }
+    return held;
+}
+
+// Settles both sides of each fill that an agent took part in
+void AgentRegistry::settle(std::span<const Fill> fills)
+{
+    int lastProduct = SymbolTable::none;
+    int base = SymbolTable::none;
+    int quote = SymbolTable::none;
+    for (const Fill& fill : fills)
+    {
+        int32_t buyer = agentOf(fill.buyer);
+        int32_t seller = agentOf(fill.seller);
+        if (buyer < 0 && seller < 0) continue; // Dataset against dataset, nobody to settle
+        if (fill.productId != lastProduct)
+        {
+            base = SymbolTable::baseCurrency(fill.productId);
+            quote = SymbolTable::quoteCurrency(fill.productId);
+            lastProduct = fill.productId;
+        }
+        if (quote == SymbolTable::none) continue; // No price currency to settle in
+        if (buyer >= 0) wallets[buyer].settle(OrderBookType::bidsale, fill.price, fill.amount, base, quote);
+        if (seller >= 0) wallets[seller].settle(OrderBookType::asksale, fill.price, fill.amount, base, quote);
+    }
+}
+
+// Finds the order's own hold through the id table and swap-removes it
+bool AgentRegistry::release(uint64_t orderId)
+{
+    if (orderId >= holdOfOrder.size() || holdOfOrder[orderId] == 0) return false;
+    size_t i = holdOfOrder[orderId] - 1;
+    const Hold& hold = holds[i];
+    wallets[hold.agent].release(hold.currency, hold.amount);
+    holdOfOrder[orderId] = 0;
+    if (i + 1 < holds.size())
+    {
+        holds[i] = holds.back();
+        if (holds[i].orderId != 0) holdOfOrder[holds[i].orderId] = static_cast<uint32_t>(i + 1);
+    }
+    holds.pop_back();
+    return true;
+}
+
+// Gives back the funds of every order that has had its chance to match, keeping the rest
+void AgentRegistry::release(int64_t timestamp)
+{
+    size_t kept = 0;
+    for (const Hold& hold : holds)
+    {
+        if (hold.timestamp <= timestamp)
+        {
+            wallets[hold.agent].release(hold.currency, hold.amount);
+            if (hold.orderId != 0) holdOfOrder[hold.orderId] = 0;
+        }
+        else
+        {
+            if (hold.orderId != 0) holdOfOrder[hold.orderId] = static_cast<uint32_t>(kept + 1);
+            holds[kept++] = hold;
+        }
+    }
+    holds.resize(kept);
+}
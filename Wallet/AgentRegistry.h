@@ -0,0 +1,86 @@
+#pragma once
+
+#include "Wallet.h"
+#include "Fill.h"
+#include <cstdint>
+#include <deque>
+#include <span>
+#include <vector>
+
+/** The wallets of every trading agent, found by SymbolTable user id.
+ * Agents place orders against funds they have not already promised:
+ * an accepted order holds its cost in its agent's wallet until the
+ * timeframe it was placed in has been matched, and each fill is then
+ * settled into the wallets on both sides of it. Orders only match in
+ * their own timeframe, so one release after that timeframe settles
+ * frees the holds of orders that filled and of orders that expired.
+ *
+ * Users without a wallet here, such as the dataset, are counterparties
+ * only: their side of a fill is skipped and their orders are refused.
+ */
+class AgentRegistry
+{
+    public:
+        /** the wallet of a user, made empty the first time the user is added.
+         * The reference stays valid as more agents are added.
+         */
+        Wallet& add(int user);
+        /** the user's wallet, nullptr if the user is not an agent */
+        Wallet* find(int user);
+        const Wallet* find(int user) const;
+        /** number of agents */
+        size_t size() const { return wallets.size(); }
+
+        /** hold the cost of an order in its agent's wallet.
+         * False, holding nothing, if the user is not an agent or the
+         * funds not already held do not cover it. orderId is the id the
+         * book gives the order, so release(orderId) can free this hold;
+         * 0 for an order that will never be cancelled on its own.
+         */
+        bool reserve(const OrderBookEntry& order, uint64_t orderId = 0);
+        /** reserve a batch of orders in order, so earlier orders get
+         * first call on a wallet's funds. accepted[i] is set to 1 for each
+         * order held and 0 for each refused. Returns the number held.
+         * With a firstId the orders held get ids from it up, one each in
+         * order, as OrderBook::insertOrders gives them once the refused
+         * ones are dropped.
+         */
+        size_t reserve(std::span<const OrderBookEntry> orders, std::vector<uint8_t>& accepted, uint64_t firstId = 0);
+        /** settle a batch of fills: the buyer's wallet takes the bid side
+         * and the seller's the ask side. Currencies are looked up once per
+         * run of fills in one product.
+         */
+        void settle(std::span<const Fill> fills);
+        /** free every hold for orders placed at or before timestamp */
+        void release(int64_t timestamp);
+        /** free the hold of the order with this id, e.g. when it is
+         * cancelled. O(1). False if the order holds nothing.
+         */
+        bool release(uint64_t orderId);
+        /** number of orders still holding funds */
+        size_t holdCount() const { return holds.size(); }
+
+    private:
+        /** funds one order holds until it is released */
+        struct Hold
+        {
+            int64_t timestamp;
+            int32_t agent;
+            int32_t currency;
+            Decimal amount;
+            /** the order's book id, 0 if it has none */
+            uint64_t orderId;
+        };
+
+        /** index into wallets, -1 if the user is not an agent */
+        int32_t agentOf(uint32_t user) const;
+
+        /** a deque so wallets do not move when agents are added */
+        std::deque<Wallet> wallets;
+        /** agent index per SymbolTable user id, -1 for users without a wallet */
+        std::vector<int32_t> agentOfUser;
+        /** in no particular order: releasing one moves the last into its place */
+        std::vector<Hold> holds;
+        /** index into holds plus one per order id, 0 for an order holding nothing */
+        std::vector<uint32_t> holdOfOrder;
+};
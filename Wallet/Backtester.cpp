@@ -0,0 +1,137 @@
+#include "Backtester.h"
+#include "AgentRegistry.h"
+#include "BookOverlay.h"
+#include "SymbolTable.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <chrono>
+#include <sstream>
+#include <stdexcept>
+
+Backtester::Backtester(const OrderBook& book, const Options& options)
+: book(book), options(options)
+{
+    if (book.isStreaming())
+    {
+        throw std::invalid_argument{"Backtester needs the whole book in memory, not a streaming one"};
+    }
+    timeframes = book.getTimeframes();
+    products = book.getKnownProducts();
+
+    // Each product's opening and closing mid, for valuing wallets; a timeframe with one side empty has none
+    for (const std::string& product : products)
+    {
+        Mids m;
+        for (auto t = timeframes.begin(); t != timeframes.end() && m.first <= 0; ++t) m.first = book.getMidPrice(product, *t);
+        for (auto t = timeframes.rbegin(); t != timeframes.rend() && m.last <= 0; ++t) m.last = book.getMidPrice(product, *t);
+        mids.push_back(m);
+    }
+}
+
+Backtester::Mids Backtester::midsOf(const std::string& product) const
+{
+    auto found = std::lower_bound(products.begin(), products.end(), product);
+    if (found == products.end() || *found != product) return Mids{};
+    return mids[found - products.begin()];
+}
+
+// Converts each balance at its product's mid, trying CUR/valueIn then valueIn/CUR
+double Backtester::value(const Wallet& wallet, bool atEnd) const
+{
+    double total = 0;
+    for (const auto& [currency, balance] : wallet.holdings())
+    {
+        const std::string& name = SymbolTable::currencyName(currency);
+        if (name == options.valueIn)
+        {
+            total += balance.toDouble();
+            continue;
+        }
+        Mids direct = midsOf(name + "/" + options.valueIn);
+        double price = atEnd ? direct.last : direct.first;
+        if (price > 0)
+        {
+            total += balance.toDouble() * price;
+            continue;
+        }
+        Mids inverse = midsOf(options.valueIn + "/" + name);
+        price = atEnd ? inverse.last : inverse.first;
+        if (price > 0) total += balance.toDouble() / price;
+    }
+    return total;
+}
+
+std::vector<Backtester::Result> Backtester::run(std::vector<std::unique_ptr<Strategy>>& strategies)
+{
+    std::vector<Result> results(strategies.size());
+    ThreadPool pool{options.threads};
+    pool.parallelFor(strategies.size(), [&](size_t i)
+    {
+        results[i] = run(*strategies[i]);
+    });
+    return results;
+}
+
+// One strategy through every timeframe: ask for orders, hold their funds, match them over the book, settle, release
+Backtester::Result Backtester::run(Strategy& strategy) const
+{
+    auto start = std::chrono::steady_clock::now();
+    Result result;
+    result.name = strategy.name();
+    const uint32_t user = static_cast<uint32_t>(SymbolTable::userId(result.name));
+
+    AgentRegistry agents;  // Just the one agent, for its reservation bookkeeping
+    Wallet& wallet = agents.add(static_cast<int>(user));
+    for (const auto& [currency, amount] : options.funds) wallet.insertCurrency(currency, amount);
+    result.startValue = value(wallet, false);
+    BookOverlay overlay{book, user};
+
+    std::vector<OrderBookEntry> orders;
+    std::vector<uint8_t> accepted;
+    for (int64_t timestamp : timeframes)
+    {
+        orders.clear();
+        strategy.onTimeframe(StrategyContext{book, timestamp, products, wallet}, orders);
+        for (OrderBookEntry& order : orders)
+        {
+            order.timestamp = timestamp;
+            order.userId = user;
+        }
+
+        size_t held = agents.reserve(orders, accepted);
+        result.placed += held;
+        result.refused += orders.size() - held;
+        size_t kept = 0;
+        for (size_t i = 0; i < orders.size(); ++i)
+        {
+            if (accepted[i]) orders[kept++] = orders[i];
+        }
+        orders.erase(orders.begin() + kept, orders.end());
+        if (orders.empty()) continue;
+
+        overlay.insertOrders(orders);
+        size_t fillCount = overlay.match(timestamp);
+        std::span<const Fill> fills{overlay.fills().data() + overlay.fills().size() - fillCount, fillCount};
+        agents.settle(fills);
+        agents.release(timestamp);
+        result.fills += fillCount;
+        if (fillCount > 0) strategy.onFills(fills);
+    }
+
+    result.wallet = wallet;
+    result.finalValue = value(wallet, true);
+    result.overlayBytes = overlay.memoryBytes();
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return result;
+}
+
+std::string Backtester::report(const std::vector<Result>& results)
+{
+    std::ostringstream out;
+    for (const Result& r : results)
+    {
+        out << r.name << ": " << r.placed << " placed, " << r.refused << " refused, " << r.fills << " fills, "
+            << r.overlayBytes << " overlay bytes, " << r.seconds << " s, pnl " << r.pnl() << "\n" << r.wallet.toString();
+    }
+    return out.str();
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include "OrderBook.h"
+#include "Strategy.h"
+#include "Wallet.h"
+#include "Decimal.h"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+/** Runs trading strategies over every timeframe of one loaded book.
+ * The book is shared by all of them and only read: each strategy places
+ * its orders into its own BookOverlay and settles its fills into its own
+ * wallet, so the strategies run on separate threads without locking
+ * and the market data is never copied. Streaming books can not be
+ * shared this way, so they are refused.
+ */
+class Backtester
+{
+    public:
+        struct Options
+        {
+            /** threads running strategies, 0 for one per hardware thread */
+            unsigned threads = 0;
+            /** what every strategy's wallet starts with */
+            std::vector<std::pair<std::string, Decimal>> funds{{"BTC", Decimal::whole(10)}};
+            /** the currency wallets are valued in for the profit and loss */
+            std::string valueIn = "BTC";
+        };
+
+        /** how one strategy did */
+        struct Result
+        {
+            std::string name;
+            /** its wallet at the end of the run */
+            Wallet wallet;
+            size_t placed = 0;
+            /** orders dropped because the wallet could not cover them */
+            size_t refused = 0;
+            size_t fills = 0;
+            /** bytes its overlay held at the end, orders and fills */
+            size_t overlayBytes = 0;
+            double seconds = 0;
+            /** the starting funds at the first timeframe's mid prices, in Options::valueIn */
+            double startValue = 0;
+            /** the final wallet at the last timeframe's mid prices */
+            double finalValue = 0;
+
+            double pnl() const { return finalValue - startValue; }
+        };
+
+        /** throws std::invalid_argument for a streaming book */
+        Backtester(const OrderBook& book, const Options& options);
+
+        /** run every strategy from the first timeframe to the last.
+         * Results come back in the same order as the strategies.
+         */
+        std::vector<Result> run(std::vector<std::unique_ptr<Strategy>>& strategies);
+        /** run one strategy on the calling thread */
+        Result run(Strategy& strategy) const;
+
+        /** one line per result: name, placed, refused, fills and the wallet */
+        static std::string report(const std::vector<Result>& results);
+
+        /** what a wallet is worth in Options::valueIn at the first (atEnd
+         * false) or last mid price of each product. A currency with no
+         * product against valueIn either way round counts as 0.
+         */
+        double value(const Wallet& wallet, bool atEnd) const;
+
+    private:
+        /** mid price of a product at its first and last timeframe that has one */
+        struct Mids
+        {
+            double first = 0;
+            double last = 0;
+        };
+        /** the mids of a product by name, zero if it is not in the book */
+        Mids midsOf(const std::string& product) const;
+
+        const OrderBook& book;
+        Options options;
+        /** read from the book once, so the threads never touch its time cursor */
+        std::vector<int64_t> timeframes;
+        std::vector<std::string> products;
+        /** per product, in the same order */
+        std::vector<Mids> mids;
+};
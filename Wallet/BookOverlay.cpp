@@ -0,0 +1,63 @@
+#include "BookOverlay.h"
+#include "SymbolTable.h"
+#include <algorithm>
+#include <stdexcept>
+
+BookOverlay::BookOverlay(const OrderBook& base, uint32_t user)
+: book(base), owner(user)
+{
+}
+
+void BookOverlay::insertOrders(std::span<const OrderBookEntry> orders)
+{
+    for (const OrderBookEntry& order : orders)
+    {
+        if (!ownOrders.empty() && order.timestamp < ownOrders.back().timestamp)
+        {
+            throw std::invalid_argument{"BookOverlay::insertOrders: orders must arrive in time order"};
+        }
+        ownOrders.push_back(order);
+    }
+}
+
+// The overlay's orders are in time order, so the ones at a time are one run found by binary search
+std::span<const OrderBookEntry> BookOverlay::orders(int64_t timestamp) const
+{
+    auto earlier = [](const OrderBookEntry& e, int64_t t) { return e.timestamp < t; };
+    auto later = [](int64_t t, const OrderBookEntry& e) { return t < e.timestamp; };
+    auto first = std::lower_bound(ownOrders.begin(), ownOrders.end(), timestamp, earlier);
+    auto last = std::upper_bound(first, ownOrders.end(), timestamp, later);
+    return {ownOrders.data() + (first - ownOrders.begin()), static_cast<size_t>(last - first)};
+}
+
+// Only products the overlay trades at this time can give it fills, so the rest are not matched at all
+size_t BookOverlay::match(int64_t timestamp)
+{
+    std::span<const OrderBookEntry> due = orders(timestamp);
+    std::vector<uint16_t> products;
+    for (const OrderBookEntry& order : due)
+    {
+        if (std::find(products.begin(), products.end(), order.productId) == products.end()) products.push_back(order.productId);
+    }
+    std::sort(products.begin(), products.end(), [](uint16_t a, uint16_t b)
+    {
+        return SymbolTable::productName(a) < SymbolTable::productName(b); // Name order, like the menu's matching
+    });
+
+    size_t before = ownFills.size();
+    for (uint16_t product : products)
+    {
+        scratch.clear();
+        book.matchAsksToBids(SymbolTable::productName(product), timestamp, due, scratch);
+        for (const Fill& fill : scratch)
+        {
+            if (fill.involves(owner)) ownFills.push_back(fill);
+        }
+    }
+    return ownFills.size() - before;
+}
+
+size_t BookOverlay::memoryBytes() const
+{
+    return ownOrders.capacity() * sizeof(OrderBookEntry) + (ownFills.capacity() + scratch.capacity()) * sizeof(Fill);
+}
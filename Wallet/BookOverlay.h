@@ -0,0 +1,52 @@
+#pragma once
+
+#include "OrderBook.h"
+#include "Fill.h"
+#include <cstdint>
+#include <span>
+#include <vector>
+
+/** One trader's orders and fills layered over a shared book that is
+ * never written to. Reads go to the base book; the trader's orders are
+ * kept here and matched together with the base book's own orders, so
+ * many overlays can sit on one loaded book, each on its own thread,
+ * without copying any of it. An overlay's memory grows only with its
+ * own orders and fills.
+ */
+class BookOverlay
+{
+    public:
+        /** user is the SymbolTable id the overlay's orders are placed as */
+        BookOverlay(const OrderBook& base, uint32_t user);
+
+        const OrderBook& base() const { return book; }
+        uint32_t user() const { return owner; }
+
+        /** add orders to the overlay. They must not be earlier than the
+         * orders already in it, which is the case when a driver walks
+         * the timeframes in order.
+         */
+        void insertOrders(std::span<const OrderBookEntry> orders);
+        /** match the base book and the overlay's orders at the sent time,
+         * for each product the overlay has orders in, keeping the fills
+         * the overlay's user took part in. Returns how many were added
+         * to fills().
+         */
+        size_t match(int64_t timestamp);
+
+        /** the overlay's orders at the sent time, in the order they were inserted */
+        std::span<const OrderBookEntry> orders(int64_t timestamp) const;
+        /** every fill kept by match, oldest first */
+        const std::vector<Fill>& fills() const { return ownFills; }
+        /** bytes held for the overlay's orders and fills */
+        size_t memoryBytes() const;
+
+    private:
+        const OrderBook& book;
+        uint32_t owner;
+        /** in time order */
+        std::vector<OrderBookEntry> ownOrders;
+        std::vector<Fill> ownFills;
+        /** one product's fills during match, reused between calls */
+        std::vector<Fill> scratch;
+};
@@ -1,6 +1,12 @@
 #include "CSVReader.h"
-#include <iostream>
-#include <fstream>
+#include "MappedFile.h"
+#include "Logger.h"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+#include <chrono>
+#include <iterator>
 
 // Constructor for CSVReader
 CSVReader::CSVReader()
@@ -8,88 +14,275 @@ CSVReader::CSVReader()
     // Empty constructor: no initialization needed here
 }
 
-// Reads a CSV file and returns a vector of OrderBookEntry objects
-std::vector<OrderBookEntry> CSVReader::readCSV(std::string csvFilename)
+// Reads a CSV file and returns a vector of OrderBookEntry objects, printing one summary line
+std::vector<OrderBookEntry> CSVReader::readCSV(std::string csvFilename, unsigned threads)
 {
+    CSVReadSummary summary;
+    std::vector<OrderBookEntry> entries = readCSV(csvFilename, summary, threads);
+    LOG(csv, info) << "CSVReader::readCSV " << summary.toString(); // Report what was read and what was dropped
+    if (summary.threads.size() > 1 && Logger::enabled(LogModule::csv, LogLevel::info))
+    {
+        std::string report = summary.throughputReport(); // Show how evenly the loader threads shared the work
+        report.pop_back(); // The logger ends the last line itself
+        LOG(csv, info) << report;
+    }
+    return entries; // Return the vector of entries
+}
+
+// Reads a CSV file through a memory mapping, recording rejected lines in the summary
+std::vector<OrderBookEntry> CSVReader::readCSV(const std::string& csvFilename,
+                                               CSVReadSummary& summary,
+                                               unsigned threads)
+{
+    auto start = std::chrono::steady_clock::now();
     std::vector<OrderBookEntry> entries; // To store the entries from the CSV file
 
-    std::ifstream csvFile{csvFilename}; // Open the CSV file
-    std::string line;
-    if (csvFile.is_open()) // Check if the file has been successfully opened
+    MappedFile csvFile{csvFilename}; // Map the CSV file
+    if (csvFile.isOpen()) // Check if the file has been successfully opened
     {
-        while(std::getline(csvFile, line)) // Read each line of the CSV file
+        if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+        if (threads > 1)
         {
-            try {
-                OrderBookEntry obe = stringsToOBE(tokenise(line, ',')); // Convert the line to OrderBookEntry
-                entries.push_back(obe); // Add the entry to the vector
-            } catch(const std::exception& e) {
-                std::cout << "CSVReader::readCSV bad data" << std::endl; // Handle any parsing errors
-            }
+            parseCSVParallel(csvFile.view(), entries, summary, threads);
+        }
+        else
+        {
+            parseCSV(csvFile.view(), entries, summary);
+            summary.threads.push_back({summary.accepted, summary.bytes,
+                std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count()});
         }
     }
-
-    std::cout << "CSVReader::readCSV read " << entries.size() << " entries" << std::endl; // Print the number of entries read
+    summary.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
     return entries; // Return the vector of entries
 }
 
-// Splits a given line into tokens based on the specified separator
-std::vector<std::string> CSVReader::tokenise(std::string csvLine, char separator)
+// Parses chunks of text on their own threads, then joins them back up in file order
+void CSVReader::parseCSVParallel(std::string_view text,
+                                 std::vector<OrderBookEntry>& entries,
+                                 CSVReadSummary& summary,
+                                 unsigned threads)
 {
-    std::vector<std::string> tokens; // To store the tokens
-    signed int start, end;
-    std::string token;
-    start = csvLine.find_first_not_of(separator, 0);
-    do {
-        end = csvLine.find_first_of(separator, start);
-        if (start == csvLine.length() || start == end) break; // Stop if end of line or empty token
-        if (end >= 0) token = csvLine.substr(start, end - start); // Extract the token
-        else token = csvLine.substr(start, csvLine.length() - start);
-        tokens.push_back(token); // Add the token to the vector
-        start = end + 1; // Move start to the next character after the separator
-    } while(end > 0);
+    // Cut the text into roughly equal chunks, moving each cut forward to just after a newline
+    std::vector<std::string_view> chunks;
+    size_t chunkStart = 0;
+    for (unsigned i = 1; i <= threads && chunkStart < text.size(); ++i)
+    {
+        size_t cut = i == threads ? text.size() : std::max(chunkStart, text.size() / threads * i);
+        if (cut < text.size())
+        {
+            cut = text.find('\n', cut);
+            cut = cut == std::string_view::npos ? text.size() : cut + 1;
+        }
+        chunks.push_back(text.substr(chunkStart, cut - chunkStart));
+        chunkStart = cut;
+    }
 
-    return tokens; // Return the vector of tokens
+    std::vector<std::vector<OrderBookEntry>> chunkEntries(chunks.size());
+    std::vector<CSVReadSummary> chunkSummaries(chunks.size());
+    std::vector<std::thread> workers;
+    for (size_t i = 0; i < chunks.size(); ++i)
+    {
+        workers.emplace_back([&, i]()
+        {
+            auto start = std::chrono::steady_clock::now();
+            parseCSV(chunks[i], chunkEntries[i], chunkSummaries[i]); // Line numbers are fixed up when merging
+            chunkSummaries[i].threads.push_back({chunkSummaries[i].accepted, chunkSummaries[i].bytes,
+                std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count()});
+        });
+    }
+    for (std::thread& worker : workers) worker.join();
+
+    // Merge in file order, since OrderBook relies on rows arriving in timestamp order
+    size_t total = entries.size();
+    for (const std::vector<OrderBookEntry>& chunk : chunkEntries) total += chunk.size();
+    entries.reserve(total);
+    for (size_t i = 0; i < chunks.size(); ++i)
+    {
+        entries.insert(entries.end(),
+                       std::make_move_iterator(chunkEntries[i].begin()),
+                       std::make_move_iterator(chunkEntries[i].end()));
+        std::vector<OrderBookEntry>{}.swap(chunkEntries[i]); // Free each chunk as soon as it is merged
+        summary.append(chunkSummaries[i]);
+    }
 }
 
-// Converts a vector of strings to an OrderBookEntry object
-OrderBookEntry CSVReader::stringsToOBE(std::vector<std::string> tokens)
+// Parses every line of text, appending the good ones to entries
+void CSVReader::parseCSV(std::string_view text,
+                         std::vector<OrderBookEntry>& entries,
+                         CSVReadSummary& summary,
+                         size_t firstLine)
 {
-    double price, amount;
+    entries.reserve(entries.size() + std::count(text.begin(), text.end(), '\n') + 1);
+    summary.bytes += text.size();
+
+    size_t lineNumber = firstLine - 1;
+    std::string_view tokens[6];
+    std::string_view lastTimestampText; // Rows come in runs that share a timestamp, so remember the last one parsed
+    int64_t lastTimestamp = 0;
+    std::string_view lastProductText; // Products come in runs too, so remember the last one interned
+    int lastProduct = SymbolTable::none;
+
+    // Counts a rejected line under its reason, keeping the first few line numbers
+    auto reject = [&summary, &lineNumber](size_t& reason)
+    {
+        ++reason;
+        if (summary.firstRejectedLines.size() < CSVReadSummary::maxRejectedLinesKept)
+        {
+            summary.firstRejectedLines.push_back(lineNumber);
+        }
+    };
 
-    if (tokens.size() != 5) // Check if the line has exactly 5 tokens
+    const char* pos = text.data();
+    const char* end = text.data() + text.size();
+    while (pos < end)
     {
-        std::cout << "Bad line " << std::endl;
-        throw std::exception{}; // Throw an exception if not
+        const char* newline = static_cast<const char*>(std::memchr(pos, '\n', end - pos));
+        const char* lineEnd = newline != nullptr ? newline : end;
+        std::string_view line{pos, static_cast<size_t>(lineEnd - pos)};
+        pos = lineEnd + 1;
+        ++summary.lines;
+        ++lineNumber;
+
+        size_t fields = tokenise(line, ',', tokens, 6);
+        if (fields != 5 && fields != 6) // Check if the line has 5 tokens, or 6 with the user
+        {
+            reject(summary.badFieldCount);
+            continue;
+        }
+
+        Decimal price, amount;
+        if (!Decimal::parse(tokens[3], price) || !Decimal::parse(tokens[4], amount)) // Convert the price and amount straight from the text
+        {
+            reject(summary.badNumber);
+            continue;
+        }
+
+        if (tokens[0] != lastTimestampText) // Parse each timestamp once, here at load time
+        {
+            if (!OrderBookEntry::parseTimestamp(tokens[0], lastTimestamp))
+            {
+                lastTimestampText = std::string_view{};
+                reject(summary.badTimestamp);
+                continue;
+            }
+            lastTimestampText = tokens[0];
+        }
+
+        if (tokens[1] != lastProductText) // Intern each run of one product once
+        {
+            lastProduct = SymbolTable::productId(tokens[1]);
+            lastProductText = tokens[1];
+        }
+
+        entries.emplace_back(price, amount, lastTimestamp, lastProduct,
+                             OrderBookEntry::stringToOrderBookType(tokens[2]));
+        if (fields == 6) entries.back().userId = SymbolTable::userId(tokens[5]); // An order script can name whose order it is
+        ++summary.accepted;
     }
+}
 
-    try {
-        price = std::stod(tokens[3]); // Convert the price to a double
-        amount = std::stod(tokens[4]); // Convert the amount to a double
-    } catch(const std::exception& e) {
-        std::cout << "CSVReader::stringsToOBE Bad float! " << tokens[3] << std::endl;
-        std::cout << "CSVReader::stringsToOBE Bad float! " << tokens[4] << std::endl;
-        throw; // Re-throw the exception if conversion fails
+// Splits a given line into tokens based on the specified separator
+std::vector<std::string> CSVReader::tokenise(const std::string& csvLine, char separator)
+{
+    std::vector<std::string> tokens; // To store the tokens
+    std::string_view line{csvLine};
+    size_t start = line.find_first_not_of(separator);
+    while (start < line.size())
+    {
+        size_t end = line.find(separator, start);
+        if (end == start) break; // Stop at an empty token
+        tokens.emplace_back(line.substr(start, end == std::string_view::npos ? end : end - start)); // Add the token to the vector
+        if (end == std::string_view::npos) break;
+        start = end + 1; // Move start to the next character after the separator
     }
 
-    OrderBookEntry obe{price, amount, tokens[0], tokens[1], OrderBookEntry::stringToOrderBookType(tokens[2])};
-    return obe; // Construct and return the OrderBookEntry object
+    return tokens; // Return the vector of tokens
+}
+
+// Splits a line into views on the line itself: leading separators are skipped and an empty field ends the line
+size_t CSVReader::tokenise(std::string_view csvLine, char separator,
+                           std::string_view* tokens, size_t maxTokens)
+{
+    size_t count = 0;
+    size_t start = csvLine.find_first_not_of(separator);
+    while (start < csvLine.size())
+    {
+        size_t end = csvLine.find(separator, start);
+        if (end == start) break; // Stop at an empty token
+        if (count == maxTokens) return maxTokens + 1; // Too many tokens, the caller only needs to know that
+        tokens[count++] = csvLine.substr(start, end == std::string_view::npos ? end : end - start);
+        if (end == std::string_view::npos) break;
+        start = end + 1; // Move start to the next character after the separator
+    }
+    return count;
 }
+
 // Alternative method to create an OrderBookEntry from individual string components
 OrderBookEntry CSVReader::stringsToOBE(std::string priceString, 
                                        std::string amountString, 
-                                       std::string timestamp, 
+                                       int64_t timestamp, 
                                        std::string product, 
                                        OrderBookType orderType)
 {
-    double price, amount;
-    try {
-        price = std::stod(priceString); // Convert the price string to a double
-        amount = std::stod(amountString); // Convert the amount string to a double
-    } catch(const std::exception& e) {
-        std::cout << "CSVReader::stringsToOBE Bad float! " << priceString << std::endl;
-        std::cout << "CSVReader::stringsToOBE Bad float! " << amountString << std::endl;
-        throw; // Throw exception if conversion fails
+    Decimal price, amount;
+    if (!Decimal::parse(priceString, price) || !Decimal::parse(amountString, amount)) // Convert the price and amount strings
+    {
+        LOG(csv, warn) << "CSVReader::stringsToOBE Bad float! " << priceString;
+        LOG(csv, warn) << "CSVReader::stringsToOBE Bad float! " << amountString;
+        throw std::invalid_argument{"bad float"}; // Throw exception if conversion fails
     }
     OrderBookEntry obe{price, amount, timestamp, product, orderType};
     return obe; // Construct and return the OrderBookEntry object
-}
\ No newline at end of file
+}
+
+// Adds the counts of the chunk that follows this one, shifting its line numbers past ours
+void CSVReadSummary::append(const CSVReadSummary& next)
+{
+    for (size_t line : next.firstRejectedLines)
+    {
+        if (firstRejectedLines.size() == maxRejectedLinesKept) break;
+        firstRejectedLines.push_back(lines + line);
+    }
+    bytes += next.bytes;
+    lines += next.lines;
+    accepted += next.accepted;
+    badFieldCount += next.badFieldCount;
+    badNumber += next.badNumber;
+    badTimestamp += next.badTimestamp;
+    threads.insert(threads.end(), next.threads.begin(), next.threads.end());
+}
+
+// Formats the summary as a single line for the console
+std::string CSVReadSummary::toString() const
+{
+    std::string s = "read " + std::to_string(accepted) + " entries";
+    if (rejected() == 0) return s;
+
+    s += ", rejected " + std::to_string(rejected()) + " lines (" +
+         std::to_string(badFieldCount) + " wrong field count, " +
+         std::to_string(badNumber) + " bad number, " +
+         std::to_string(badTimestamp) + " bad timestamp) at line";
+    if (firstRejectedLines.size() > 1) s += "s";
+    for (size_t i = 0; i < firstRejectedLines.size(); ++i)
+    {
+        s += (i == 0 ? " " : ", ") + std::to_string(firstRejectedLines[i]);
+    }
+    if (rejected() > firstRejectedLines.size()) s += ", ...";
+    return s;
+}
+
+// Formats rows/sec per loader thread and overall, one line each
+std::string CSVReadSummary::throughputReport() const
+{
+    std::string s;
+    for (size_t i = 0; i < threads.size(); ++i)
+    {
+        const ThreadTiming& t = threads[i];
+        s += "  thread " + std::to_string(i) + ": " + std::to_string(t.rows) + " rows in " +
+             std::to_string(t.seconds) + " s, " +
+             std::to_string(static_cast<long long>(t.seconds > 0 ? t.rows / t.seconds : 0)) + " rows/sec\n";
+    }
+    s += "  total: " + std::to_string(accepted) + " rows in " + std::to_string(seconds) + " s, " +
+         std::to_string(static_cast<long long>(seconds > 0 ? accepted / seconds : 0)) + " rows/sec\n";
+    return s;
+}
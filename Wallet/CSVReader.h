@@ -3,23 +3,88 @@
 #include "OrderBookEntry.h"
 #include <vector>
 #include <string>
+#include <string_view>
 
+/** what readCSV made of a file: how much it read and why lines were dropped */
+struct CSVReadSummary
+{
+    size_t bytes = 0;
+    size_t lines = 0;
+    size_t accepted = 0;
+    /** lines without 5 fields, or 6 with a username, including blank lines */
+    size_t badFieldCount = 0;
+    /** lines whose price or amount is not a number */
+    size_t badNumber = 0;
+    /** lines whose timestamp does not parse */
+    size_t badTimestamp = 0;
+    /** 1-based numbers of the first few rejected lines, for tracking them down */
+    std::vector<size_t> firstRejectedLines;
+    /** the largest number of rejected line numbers a summary keeps */
+    static constexpr size_t maxRejectedLinesKept = 10;
+
+    /** how long one loader thread took over its chunk of the file */
+    struct ThreadTiming
+    {
+        size_t rows = 0;
+        size_t bytes = 0;
+        double seconds = 0;
+    };
+    /** one timing per loader thread, in file order */
+    std::vector<ThreadTiming> threads;
+    /** wall clock time for the whole read, including the merge */
+    double seconds = 0;
+
+    size_t rejected() const { return badFieldCount + badNumber + badTimestamp; }
+    /** fold in the summary of the chunk that follows this one in the file */
+    void append(const CSVReadSummary& next);
+    /** one line summary, e.g. "read 3540 entries, rejected 9 lines (...)" */
+    std::string toString() const;
+    /** rows/sec for each loader thread and for the whole read, one per line */
+    std::string throughputReport() const;
+};
 
 class CSVReader
 {
     public:
      CSVReader();
 
-     static std::vector<OrderBookEntry> readCSV(std::string csvFile);
-     static std::vector<std::string> tokenise(std::string csvLine, char separator);
+     /** read a whole csv file, printing a one line summary.
+      * With more than one thread the file is split into that many chunks
+      * at line boundaries and the throughput of each thread is printed too.
+      * threads = 0 means one per hardware thread.
+      */
+     static std::vector<OrderBookEntry> readCSV(std::string csvFile, unsigned threads = 1);
+     /** read a whole csv file, filling in summary instead of printing */
+     static std::vector<OrderBookEntry> readCSV(const std::string& csvFile,
+                                                CSVReadSummary& summary,
+                                                unsigned threads = 1);
+     /** parse csv text already in memory, appending to entries.
+      * firstLine is the 1-based line number of the first line in text.
+      */
+     static void parseCSV(std::string_view text,
+                          std::vector<OrderBookEntry>& entries,
+                          CSVReadSummary& summary,
+                          size_t firstLine = 1);
+
+     static std::vector<std::string> tokenise(const std::string& csvLine, char separator);
+     /** split csvLine into at most maxTokens views, with the same rules as
+      * tokenise. Returns the token count, or maxTokens + 1 if there were more.
+      */
+     static size_t tokenise(std::string_view csvLine, char separator,
+                            std::string_view* tokens, size_t maxTokens);
     
      static OrderBookEntry stringsToOBE(std::string price, 
                                         std::string amount, 
-                                        std::string timestamp, 
+                                        int64_t timestamp, 
                                         std::string product, 
                                         OrderBookType OrderBookType);
 
     private:
-     static OrderBookEntry stringsToOBE(std::vector<std::string> strings);
-     
-};
\ No newline at end of file
+     /** split text into chunks at line boundaries, parse each on its own
+      * thread and merge the results in file order
+      */
+     static void parseCSVParallel(std::string_view text,
+                                  std::vector<OrderBookEntry>& entries,
+                                  CSVReadSummary& summary,
+                                  unsigned threads);
+};
@@ -0,0 +1,70 @@
+#include "CSVStreamReader.h"
+#include <utility>
+
+// Opens the file; nothing is read until the first timeframe is asked for
+CSVStreamReader::CSVStreamReader(const std::string& filename, size_t _blockSize)
+: file(filename, std::ios::binary),
+  blockSize(_blockSize)
+{
+}
+
+// Hands out the rows of the next timeframe, reading more of the file as needed
+bool CSVStreamReader::readTimeframe(std::vector<OrderBookEntry>& entries)
+{
+    entries.clear();
+    while (pending.empty())
+    {
+        if (!readBlock()) return false; // Nothing left in the file
+    }
+
+    int64_t timestamp = pending.front().timestamp;
+    while (true)
+    {
+        while (!pending.empty() && pending.front().timestamp == timestamp)
+        {
+            entries.push_back(std::move(pending.front()));
+            pending.pop_front();
+        }
+        if (!pending.empty()) break; // The next timeframe has started
+        if (!readBlock()) break; // The timeframe ran to the end of the file
+    }
+    return true;
+}
+
+// Goes back to the top of the file and forgets everything read so far
+void CSVStreamReader::rewind()
+{
+    file.clear();
+    file.seekg(0);
+    buffer.clear();
+    pending.clear();
+    endOfFile = false;
+    summary = CSVReadSummary{};
+}
+
+// Reads one block, parses the complete lines in it and keeps the partial last line for next time
+bool CSVStreamReader::readBlock()
+{
+    if (endOfFile || !file.is_open()) return false;
+
+    size_t carried = buffer.size();
+    buffer.resize(carried + blockSize);
+    file.read(&buffer[carried], blockSize);
+    buffer.resize(carried + static_cast<size_t>(file.gcount()));
+    if (!file) endOfFile = true;
+
+    size_t end = buffer.size();
+    if (!endOfFile)
+    {
+        size_t lastNewline = buffer.rfind('\n');
+        if (lastNewline == std::string::npos) return true; // No complete line yet, keep reading
+        end = lastNewline + 1;
+    }
+    if (end == 0) return false;
+
+    std::vector<OrderBookEntry> rows;
+    CSVReader::parseCSV(std::string_view{buffer.data(), end}, rows, summary, summary.lines + 1);
+    for (OrderBookEntry& row : rows) pending.push_back(std::move(row));
+    buffer.erase(0, end);
+    return true;
+}
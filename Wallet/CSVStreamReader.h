@@ -0,0 +1,45 @@
+#pragma once
+
+#include "OrderBookEntry.h"
+#include "CSVReader.h"
+#include <deque>
+#include <fstream>
+#include <string>
+#include <vector>
+
+/** Reads a csv data file front to back one timeframe at a time,
+ * holding only a block of the file and the rows not handed out yet.
+ * Rows are expected in timestamp order, as in the data files.
+ */
+class CSVStreamReader
+{
+    public:
+        CSVStreamReader(const std::string& filename, size_t blockSize = 1 << 20);
+
+        bool isOpen() const { return file.is_open(); }
+        /** replace entries with every row of the next timeframe.
+         * Returns false once the whole file has been handed out.
+         */
+        bool readTimeframe(std::vector<OrderBookEntry>& entries);
+        /** start again from the top of the file */
+        void rewind();
+        /** true once the last row has been handed out */
+        bool atEnd() const { return endOfFile && pending.empty(); }
+        /** what has been read so far */
+        const CSVReadSummary& getSummary() const { return summary; }
+
+    private:
+        /** read the next block and parse its complete lines into pending.
+         * Returns false if there was nothing left to read.
+         */
+        bool readBlock();
+
+        std::ifstream file;
+        size_t blockSize;
+        /** the last block read, starting with any partial line left over from the block before */
+        std::string buffer;
+        /** parsed rows not yet handed out */
+        std::deque<OrderBookEntry> pending;
+        bool endOfFile = false;
+        CSVReadSummary summary;
+};
@@ -0,0 +1,147 @@
+#include "CandleEngine.h"
+#include "OrderBook.h"
+#include "PriceKernels.h"
+#include "SymbolTable.h"
+#include <algorithm>
+#include <stdexcept>
+
+CandleEngine::CandleEngine(int64_t interval)
+: interval(interval)
+{
+    if (interval < 0) throw std::invalid_argument{"candle interval must not be negative"};
+}
+
+// Reduces the ticks with the kernels, then folds them into the product's last candle or a new one
+void CandleEngine::add(int product, int64_t timestamp, const Decimal* tickPrices, const Decimal* tickAmounts, size_t count)
+{
+    if (count == 0) return;
+    if (series.size() <= static_cast<size_t>(product)) series.resize(product + 1);
+    std::vector<Candle>& candles = series[product];
+
+    int64_t start = timestamp;
+    if (interval > 0)
+    {
+        start = timestamp - timestamp % interval;
+        if (timestamp % interval < 0) start -= interval; // Round down before the epoch too
+    }
+    if (!candles.empty() && start < candles.back().start)
+    {
+        throw std::invalid_argument{"candle ticks must arrive in time order"};
+    }
+
+    // The kernels are exact; the candle keeps doubles for reporting
+    double high = PriceKernels::max(tickPrices, count).toDouble();
+    double low = PriceKernels::min(tickPrices, count).toDouble();
+    double volume = PriceKernels::sum(tickAmounts, count).toDouble();
+    double notional = PriceKernels::dot(tickPrices, tickAmounts, count);
+    double open = tickPrices[0].toDouble();
+    double close = tickPrices[count - 1].toDouble();
+
+    if (candles.empty() || candles.back().start != start)
+    {
+        candles.push_back(Candle{start, open, high, low, close, volume, notional, count});
+        return;
+    }
+    Candle& candle = candles.back();
+    candle.high = std::max(candle.high, high);
+    candle.low = std::min(candle.low, low);
+    candle.close = close;
+    candle.volume += volume;
+    candle.notional += notional;
+    candle.trades += count;
+}
+
+// Gathers the prices and amounts into arrays so the kernels can run over them
+void CandleEngine::add(const std::string& product, int64_t timestamp, std::span<const OrderBookEntry> ticks)
+{
+    if (ticks.empty()) return;
+    prices.clear();
+    amounts.clear();
+    for (const OrderBookEntry& tick : ticks)
+    {
+        prices.push_back(tick.price);
+        amounts.push_back(tick.amount);
+    }
+    add(SymbolTable::productId(product), timestamp, prices.data(), amounts.data(), ticks.size());
+}
+
+void CandleEngine::add(const std::string& product, int64_t timestamp, std::span<const Fill> fills)
+{
+    if (fills.empty()) return;
+    prices.clear();
+    amounts.clear();
+    for (const Fill& fill : fills)
+    {
+        prices.push_back(fill.price);
+        amounts.push_back(fill.amount);
+    }
+    add(SymbolTable::productId(product), timestamp, prices.data(), amounts.data(), fills.size());
+}
+
+// Snapshot buckets are already contiguous runs of prices and amounts, so they go straight in
+void CandleEngine::addQuotes(const MarketSnapshot& snapshot, OrderBookType type)
+{
+    std::vector<int> productIds;
+    for (size_t p = 0; p < snapshot.productCount(); ++p)
+    {
+        productIds.push_back(SymbolTable::productId(snapshot.productName(p)));
+    }
+    int side = MarketSnapshot::sideOf(type);
+    for (size_t tf = 0; tf < snapshot.timeframeCount(); ++tf)
+    {
+        for (size_t p = 0; p < snapshot.productCount(); ++p)
+        {
+            std::pair<size_t, size_t> rows = snapshot.bucket(tf, p, side);
+            add(productIds[p], snapshot.timeframe(tf), snapshot.prices() + rows.first,
+                snapshot.amounts() + rows.first, rows.second - rows.first);
+        }
+    }
+}
+
+// Walks the book one timeframe at a time until it wraps round to the start, reading each side in place
+void CandleEngine::addQuotes(OrderBook& book, OrderBookType type)
+{
+    std::vector<std::string> products = book.getKnownProducts();
+    int64_t time = book.getEarliestTime();
+    while (true)
+    {
+        for (const std::string& p : products)
+        {
+            OrderView orders = book.getOrders(type, p, time);
+            if (orders.empty()) continue;
+            prices.clear();
+            amounts.clear();
+            for (const OrderBookEntry& order : orders)
+            {
+                prices.push_back(order.price);
+                amounts.push_back(order.amount);
+            }
+            add(SymbolTable::productId(p), time, prices.data(), amounts.data(), orders.size());
+        }
+        int64_t next = book.getNextTime(time);
+        if (next <= time) break; // Wrapped round to the start
+        time = next;
+    }
+}
+
+const std::vector<Candle>& CandleEngine::candles(const std::string& product) const
+{
+    static const std::vector<Candle> none;
+    int id = SymbolTable::productId(product);
+    return static_cast<size_t>(id) < series.size() ? series[id] : none;
+}
+
+// Products come out in id order, each product's candles oldest first
+void CandleEngine::writeCSV(std::ostream& out) const
+{
+    for (size_t p = 0; p < series.size(); ++p)
+    {
+        for (const Candle& c : series[p])
+        {
+            out << SymbolTable::productName(static_cast<int>(p)) << ','
+                << OrderBookEntry::timestampToString(c.start) << ','
+                << c.open << ',' << c.high << ',' << c.low << ',' << c.close << ','
+                << c.volume << ',' << c.vwap() << ',' << c.trades << '\n';
+        }
+    }
+}
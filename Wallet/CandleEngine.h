@@ -0,0 +1,76 @@
+#pragma once
+
+#include "OrderBookEntry.h"
+#include "MarketSnapshot.h"
+#include "Fill.h"
+#include <cstdint>
+#include <ostream>
+#include <span>
+#include <string>
+#include <vector>
+
+class OrderBook;
+
+/** open, high, low, close and volume of the ticks in one interval */
+struct Candle
+{
+    /** start of the interval, microseconds since the epoch */
+    int64_t start = 0;
+    double open = 0;
+    double high = 0;
+    double low = 0;
+    double close = 0;
+    /** total amount */
+    double volume = 0;
+    /** total price * amount */
+    double notional = 0;
+    uint64_t trades = 0;
+
+    /** volume-weighted average price, 0 if there is no volume */
+    double vwap() const { return volume > 0 ? notional / volume : 0; }
+};
+
+/** Builds candles for each product from ticks: fills from
+ * matchAsksToBids, or the orders in the book. Ticks are added one
+ * timeframe at a time, either as each timeframe is matched or in a
+ * batch over a whole day, and each batch is reduced with PriceKernels.
+ */
+class CandleEngine
+{
+    public:
+        /** interval is the candle length in microseconds. Candles start
+         * on whole multiples of it; 0 gives one candle per timeframe.
+         */
+        CandleEngine(int64_t interval);
+
+        /** add one timeframe's ticks for a product, in the order they
+         * happened. Each product's timeframes must arrive in time order;
+         * throws std::invalid_argument if one goes back in time.
+         */
+        void add(int product, int64_t timestamp, const Decimal* prices, const Decimal* amounts, size_t count);
+        /** same, for the orders or sales of one product at one time */
+        void add(const std::string& product, int64_t timestamp, std::span<const OrderBookEntry> ticks);
+        /** same, for the fills of one product at one time */
+        void add(const std::string& product, int64_t timestamp, std::span<const Fill> fills);
+        /** batch build over the orders on one side of every product in a snapshot */
+        void addQuotes(const MarketSnapshot& snapshot, OrderBookType type);
+        /** batch build over the orders on one side of every product in a book,
+         * visiting its timeframes from the earliest
+         */
+        void addQuotes(OrderBook& book, OrderBookType type);
+
+        /** the product's candles so far, oldest first */
+        const std::vector<Candle>& candles(const std::string& product) const;
+        /** every product's candles, one csv line each:
+         * product,start,open,high,low,close,volume,vwap,trades
+         */
+        void writeCSV(std::ostream& out) const;
+
+    private:
+        int64_t interval;
+        /** candles per product, indexed by SymbolTable product id */
+        std::vector<std::vector<Candle>> series;
+        /** gathered prices and amounts for add(), reused between calls */
+        std::vector<Decimal> prices;
+        std::vector<Decimal> amounts;
+};
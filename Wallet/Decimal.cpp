@@ -0,0 +1,164 @@
+#include "Decimal.h"
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+namespace
+{
+    using Wide = __int128;
+
+    // The most digits the mantissa keeps; any more could overflow it
+    const int maxMantissaDigits = 36;
+
+    Wide powerOf10(int n)
+    {
+        Wide p = 1;
+        for (int i = 0; i < n; ++i) p *= 10;
+        return p;
+    }
+
+    // Divides, rounding to the nearest whole number with halves away from zero
+    Wide divideRounded(Wide n, Wide d)
+    {
+        Wide q = n / d;
+        Wide r = n % d;
+        if (r < 0) r = -r;
+        if (d < 0) d = -d;
+        if (2 * r >= d) q += (n < 0) != (d < 0) ? -1 : 1;
+        return q;
+    }
+
+    // Narrows a result back to units, which must fit in an int64
+    int64_t toUnits(Wide v, const char* what)
+    {
+        if (v > std::numeric_limits<int64_t>::max() || v < std::numeric_limits<int64_t>::min())
+        {
+            throw std::overflow_error{what};
+        }
+        return static_cast<int64_t>(v);
+    }
+}
+
+Decimal Decimal::fromDouble(double v)
+{
+    double units = std::round(v * static_cast<double>(scale));
+    if (!(std::abs(units) < 9.2e18)) throw std::overflow_error{"Decimal::fromDouble out of range"};
+    return fromUnits(static_cast<int64_t>(units));
+}
+
+// Reads the digits into a wide mantissa and a power of ten, then shifts it to units once at the end
+bool Decimal::parse(std::string_view s, Decimal& value)
+{
+    const char* p = s.data();
+    const char* end = s.data() + s.size();
+    while (p < end && (*p == ' ' || (*p >= '\t' && *p <= '\r'))) ++p;
+    bool negative = false;
+    if (p < end && (*p == '+' || *p == '-')) negative = *p++ == '-';
+
+    Wide mantissa = 0;
+    int digits = 0;   // Digits kept in the mantissa, leading zeros aside
+    int exponent = 0; // Power of ten the mantissa is scaled by
+    bool sawDigit = false;
+    bool roundUp = false; // The first digit dropped past maxMantissaDigits was 5 or more
+    bool droppedAny = false;
+
+    for (; p < end && *p >= '0' && *p <= '9'; ++p)
+    {
+        sawDigit = true;
+        if (digits < maxMantissaDigits)
+        {
+            mantissa = mantissa * 10 + (*p - '0');
+            if (mantissa != 0) ++digits;
+        }
+        else
+        {
+            if (!droppedAny) roundUp = *p >= '5';
+            droppedAny = true;
+            ++exponent; // Whole digits past the ones kept still count
+        }
+    }
+    if (p < end && *p == '.')
+    {
+        ++p;
+        for (; p < end && *p >= '0' && *p <= '9'; ++p)
+        {
+            sawDigit = true;
+            if (digits < maxMantissaDigits)
+            {
+                mantissa = mantissa * 10 + (*p - '0');
+                if (mantissa != 0) ++digits;
+                --exponent;
+            }
+            else if (!droppedAny)
+            {
+                roundUp = *p >= '5';
+                droppedAny = true;
+            }
+        }
+    }
+    if (!sawDigit) return false;
+    if (roundUp) ++mantissa;
+
+    // An exponent only counts if it has digits, otherwise the number ends before the 'e'
+    if (p < end && (*p == 'e' || *p == 'E'))
+    {
+        const char* q = p + 1;
+        bool negativeExponent = false;
+        if (q < end && (*q == '+' || *q == '-')) negativeExponent = *q++ == '-';
+        if (q < end && *q >= '0' && *q <= '9')
+        {
+            int e = 0;
+            for (; q < end && *q >= '0' && *q <= '9'; ++q)
+            {
+                if (e < 10000) e = e * 10 + (*q - '0');
+            }
+            exponent += negativeExponent ? -e : e;
+        }
+    }
+
+    int shift = exponent + places;
+    Wide units;
+    if (mantissa == 0) units = 0;
+    else if (shift >= 0)
+    {
+        if (shift + digits > 19) return false; // Can not fit in an int64
+        units = mantissa * powerOf10(shift);
+    }
+    else if (-shift > maxMantissaDigits + 2) units = 0; // Rounds away to nothing
+    else units = divideRounded(mantissa, powerOf10(-shift));
+
+    if (negative) units = -units;
+    if (units > std::numeric_limits<int64_t>::max() || units < std::numeric_limits<int64_t>::min()) return false;
+    value = fromUnits(static_cast<int64_t>(units));
+    return true;
+}
+
+std::string Decimal::toString() const
+{
+    uint64_t magnitude = value < 0 ? 0 - static_cast<uint64_t>(value) : static_cast<uint64_t>(value);
+    std::string s = value < 0 ? "-" : "";
+    s += std::to_string(magnitude / scale);
+    uint64_t fraction = magnitude % scale;
+    if (fraction == 0) return s;
+    std::string digits = std::to_string(fraction);
+    digits.insert(0, places - digits.size(), '0');
+    digits.erase(digits.find_last_not_of('0') + 1);
+    return s + "." + digits;
+}
+
+Decimal operator*(Decimal a, Decimal b)
+{
+    Wide product = static_cast<Wide>(a.units()) * b.units();
+    return Decimal::fromUnits(toUnits(divideRounded(product, Decimal::scale), "Decimal product out of range"));
+}
+
+Decimal operator/(Decimal a, int64_t divisor)
+{
+    if (divisor == 0) throw std::domain_error{"Decimal divided by zero"};
+    return Decimal::fromUnits(toUnits(divideRounded(a.units(), divisor), "Decimal quotient out of range"));
+}
+
+std::ostream& operator<<(std::ostream& os, Decimal d)
+{
+    return os << d.toDouble();
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <compare>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <string_view>
+
+/** digits kept after the point; build with -DDECIMAL_PLACES=n to change it */
+#ifndef DECIMAL_PLACES
+#define DECIMAL_PLACES 8
+#endif
+
+/** A fixed-point number for prices, amounts and balances: a whole
+ * number of units of 10^-places, 1e-8 (a satoshi) by default. Adding,
+ * subtracting and comparing are exact integer operations, so equal
+ * amounts compare equal and repeated partial fills do not drift, and
+ * a price can be used as a hash key. Multiplying rounds to the nearest
+ * unit, halves away from zero.
+ *
+ * Plain data holding one int64, so arrays of it can be written to
+ * and mapped from snapshots, and read by the integer kernels.
+ */
+class Decimal
+{
+    public:
+        static constexpr int places = DECIMAL_PLACES;
+        static_assert(places >= 0 && places <= 18, "DECIMAL_PLACES must be between 0 and 18");
+        /** units in one whole, 10^places */
+        static constexpr int64_t scale = []
+        {
+            int64_t s = 1;
+            for (int i = 0; i < places; ++i) s *= 10;
+            return s;
+        }();
+
+        constexpr Decimal() = default;
+
+        static constexpr Decimal fromUnits(int64_t units) { Decimal d; d.value = units; return d; }
+        static constexpr Decimal whole(int64_t n) { return fromUnits(n * scale); }
+        /** the nearest Decimal to a double, for values that only exist as one */
+        static Decimal fromDouble(double v);
+        /** parse decimal text like "0.02187308", "-5" or "1.5e-3" straight
+         * into units, with no double in between. Leading whitespace is
+         * skipped and anything after the number is ignored, as std::stod
+         * does. Digits past the last place are rounded. Returns false if
+         * there is no number or it does not fit.
+         */
+        static bool parse(std::string_view s, Decimal& value);
+
+        constexpr int64_t units() const { return value; }
+        double toDouble() const { return static_cast<double>(value) / static_cast<double>(scale); }
+        /** every digit, with trailing zeros after the point dropped: "0.0219", "12" */
+        std::string toString() const;
+
+        constexpr auto operator<=>(const Decimal&) const = default;
+
+        constexpr Decimal operator-() const { return fromUnits(-value); }
+        constexpr Decimal& operator+=(Decimal other) { value += other.value; return *this; }
+        constexpr Decimal& operator-=(Decimal other) { value -= other.value; return *this; }
+        friend constexpr Decimal operator+(Decimal a, Decimal b) { return a += b; }
+        friend constexpr Decimal operator-(Decimal a, Decimal b) { return a -= b; }
+        /** the product rounded to a unit; throws std::overflow_error if it does not fit */
+        friend Decimal operator*(Decimal a, Decimal b);
+        /** divided by a whole number, rounded to a unit */
+        friend Decimal operator/(Decimal a, int64_t divisor);
+
+    private:
+        int64_t value = 0;
+};
+
+/** writes the value as a double, so the stream's precision and format flags apply */
+std::ostream& operator<<(std::ostream& os, Decimal d);
+
+template <>
+struct std::hash<Decimal>
+{
+    size_t operator()(Decimal d) const noexcept { return std::hash<int64_t>{}(d.units()); }
+};
+
+static_assert(sizeof(Decimal) == sizeof(int64_t), "Decimal should be a bare int64");
@@ -0,0 +1,135 @@
+#include "DepthLadder.h"
+#include <algorithm>
+
+namespace
+{
+    // Totals of the levels before position i, zero before the first
+    double amountBefore(std::span<const DepthLevel> ladder, size_t i)
+    {
+        return i == 0 ? 0 : ladder[i - 1].cumulativeAmount;
+    }
+
+    double notionalBefore(std::span<const DepthLevel> ladder, size_t i)
+    {
+        return i == 0 ? 0 : ladder[i - 1].cumulativeNotional;
+    }
+}
+
+// Finds or makes the price's level, then bumps the totals from there up
+void DepthLadder::add(std::vector<DepthLevel>& ladder, double price, double amount)
+{
+    auto level = std::lower_bound(ladder.begin(), ladder.end(), price,
+                                  [](const DepthLevel& l, double p) { return l.price < p; });
+    if (level == ladder.end() || level->price != price)
+    {
+        size_t i = level - ladder.begin();
+        level = ladder.insert(level, DepthLevel{price, 0, amountBefore(ladder, i), notionalBefore(ladder, i)});
+    }
+    level->amount += amount;
+    for (; level != ladder.end(); ++level)
+    {
+        level->cumulativeAmount += amount;
+        level->cumulativeNotional += price * amount;
+    }
+}
+
+// Walks both ladders in price order like a merge sort, then redoes the totals
+std::vector<DepthLevel> DepthLadder::merge(std::span<const DepthLevel> a, std::span<const DepthLevel> b)
+{
+    std::vector<DepthLevel> merged;
+    merged.reserve(a.size() + b.size());
+    size_t i = 0;
+    size_t j = 0;
+    while (i < a.size() || j < b.size())
+    {
+        DepthLevel next;
+        if (j == b.size() || (i < a.size() && a[i].price < b[j].price)) next = a[i++];
+        else if (i == a.size() || b[j].price < a[i].price) next = b[j++];
+        else
+        {
+            next = a[i++];
+            next.amount += b[j++].amount;
+        }
+        next.cumulativeAmount = (merged.empty() ? 0 : merged.back().cumulativeAmount) + next.amount;
+        next.cumulativeNotional = (merged.empty() ? 0 : merged.back().cumulativeNotional) + next.price * next.amount;
+        merged.push_back(next);
+    }
+    return merged;
+}
+
+// Copies the best levels out, turning the totals round for bids so they count from the dearest
+std::vector<DepthLevel> DepthLadder::top(std::span<const DepthLevel> ladder, bool dearestFirst, size_t count)
+{
+    count = std::min(count, ladder.size());
+    std::vector<DepthLevel> levels;
+    levels.reserve(count);
+    if (!dearestFirst)
+    {
+        levels.assign(ladder.begin(), ladder.begin() + count);
+        return levels;
+    }
+    const DepthLevel& last = ladder.back();
+    for (size_t k = 0; k < count; ++k)
+    {
+        size_t i = ladder.size() - 1 - k;
+        levels.push_back(DepthLevel{ladder[i].price, ladder[i].amount,
+                                    last.cumulativeAmount - amountBefore(ladder, i),
+                                    last.cumulativeNotional - notionalBefore(ladder, i)});
+    }
+    return levels;
+}
+
+// Binary searches the running totals for the level where the size runs out, then adds the part taken from it
+SizeQuote DepthLadder::priceForSize(std::span<const DepthLevel> ladder, bool dearestFirst, double size)
+{
+    SizeQuote quote;
+    if (ladder.empty() || size <= 0) return quote;
+    const DepthLevel& last = ladder.back();
+    quote.bestPrice = dearestFirst ? last.price : ladder.front().price;
+
+    if (size >= last.cumulativeAmount) // Takes the whole side
+    {
+        quote.filled = last.cumulativeAmount;
+        quote.averagePrice = quote.filled > 0 ? last.cumulativeNotional / quote.filled : 0;
+        quote.worstPrice = dearestFirst ? ladder.front().price : last.price;
+        return quote;
+    }
+
+    double notional;
+    size_t i;
+    if (!dearestFirst)
+    {
+        // First level whose running total reaches the size
+        i = std::lower_bound(ladder.begin(), ladder.end(), size,
+                             [](const DepthLevel& l, double s) { return l.cumulativeAmount < s; }) - ladder.begin();
+        notional = notionalBefore(ladder, i) + (size - amountBefore(ladder, i)) * ladder[i].price;
+    }
+    else
+    {
+        // Counting from the top, the levels above i hold less than the size and i makes it up
+        double leave = last.cumulativeAmount - size;
+        i = std::upper_bound(ladder.begin(), ladder.end(), leave,
+                             [](double s, const DepthLevel& l) { return s < l.cumulativeAmount; }) - ladder.begin();
+        double above = last.cumulativeAmount - ladder[i].cumulativeAmount;
+        notional = (last.cumulativeNotional - ladder[i].cumulativeNotional) + (size - above) * ladder[i].price;
+    }
+    quote.filled = size;
+    quote.averagePrice = notional / size;
+    quote.worstPrice = ladder[i].price;
+    return quote;
+}
+
+// Binary searches the prices for the limit and reads the running total there
+double DepthLadder::sizeWithin(std::span<const DepthLevel> ladder, bool dearestFirst, double limitPrice)
+{
+    if (ladder.empty()) return 0;
+    if (!dearestFirst)
+    {
+        size_t i = std::upper_bound(ladder.begin(), ladder.end(), limitPrice,
+                                    [](double p, const DepthLevel& l) { return p < l.price; }) - ladder.begin();
+        return amountBefore(ladder, i);
+    }
+    size_t i = std::lower_bound(ladder.begin(), ladder.end(), limitPrice,
+                                [](const DepthLevel& l, double p) { return l.price < p; }) - ladder.begin();
+    return ladder.back().cumulativeAmount - amountBefore(ladder, i);
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstddef>
+#include <span>
+#include <vector>
+
+/** one price level of one side of a book */
+struct DepthLevel
+{
+    double price = 0;
+    /** total amount of the orders at this price */
+    double amount = 0;
+    /** amount at this price and every level before it */
+    double cumulativeAmount = 0;
+    /** price * amount summed over the same levels */
+    double cumulativeNotional = 0;
+};
+
+/** what it would cost to take an amount from one side of a book, best levels first */
+struct SizeQuote
+{
+    /** how much could be filled; less than asked for if the side runs out */
+    double filled = 0;
+    /** average price of the part filled, 0 if nothing was */
+    double averagePrice = 0;
+    /** price of the last level reached */
+    double worstPrice = 0;
+    /** price of the first level, to measure the impact against */
+    double bestPrice = 0;
+
+    /** how far the average price moved from the best one, as a fraction of it */
+    double impact() const { return bestPrice != 0 ? (averagePrice - bestPrice) / bestPrice : 0; }
+};
+
+/** Queries over a depth ladder: one side's price levels, cheapest first,
+ * with running totals of amount and notional from the cheapest up.
+ * Those prefix sums let every query binary search instead of scanning.
+ * Asks are taken from the cheapest level and bids from the dearest,
+ * so each query says which end to start from.
+ */
+class DepthLadder
+{
+    public:
+        /** add an amount at a price, keeping the levels sorted and the totals
+         * right. O(levels) at worst, for the totals above the new amount.
+         */
+        static void add(std::vector<DepthLevel>& ladder, double price, double amount);
+        /** a ladder holding the levels of both, with equal prices added together */
+        static std::vector<DepthLevel> merge(std::span<const DepthLevel> a, std::span<const DepthLevel> b);
+
+        /** the best count levels in the order they would fill, each with its
+         * totals counted from the best level
+         */
+        static std::vector<DepthLevel> top(std::span<const DepthLevel> ladder, bool dearestFirst, size_t count);
+        /** cost of taking size from the ladder, best levels first */
+        static SizeQuote priceForSize(std::span<const DepthLevel> ladder, bool dearestFirst, double size);
+        /** amount available at prices no worse than the limit: at or
+         * below it for asks, at or above it for bids
+         */
+        static double sizeWithin(std::span<const DepthLevel> ladder, bool dearestFirst, double limitPrice);
+};
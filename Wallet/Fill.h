@@ -0,0 +1,26 @@
+#pragma once
+
+#include "Decimal.h"
+#include "SymbolTable.h"
+#include <cstdint>
+
+/** One match between a bid and an ask, naming the users on both sides
+ * so each can be settled by id. Plain data, like OrderBookEntry.
+ */
+struct Fill
+{
+    /** what it traded at, the ask's price */
+    Decimal price;
+    Decimal amount;
+    /** microseconds since the epoch */
+    int64_t timestamp = 0;
+    /** SymbolTable user id of the bid's owner */
+    uint32_t buyer = SymbolTable::datasetUser;
+    /** SymbolTable user id of the ask's owner */
+    uint32_t seller = SymbolTable::datasetUser;
+    /** SymbolTable product id */
+    uint16_t productId = 0;
+
+    /** true if the user is on either side */
+    bool involves(uint32_t user) const { return buyer == user || seller == user; }
+};
@@ -0,0 +1,347 @@
+#include "Gateway.h"
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace
+{
+    const size_t readChunk = 64 * 1024;
+    /** a client with this many unsent reply bytes is not read from until they drain */
+    const size_t outputLimit = 1 << 20;
+    const int eventBatch = 256;
+
+    std::runtime_error socketError(const std::string& what)
+    {
+        return std::runtime_error{"Gateway: " + what + ": " + std::strerror(errno)};
+    }
+
+    // The sockaddr for an address in the Options format; length is set to the part used
+    void resolve(const std::string& address, sockaddr_storage& storage, socklen_t& length)
+    {
+        std::memset(&storage, 0, sizeof(storage));
+        if (address.rfind("unix:", 0) == 0)
+        {
+            sockaddr_un& unixAddress = reinterpret_cast<sockaddr_un&>(storage);
+            std::string path = address.substr(5);
+            if (path.empty() || path.size() >= sizeof(unixAddress.sun_path))
+            {
+                throw std::runtime_error{"Gateway: bad unix socket path in " + address};
+            }
+            unixAddress.sun_family = AF_UNIX;
+            std::memcpy(unixAddress.sun_path, path.c_str(), path.size() + 1);
+            length = sizeof(sockaddr_un);
+            return;
+        }
+        size_t colon = address.rfind(':');
+        std::string host = colon == std::string::npos ? "127.0.0.1" : address.substr(0, colon);
+        std::string port = colon == std::string::npos ? address : address.substr(colon + 1);
+        sockaddr_in& inetAddress = reinterpret_cast<sockaddr_in&>(storage);
+        inetAddress.sin_family = AF_INET;
+        int portNumber = 0;
+        try {
+            portNumber = std::stoi(port);
+        } catch (const std::exception& e) {
+            portNumber = -1;
+        }
+        if (portNumber < 0 || portNumber > 65535 || ::inet_pton(AF_INET, host.c_str(), &inetAddress.sin_addr) != 1)
+        {
+            throw std::runtime_error{"Gateway: bad address " + address + ", want unix:/path, host:port or port"};
+        }
+        inetAddress.sin_port = htons(static_cast<uint16_t>(portNumber));
+        length = sizeof(sockaddr_in);
+    }
+
+    // Turns off Nagle on TCP sockets, so one short reply is sent at once
+    void noDelay(int fd, const sockaddr_storage& storage)
+    {
+        if (storage.ss_family != AF_INET) return;
+        int on = 1;
+        ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    }
+}
+
+// Binds the listening socket and sets up the epoll set with it and the stop wakeup in it
+Gateway::Gateway(const Options& options)
+: options(options),
+  readBuffer(readChunk)
+{
+    sockaddr_storage storage;
+    socklen_t length;
+    resolve(options.address, storage, length);
+    if (storage.ss_family == AF_UNIX)
+    {
+        unixPath = options.address.substr(5);
+        ::unlink(unixPath.c_str()); // A socket file left by an earlier run would stop the bind
+    }
+
+    // The destructor does not run for a constructor that throws, so undo what was set up here first
+    auto fail = [this](const std::string& what)
+    {
+        std::runtime_error error = socketError(what); // Before close can change errno
+        if (listener >= 0) ::close(listener);
+        if (epoll >= 0) ::close(epoll);
+        if (waker >= 0) ::close(waker);
+        if (!unixPath.empty()) ::unlink(unixPath.c_str());
+        throw error;
+    };
+
+    listener = ::socket(storage.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listener < 0) fail("could not open a socket");
+    int on = 1;
+    ::setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    if (::bind(listener, reinterpret_cast<sockaddr*>(&storage), length) != 0 || ::listen(listener, SOMAXCONN) != 0)
+    {
+        fail("could not listen on " + options.address);
+    }
+
+    epoll = ::epoll_create1(EPOLL_CLOEXEC);
+    if (epoll < 0) fail("could not set up epoll");
+    waker = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (waker < 0) fail("could not set up the stop wakeup");
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.fd = listener;
+    if (::epoll_ctl(epoll, EPOLL_CTL_ADD, listener, &event) != 0) fail("could not watch the listening socket");
+    event.data.fd = waker;
+    if (::epoll_ctl(epoll, EPOLL_CTL_ADD, waker, &event) != 0) fail("could not watch the stop wakeup");
+}
+
+Gateway::~Gateway()
+{
+    for (std::unique_ptr<Connection>& connection : connections)
+    {
+        if (connection) ::close(connection->fd);
+    }
+    if (listener >= 0) ::close(listener);
+    if (epoll >= 0) ::close(epoll);
+    if (waker >= 0) ::close(waker);
+    if (!unixPath.empty()) ::unlink(unixPath.c_str());
+}
+
+// Waits for sockets to be ready and services them, running the tick between batches
+void Gateway::run(Handler& handler)
+{
+    using Clock = std::chrono::steady_clock;
+    const std::chrono::milliseconds tick{options.tickMillis};
+    Clock::time_point nextTick = Clock::now() + tick;
+    epoll_event events[eventBatch];
+    while (!stopping.load(std::memory_order_relaxed))
+    {
+        int timeout = -1;
+        if (!backlog.empty()) timeout = 0; // Sockets with bytes still to read come first
+        else if (options.tickMillis > 0)
+        {
+            auto wait = std::chrono::ceil<std::chrono::milliseconds>(nextTick - Clock::now()).count();
+            timeout = static_cast<int>(wait > 0 ? wait : 0);
+        }
+        int ready = ::epoll_wait(epoll, events, eventBatch, timeout);
+        if (ready < 0 && errno != EINTR) throw socketError("epoll_wait failed");
+        for (int i = 0; i < ready; ++i)
+        {
+            int fd = events[i].data.fd;
+            if (fd == listener)
+            {
+                accept(handler);
+                continue;
+            }
+            if (fd == waker) continue; // stop() was called; the loop condition sees it
+            Connection* connection = static_cast<size_t>(fd) < connections.size() ? connections[fd].get() : nullptr;
+            if (connection == nullptr) continue;
+            if ((events[i].events & (EPOLLERR | EPOLLHUP)) || !service(*connection, handler))
+            {
+                close(*connection, handler);
+            }
+        }
+        // One more read for each socket that filled the buffer last time, in turn
+        std::vector<int> again;
+        again.swap(backlog);
+        for (int fd : again)
+        {
+            Connection* connection = connections[fd].get();
+            if (connection == nullptr || !connection->backlogged) continue;
+            connection->backlogged = false;
+            if (!service(*connection, handler)) close(*connection, handler);
+        }
+        if (options.tickMillis > 0 && Clock::now() >= nextTick)
+        {
+            handler.onTick();
+            ++counts.ticks;
+            nextTick += tick;
+            if (nextTick < Clock::now()) nextTick = Clock::now() + tick; // A slow tick skips the ones it ran over
+        }
+    }
+}
+
+void Gateway::stop()
+{
+    stopping.store(true, std::memory_order_relaxed);
+    uint64_t one = 1;
+    ssize_t written = ::write(waker, &one, sizeof(one));
+    (void)written;
+}
+
+// Takes every pending connection, each watched edge-triggered for reads and writes
+void Gateway::accept(Handler& handler)
+{
+    while (true)
+    {
+        sockaddr_storage peer;
+        socklen_t length = sizeof(peer);
+        int fd = ::accept4(listener, reinterpret_cast<sockaddr*>(&peer), &length, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0)
+        {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            return; // EAGAIN once the queue is empty; EMFILE and the like leave the rest queued
+        }
+        noDelay(fd, peer);
+        if (static_cast<size_t>(fd) >= connections.size()) connections.resize(fd + 1);
+        connections[fd] = std::make_unique<Connection>();
+        Connection& connection = *connections[fd];
+        connection.fd = fd;
+        connection.id = nextClient++;
+
+        epoll_event event{};
+        event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        event.data.fd = fd;
+        if (::epoll_ctl(epoll, EPOLL_CTL_ADD, fd, &event) != 0)
+        {
+            ::close(fd);
+            connections[fd].reset();
+            continue;
+        }
+        ++counts.accepted;
+        ++counts.open;
+        handler.onConnect(connection.id);
+    }
+}
+
+// One read per call, so a client that keeps sending can not hold the loop:
+// edge-triggered means a socket left with bytes unread reports nothing more,
+// so one that filled the buffer goes on the backlog to be read again in turn
+bool Gateway::service(Connection& connection, Handler& handler)
+{
+    if (!flush(connection)) return false;
+    if (!connection.readClosed && connection.output.size() - connection.outputStart < outputLimit)
+    {
+        ssize_t n;
+        do n = ::read(connection.fd, readBuffer.data(), readBuffer.size());
+        while (n < 0 && errno == EINTR);
+        if (n > 0)
+        {
+            connection.input.append(readBuffer.data(), static_cast<size_t>(n));
+            if (static_cast<size_t>(n) == readBuffer.size() && !connection.backlogged)
+            {
+                connection.backlogged = true;
+                backlog.push_back(connection.fd);
+            }
+        }
+        else if (n == 0) connection.readClosed = true;
+        else if (errno != EAGAIN && errno != EWOULDBLOCK) return false;
+    }
+    // A client holding back replies is only read again once its output drains, so this may answer lines read earlier
+    if (!answer(connection, handler) || !flush(connection)) return false;
+    return !connection.readClosed || connection.outputStart < connection.output.size();
+}
+
+// Hands each whole line to the handler, keeping a partial line for the next read
+bool Gateway::answer(Connection& connection, Handler& handler)
+{
+    std::string& input = connection.input;
+    while (connection.output.size() - connection.outputStart < outputLimit)
+    {
+        size_t end = input.find('\n', connection.inputStart);
+        if (end == std::string::npos) break;
+        std::string_view line{input.data() + connection.inputStart, end - connection.inputStart};
+        if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+        connection.inputStart = end + 1;
+        if (line.empty()) continue;
+        if (line.size() > options.maxLineLength)
+        {
+            connection.output += "err,line too long\n";
+            flush(connection);
+            return false;
+        }
+        ++counts.requests;
+        handler.onRequest(connection.id, line, connection.output);
+    }
+    bool partial = input.find('\n', connection.inputStart) == std::string::npos;
+    if (partial && input.size() - connection.inputStart > options.maxLineLength)
+    {
+        connection.output += "err,line too long\n";
+        flush(connection);
+        return false;
+    }
+    input.erase(0, connection.inputStart); // Usually only a partial line is left, so this moves a few bytes
+    connection.inputStart = 0;
+    return true;
+}
+
+bool Gateway::flush(Connection& connection)
+{
+    while (connection.outputStart < connection.output.size())
+    {
+        ssize_t n = ::send(connection.fd, connection.output.data() + connection.outputStart,
+                           connection.output.size() - connection.outputStart, MSG_NOSIGNAL);
+        if (n < 0)
+        {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return true; // EPOLLOUT says when there is room again
+            return false;
+        }
+        connection.outputStart += static_cast<size_t>(n);
+    }
+    connection.output.clear();
+    connection.outputStart = 0;
+    return true;
+}
+
+void Gateway::close(Connection& connection, Handler& handler)
+{
+    int fd = connection.fd;
+    handler.onDisconnect(connection.id);
+    ::epoll_ctl(epoll, EPOLL_CTL_DEL, fd, nullptr);
+    ::close(fd);
+    connections[fd].reset();
+    --counts.open;
+}
+
+int Gateway::connect(const std::string& address)
+{
+    sockaddr_storage storage;
+    socklen_t length;
+    resolve(address, storage, length);
+    int fd = ::socket(storage.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) throw socketError("could not open a socket");
+    noDelay(fd, storage);
+    if (::connect(fd, reinterpret_cast<sockaddr*>(&storage), length) != 0 && errno != EINPROGRESS && errno != EAGAIN)
+    {
+        std::runtime_error error = socketError("could not connect to " + address);
+        ::close(fd);
+        throw error;
+    }
+    return fd;
+}
+
+uint64_t Gateway::raiseFileLimit()
+{
+    rlimit limit;
+    if (::getrlimit(RLIMIT_NOFILE, &limit) != 0) return 0;
+    if (limit.rlim_cur < limit.rlim_max)
+    {
+        limit.rlim_cur = limit.rlim_max;
+        ::setrlimit(RLIMIT_NOFILE, &limit);
+        ::getrlimit(RLIMIT_NOFILE, &limit);
+    }
+    return limit.rlim_cur;
+}
@@ -0,0 +1,132 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/** Order entry over sockets: a single-threaded, non-blocking epoll loop
+ * serving any number of clients on a Unix-domain or TCP socket, so
+ * thousands of traders can reach one book instead of one on stdin.
+ *
+ * The protocol is lines of text, one request per line and one reply
+ * line per request, in the order the requests came. A client may send
+ * many requests before reading the replies. What a request means is up
+ * to the Handler; MerkelMain::serve takes
+ *
+ *   bid,ETH/BTC,0.02,0.5      ask,ETH/BTC,0.03,0.5     ->  ok,<order id>
+ *   cancel,<id>               amend,<id>,<amount>      ->  ok,<order id>
+ *   login,<name>                                       ->  ok,<name>
+ *
+ * and answers err,<reason> to anything it refuses.
+ */
+class Gateway
+{
+    public:
+        struct Options
+        {
+            /** "unix:/path/to/socket", "host:port" or just "port" for 127.0.0.1 */
+            std::string address = "7000";
+            /** how often Handler::onTick runs, in milliseconds; 0 for never */
+            int64_t tickMillis = 1000;
+            /** a longer line gets err and the client is dropped */
+            size_t maxLineLength = 256;
+        };
+
+        /** what the gateway does with requests. Every call is made on the
+         * thread running the loop, so a handler needs no locks.
+         */
+        class Handler
+        {
+            public:
+                virtual ~Handler() = default;
+                /** a new client; ids are never reused */
+                virtual void onConnect(uint64_t client) { (void)client; }
+                /** one request, without its newline. Append exactly one
+                 * reply line, newline included, to reply.
+                 */
+                virtual void onRequest(uint64_t client, std::string_view request, std::string& reply) = 0;
+                virtual void onDisconnect(uint64_t client) { (void)client; }
+                /** called every Options::tickMillis, between requests */
+                virtual void onTick() {}
+        };
+
+        /** what the loop has done so far */
+        struct Stats
+        {
+            uint64_t accepted = 0;
+            uint64_t open = 0;
+            uint64_t requests = 0;
+            uint64_t ticks = 0;
+        };
+
+        /** bind and listen on the address. Throws std::runtime_error if it can not. */
+        Gateway(const Options& options);
+        ~Gateway();
+
+        Gateway(const Gateway&) = delete;
+        Gateway& operator=(const Gateway&) = delete;
+
+        /** serve clients until stop is called */
+        void run(Handler& handler);
+        /** make run return once it has finished the requests in hand; safe from any thread */
+        void stop();
+        Stats stats() const { return counts; }
+
+        /** open a non-blocking client socket to an address in the Options
+         * format. The connection may still be in progress when it returns.
+         * Throws std::runtime_error if it can not be started.
+         */
+        static int connect(const std::string& address);
+        /** raise this process's open file limit as far as it may go, so it
+         * can hold thousands of sockets. Returns the new limit.
+         */
+        static uint64_t raiseFileLimit();
+
+    private:
+        /** one client's socket with its unread and unsent bytes */
+        struct Connection
+        {
+            int fd = -1;
+            uint64_t id = 0;
+            /** bytes read but not yet a whole line */
+            std::string input;
+            size_t inputStart = 0;
+            /** replies not yet written */
+            std::string output;
+            size_t outputStart = 0;
+            /** the peer has closed its side */
+            bool readClosed = false;
+            /** on the backlog: the last read filled the buffer, so more may be waiting */
+            bool backlogged = false;
+        };
+
+        void accept(Handler& handler);
+        /** read once from the socket, answer every whole line, write the replies.
+         * False if the connection should be closed.
+         */
+        bool service(Connection& connection, Handler& handler);
+        /** answer the whole lines in the input; false if a line is too long */
+        bool answer(Connection& connection, Handler& handler);
+        /** write as much output as the socket takes; false on a socket error */
+        bool flush(Connection& connection);
+        void close(Connection& connection, Handler& handler);
+
+        Options options;
+        int listener = -1;
+        int epoll = -1;
+        /** written to by stop() to wake the loop */
+        int waker = -1;
+        std::string unixPath;
+        /** by file descriptor */
+        std::vector<std::unique_ptr<Connection>> connections;
+        /** fds of connections with bytes still to read, serviced once each per pass */
+        std::vector<int> backlog;
+        /** every read lands here first, then only its bytes are added to the connection's input */
+        std::vector<char> readBuffer;
+        uint64_t nextClient = 1;
+        std::atomic<bool> stopping{false};
+        Stats counts;
+};
@@ -0,0 +1,352 @@
+#include "Journal.h"
+#include "MappedFile.h"
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace
+{
+    const char journalMagic[8] = {'M', 'R', 'K', 'L', 'J', 'R', 'N', 'L'};
+    const char snapshotMagic[8] = {'M', 'R', 'K', 'L', 'S', 'T', 'A', 'T'};
+    const uint32_t journalVersion = 1;
+
+    // Start of journal.bin; the records follow it back to back
+    struct JournalHeader
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t decimalPlaces;
+        uint64_t generation;   // the snapshot the records follow, 0 for none
+    };
+
+    // Start of snapshot.bin; recordCount records follow it
+    struct SnapshotHeader
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t decimalPlaces;
+        uint64_t generation;
+        int64_t currentTime;
+        uint64_t nextOrderId;
+        uint64_t recordCount;
+    };
+
+    // Each record is a RecordFrame, then RecordBody, then the name's bytes
+    struct RecordFrame
+    {
+        uint32_t length;       // bytes after the frame
+        uint32_t checksum;     // FNV-1a of those bytes
+    };
+
+    struct RecordBody
+    {
+        uint8_t type;
+        uint8_t side;
+        uint16_t nameLength;
+        uint32_t unused;
+        uint64_t orderId;
+        int64_t timestamp;
+        int64_t nextTime;
+        int64_t price;
+        int64_t amount;
+    };
+
+    uint32_t checksum(const char* bytes, size_t length)
+    {
+        uint32_t hash = 2166136261u;
+        for (size_t i = 0; i < length; ++i)
+        {
+            hash ^= static_cast<uint8_t>(bytes[i]);
+            hash *= 16777619u;
+        }
+        return hash;
+    }
+
+    void encode(const Journal::Record& record, std::string& out)
+    {
+        if (record.name.size() > UINT16_MAX) throw std::invalid_argument{"Journal: name too long: " + record.name};
+        RecordBody body{};
+        body.type = static_cast<uint8_t>(record.type);
+        body.side = static_cast<uint8_t>(record.side);
+        body.nameLength = static_cast<uint16_t>(record.name.size());
+        body.orderId = record.orderId;
+        body.timestamp = record.timestamp;
+        body.nextTime = record.nextTime;
+        body.price = record.price.units();
+        body.amount = record.amount.units();
+
+        size_t at = out.size();
+        out.resize(at + sizeof(RecordFrame) + sizeof(RecordBody) + record.name.size());
+        char* payload = out.data() + at + sizeof(RecordFrame);
+        std::memcpy(payload, &body, sizeof(body));
+        std::memcpy(payload + sizeof(body), record.name.data(), record.name.size());
+        RecordFrame frame{static_cast<uint32_t>(sizeof(body) + record.name.size()), 0};
+        frame.checksum = checksum(payload, frame.length);
+        std::memcpy(out.data() + at, &frame, sizeof(frame));
+    }
+
+    // Reads the record at offset, moving offset past it; false if it is torn, corrupt or not there
+    bool decode(std::string_view bytes, size_t& offset, Journal::Record& record)
+    {
+        RecordFrame frame;
+        if (bytes.size() - offset < sizeof(frame)) return false;
+        std::memcpy(&frame, bytes.data() + offset, sizeof(frame));
+        if (frame.length < sizeof(RecordBody) || bytes.size() - offset - sizeof(frame) < frame.length) return false;
+        const char* payload = bytes.data() + offset + sizeof(frame);
+        if (checksum(payload, frame.length) != frame.checksum) return false;
+
+        RecordBody body;
+        std::memcpy(&body, payload, sizeof(body));
+        if (body.nameLength != frame.length - sizeof(body)) return false;
+        if (body.type < static_cast<uint8_t>(Journal::RecordType::deposit) ||
+            body.type > static_cast<uint8_t>(Journal::RecordType::timeframe)) return false;
+        record.type = static_cast<Journal::RecordType>(body.type);
+        record.side = static_cast<OrderBookType>(body.side);
+        record.orderId = body.orderId;
+        record.timestamp = body.timestamp;
+        record.nextTime = body.nextTime;
+        record.price = Decimal::fromUnits(body.price);
+        record.amount = Decimal::fromUnits(body.amount);
+        record.name.assign(payload + sizeof(body), body.nameLength);
+        offset += sizeof(frame) + frame.length;
+        return true;
+    }
+
+    void writeAll(int fd, const char* bytes, size_t length, const std::string& filename)
+    {
+        while (length > 0)
+        {
+            ssize_t n = ::write(fd, bytes, length);
+            if (n < 0) throw std::runtime_error{"Journal: could not write " + filename + ": " + std::strerror(errno)};
+            bytes += n;
+            length -= static_cast<size_t>(n);
+        }
+    }
+
+    // Writes a whole file under a temporary name, syncs it and renames it into place
+    void replaceFile(const std::string& directory, const std::string& name, const std::string& contents)
+    {
+        std::string path = directory + "/" + name;
+        std::string temporary = path + ".tmp";
+        int fd = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) throw std::runtime_error{"Journal: could not create " + temporary + ": " + std::strerror(errno)};
+        writeAll(fd, contents.data(), contents.size(), temporary);
+        bool ok = ::fsync(fd) == 0;
+        ::close(fd);
+        if (!ok || std::rename(temporary.c_str(), path.c_str()) != 0)
+        {
+            throw std::runtime_error{"Journal: could not replace " + path + ": " + std::strerror(errno)};
+        }
+        int dir = ::open(directory.c_str(), O_RDONLY); // Sync the directory too, so the rename itself survives
+        if (dir >= 0)
+        {
+            ::fsync(dir);
+            ::close(dir);
+        }
+    }
+
+    std::string journalHeader(uint64_t generation)
+    {
+        JournalHeader header{};
+        std::memcpy(header.magic, journalMagic, sizeof(header.magic));
+        header.version = journalVersion;
+        header.decimalPlaces = Decimal::places;
+        header.generation = generation;
+        return std::string{reinterpret_cast<const char*>(&header), sizeof(header)};
+    }
+}
+
+// Reads what the directory holds, then starts the thread that syncs new records
+Journal::Journal(const std::string& directory)
+: directory(directory)
+{
+    std::error_code error;
+    std::filesystem::create_directories(directory, error);
+    if (!std::filesystem::is_directory(directory))
+    {
+        throw std::runtime_error{"Journal: could not create directory " + directory};
+    }
+    recover();
+    openJournal();
+    syncer = std::thread{[this]() { syncLoop(); }};
+}
+
+Journal::~Journal()
+{
+    sync();
+    {
+        std::lock_guard<std::mutex> lock{mutex};
+        stopping = true;
+    }
+    wake.notify_all();
+    syncer.join();
+    if (fd >= 0) ::close(fd);
+}
+
+// Loads the snapshot, then the journal records that follow it, cutting off any torn or uncommitted tail
+void Journal::recover()
+{
+    MappedFile snapshot{directory + "/snapshot.bin"};
+    if (snapshot.isOpen())
+    {
+        SnapshotHeader header;
+        if (snapshot.size() < sizeof(header)) throw std::runtime_error{"Journal: snapshot.bin is too short"};
+        std::memcpy(&header, snapshot.data(), sizeof(header));
+        if (std::memcmp(header.magic, snapshotMagic, sizeof(header.magic)) != 0 || header.version != journalVersion)
+        {
+            throw std::runtime_error{"Journal: snapshot.bin is not a snapshot this build can read"};
+        }
+        if (header.decimalPlaces != Decimal::places)
+        {
+            throw std::runtime_error{"Journal: snapshot.bin was written with other DECIMAL_PLACES"};
+        }
+        // Snapshots are renamed into place whole, so a bad record means the file was damaged
+        size_t offset = sizeof(header);
+        recovery.state.resize(header.recordCount);
+        for (Record& record : recovery.state)
+        {
+            if (!decode(snapshot.view(), offset, record)) throw std::runtime_error{"Journal: snapshot.bin is damaged"};
+        }
+        generation = header.generation;
+        recovery.found = true;
+        recovery.fromSnapshot = true;
+        recovery.currentTime = header.currentTime;
+        recovery.nextOrderId = header.nextOrderId;
+    }
+
+    std::string path = directory + "/journal.bin";
+    MappedFile journal{path};
+    if (!journal.isOpen() || journal.size() == 0) return;
+    JournalHeader header;
+    if (journal.size() < sizeof(header)) return; // Torn before the header was written; openJournal starts it again
+    std::memcpy(&header, journal.data(), sizeof(header));
+    if (std::memcmp(header.magic, journalMagic, sizeof(header.magic)) != 0 || header.version != journalVersion)
+    {
+        throw std::runtime_error{"Journal: " + path + " is not a journal this build can read"};
+    }
+    if (header.decimalPlaces != Decimal::places)
+    {
+        throw std::runtime_error{"Journal: " + path + " was written with other DECIMAL_PLACES"};
+    }
+    if (header.generation < generation) return; // Left over from before the snapshot, which already holds it all
+    if (header.generation > generation)
+    {
+        throw std::runtime_error{"Journal: " + path + " follows a snapshot that is missing"};
+    }
+
+    appendable = true;
+
+    // Fills and wallet changes only count once their timeframe record is there too
+    size_t offset = sizeof(header);
+    size_t keptBytes = offset;
+    size_t keptRecords = 0;
+    Record record;
+    while (decode(journal.view(), offset, record))
+    {
+        bool pending = record.type == RecordType::fill || record.type == RecordType::walletChange;
+        recovery.tail.push_back(record);
+        if (!pending)
+        {
+            keptBytes = offset;
+            keptRecords = recovery.tail.size();
+        }
+    }
+    recovery.tail.resize(keptRecords);
+    if (keptRecords > 0) recovery.found = true;
+    recovery.discardedBytes = journal.size() - keptBytes;
+    if (recovery.discardedBytes > 0 && ::truncate(path.c_str(), static_cast<off_t>(keptBytes)) != 0)
+    {
+        throw std::runtime_error{"Journal: could not cut the torn end off " + path + ": " + std::strerror(errno)};
+    }
+}
+
+// Appends to the journal if recovery read it, otherwise starts a new one
+void Journal::openJournal()
+{
+    std::string path = directory + "/journal.bin";
+    if (!appendable) replaceFile(directory, "journal.bin", journalHeader(generation));
+    fd = ::open(path.c_str(), O_WRONLY | O_APPEND);
+    if (fd < 0) throw std::runtime_error{"Journal: could not open " + path + ": " + std::strerror(errno)};
+}
+
+void Journal::append(std::span<const Record> records)
+{
+    std::string bytes;
+    for (const Record& record : records) encode(record, bytes);
+    std::lock_guard<std::mutex> lock{mutex};
+    writeAll(fd, bytes.data(), bytes.size(), directory + "/journal.bin"); // One write, so a batch is torn at worst, never interleaved
+    ++written;
+}
+
+void Journal::commit()
+{
+    {
+        std::lock_guard<std::mutex> lock{mutex};
+        if (committed == written) return;
+        committed = written;
+    }
+    wake.notify_one();
+}
+
+void Journal::sync()
+{
+    commit();
+    std::unique_lock<std::mutex> lock{mutex};
+    synced.wait(lock, [this]() { return durable >= committed; });
+}
+
+uint64_t Journal::syncCount() const
+{
+    std::lock_guard<std::mutex> lock{mutex};
+    return syncs;
+}
+
+// Writes the snapshot beside the journal, then swaps in an empty journal that follows it
+void Journal::writeSnapshot(int64_t currentTime, uint64_t nextOrderId, std::span<const Record> state)
+{
+    sync(); // Nothing may still be syncing on the journal about to be replaced
+
+    SnapshotHeader header{};
+    std::memcpy(header.magic, snapshotMagic, sizeof(header.magic));
+    header.version = journalVersion;
+    header.decimalPlaces = Decimal::places;
+    header.generation = generation + 1;
+    header.currentTime = currentTime;
+    header.nextOrderId = nextOrderId;
+    header.recordCount = state.size();
+    std::string contents{reinterpret_cast<const char*>(&header), sizeof(header)};
+    for (const Record& record : state) encode(record, contents);
+    replaceFile(directory, "snapshot.bin", contents);
+
+    // A crash before the new journal is in place leaves the old one, which recovery then skips as older
+    std::lock_guard<std::mutex> lock{mutex};
+    ++generation;
+    replaceFile(directory, "journal.bin", journalHeader(generation));
+    std::string path = directory + "/journal.bin";
+    int next = ::open(path.c_str(), O_WRONLY | O_APPEND);
+    if (next < 0) throw std::runtime_error{"Journal: could not open " + path + ": " + std::strerror(errno)};
+    ::close(fd);
+    fd = next;
+}
+
+// Syncs in the background whenever there are committed records the disk does not have yet
+void Journal::syncLoop()
+{
+    std::unique_lock<std::mutex> lock{mutex};
+    while (true)
+    {
+        wake.wait(lock, [this]() { return stopping || committed > durable; });
+        if (committed == durable) return; // Stopping with nothing left to sync
+        uint64_t target = committed;
+        int file = fd;
+        lock.unlock();
+        ::fsync(file); // Every record committed so far goes in this one sync, however many there are
+        lock.lock();
+        durable = target;
+        ++syncs;
+        synced.notify_all();
+    }
+}
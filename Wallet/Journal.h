@@ -0,0 +1,144 @@
+#pragma once
+
+#include "OrderBookEntry.h"
+#include "Decimal.h"
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+
+/** A write-ahead journal of what the user does in the interactive sim,
+ * so a restart picks up where the last run stopped.
+ *
+ * A directory holds two files. journal.bin is append-only: each order
+ * placed, cancelled or amended goes to the OS as it happens, and each
+ * matched timeframe adds the user's fills, the wallet changes they
+ * made and a timeframe record, written together. Records are fsynced
+ * by a background thread once per timeframe (group commit), so the
+ * sim never waits for the disk. snapshot.bin holds the wallet balances
+ * and the user's orders still on the book as of one timeframe; writing
+ * it starts a new, empty journal, so recovery reads one snapshot and
+ * at most snapshotEvery timeframes of journal.
+ *
+ * Every record carries a checksum. Recovery stops at the first torn or
+ * corrupt record, and drops fills and wallet changes that are not
+ * followed by their timeframe record, so a timeframe is recovered
+ * whole or not at all.
+ */
+class Journal
+{
+    public:
+        enum class RecordType : uint8_t
+        {
+            /** currency put into the wallet from outside, e.g. the starting funds */
+            deposit = 1,
+            /** an order placed, with the id the book gave it */
+            order,
+            cancel,
+            /** an order's amount changed */
+            amend,
+            /** one of the user's fills, for the record */
+            fill,
+            /** one currency's balance moved by matching, by amount (negative to spend) */
+            walletChange,
+            /** timestamp was matched and the sim moved on to nextTime */
+            timeframe
+        };
+
+        /** one thing that happened; fields a type does not use stay zero */
+        struct Record
+        {
+            RecordType type = RecordType::deposit;
+            /** order side, or the user's side of a fill */
+            OrderBookType side = OrderBookType::unknown;
+            uint64_t orderId = 0;
+            /** the order's or fill's time, or the timeframe matched */
+            int64_t timestamp = 0;
+            /** timeframe records: the time the sim moved on to */
+            int64_t nextTime = 0;
+            Decimal price;
+            Decimal amount;
+            /** product for orders and fills, currency for deposits and wallet changes */
+            std::string name;
+        };
+
+        /** the state a directory held when it was opened */
+        struct Recovery
+        {
+            /** false if there was no snapshot and no journal to read */
+            bool found = false;
+            /** false if there was no snapshot, so state starts empty at the first timeframe */
+            bool fromSnapshot = false;
+            /** from the snapshot */
+            int64_t currentTime = 0;
+            uint64_t nextOrderId = 1;
+            /** the snapshot's balances as deposits and its orders as order records */
+            std::vector<Record> state;
+            /** every complete record journalled after the snapshot, in order */
+            std::vector<Record> tail;
+            /** bytes of torn or uncommitted records cut off the end of the journal */
+            uint64_t discardedBytes = 0;
+        };
+
+        /** open the journal in a directory, creating it if need be, and
+         * read what it holds. Throws std::runtime_error if the directory or
+         * files can not be used, or were written by a build with other
+         * DECIMAL_PLACES.
+         */
+        Journal(const std::string& directory);
+        /** waits for the last records to reach the disk */
+        ~Journal();
+
+        Journal(const Journal&) = delete;
+        Journal& operator=(const Journal&) = delete;
+
+        const Recovery& recovered() const { return recovery; }
+
+        /** write records to the journal in one go. They survive the
+         * process exiting at once, and a power cut after the next commit.
+         */
+        void append(std::span<const Record> records);
+        void append(const Record& record) { append(std::span<const Record>{&record, 1}); }
+        /** have everything appended so far fsynced in the background */
+        void commit();
+        /** commit and wait until it is on the disk */
+        void sync();
+        /** write a snapshot of the state at currentTime and start a new,
+         * empty journal. state holds the balances as deposits and the
+         * orders on the book as order records.
+         */
+        void writeSnapshot(int64_t currentTime, uint64_t nextOrderId, std::span<const Record> state);
+
+        /** number of fsyncs of the journal so far */
+        uint64_t syncCount() const;
+
+    private:
+        /** read the snapshot and journal into recovery, cutting a torn tail off the journal */
+        void recover();
+        /** open journal.bin for appending, writing its header if it is new */
+        void openJournal();
+        /** the background thread: fsync whenever records have been committed but not synced */
+        void syncLoop();
+
+        std::string directory;
+        Recovery recovery;
+        /** snapshots written to this directory so far; the journal belongs to the latest */
+        uint64_t generation = 0;
+        /** true if recovery found a journal following the snapshot to append to */
+        bool appendable = false;
+        int fd = -1;
+
+        mutable std::mutex mutex;
+        std::condition_variable wake;
+        std::condition_variable synced;
+        /** records written, committed and on the disk so far, counted in appends */
+        uint64_t written = 0;
+        uint64_t committed = 0;
+        uint64_t durable = 0;
+        uint64_t syncs = 0;
+        bool stopping = false;
+        std::thread syncer;
+};
@@ -0,0 +1,222 @@
+#include "Logger.h"
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <thread>
+
+std::atomic<LogLevel> Logger::levels[static_cast<size_t>(LogModule::count)] = {
+    LogLevel::info, LogLevel::info, LogLevel::info, LogLevel::info
+};
+
+namespace
+{
+    const char* const levelNames[] = {"debug", "info", "warn", "error", "off"};
+    const char* const moduleNames[] = {"csv", "book", "matching", "app"};
+
+    constexpr size_t slotCount = 4096; // Must be a power of two
+    constexpr size_t slotText = 240;
+
+    /** One piece of a message. A message longer than slotText takes
+     * several slots in a row, all but the last marked as continued.
+     * sequence says who may use the slot: it equals the ticket of the
+     * producer allowed to fill it, and ticket + 1 once it is filled.
+     */
+    struct alignas(64) Slot
+    {
+        std::atomic<uint64_t> sequence;
+        uint16_t length;
+        bool continued;
+        char text[slotText];
+    };
+
+    /** The ring and its writer thread. Producers take tickets from head;
+     * the writer consumes them in ticket order, so messages come out in
+     * the order they were queued even when several threads log at once.
+     */
+    class Ring
+    {
+        public:
+            Ring()
+            {
+                for (size_t i = 0; i < slotCount; ++i) slots[i].sequence.store(i, std::memory_order_relaxed);
+            }
+
+            // Writes whatever is still queued before the process exits
+            ~Ring()
+            {
+                if (!writer.joinable()) return;
+                stopping.store(true);
+                signal.fetch_add(1);
+                signal.notify_one();
+                writer.join();
+            }
+
+            void push(std::string_view text)
+            {
+                std::call_once(started, [this]() { writer = std::thread{[this]() { run(); }}; });
+
+                size_t pieces = text.empty() ? 1 : (text.size() + slotText - 1) / slotText;
+                uint64_t ticket = head.fetch_add(pieces);
+                for (size_t i = 0; i < pieces; ++i)
+                {
+                    Slot& slot = slots[(ticket + i) & (slotCount - 1)];
+                    while (slot.sequence.load(std::memory_order_acquire) != ticket + i)
+                    {
+                        std::this_thread::yield(); // The ring is full; wait for the writer to free this slot
+                    }
+                    std::string_view piece = text.substr(i * slotText, slotText);
+                    std::memcpy(slot.text, piece.data(), piece.size());
+                    slot.length = static_cast<uint16_t>(piece.size());
+                    slot.continued = i + 1 < pieces;
+                    slot.sequence.store(ticket + i + 1, std::memory_order_release);
+                }
+                signal.fetch_add(1, std::memory_order_release);
+                signal.notify_one();
+            }
+
+            void flush()
+            {
+                uint64_t target = head.load();
+                uint64_t done = written.load();
+                while (done < target)
+                {
+                    written.wait(done);
+                    done = written.load();
+                }
+            }
+
+        private:
+            // Drains the ring in batches, sleeping while it is empty
+            void run()
+            {
+                std::string batch;
+                uint64_t tail = 0;
+                while (true)
+                {
+                    uint64_t seen = signal.load(std::memory_order_acquire);
+                    uint64_t end = head.load();
+                    if (tail == end)
+                    {
+                        if (stopping.load()) return;
+                        signal.wait(seen);
+                        continue;
+                    }
+
+                    batch.clear();
+                    for (; tail < end; ++tail)
+                    {
+                        Slot& slot = slots[tail & (slotCount - 1)];
+                        while (slot.sequence.load(std::memory_order_acquire) != tail + 1)
+                        {
+                            std::this_thread::yield(); // Ticket taken but the text is still being copied in
+                        }
+                        batch.append(slot.text, slot.length);
+                        if (!slot.continued) batch += '\n';
+                        slot.sequence.store(tail + slotCount, std::memory_order_release);
+                    }
+                    std::fwrite(batch.data(), 1, batch.size(), stdout);
+                    std::fflush(stdout);
+                    written.store(tail);
+                    written.notify_all();
+                }
+            }
+
+            Slot slots[slotCount];
+            /** next ticket to hand out */
+            std::atomic<uint64_t> head{0};
+            /** tickets written to stdout so far */
+            std::atomic<uint64_t> written{0};
+            /** bumped whenever the writer may have something to do */
+            std::atomic<uint64_t> signal{0};
+            std::atomic<bool> stopping{false};
+            std::once_flag started;
+            std::thread writer;
+    };
+
+    Ring& ring()
+    {
+        static Ring instance;
+        return instance;
+    }
+}
+
+// Sets the level of every module at once
+void Logger::setLevel(LogLevel level)
+{
+    for (std::atomic<LogLevel>& moduleLevel : levels) moduleLevel.store(level);
+}
+
+// Sets the level of one module
+void Logger::setLevel(LogModule module, LogLevel level)
+{
+    levels[static_cast<size_t>(module)].store(level);
+}
+
+// Looks a level up by name
+bool Logger::parseLevel(std::string_view text, LogLevel& level)
+{
+    for (size_t i = 0; i < std::size(levelNames); ++i)
+    {
+        if (text == levelNames[i])
+        {
+            level = static_cast<LogLevel>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Looks a module up by name
+bool Logger::parseModule(std::string_view text, LogModule& module)
+{
+    for (size_t i = 0; i < std::size(moduleNames); ++i)
+    {
+        if (text == moduleNames[i])
+        {
+            module = static_cast<LogModule>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Queues a message for the writer thread, dropping it if its level is filtered out
+void Logger::write(LogModule module, LogLevel level, std::string_view text)
+{
+    if (!enabled(module, level)) return;
+    ring().push(text);
+}
+
+// Waits for the writer thread to catch up with everything queued so far
+void Logger::flush()
+{
+    ring().flush();
+}
+
+// Queues the finished message
+LogLine::~LogLine()
+{
+    Logger::write(module, level, overflow.empty() ? std::string_view{buffer, length} : std::string_view{overflow});
+}
+
+// Appends text, moving to the heap if the message outgrows the stack buffer
+LogLine& LogLine::operator<<(std::string_view text)
+{
+    if (overflow.empty() && length + text.size() <= sizeof(buffer))
+    {
+        std::memcpy(buffer + length, text.data(), text.size());
+        length += text.size();
+        return *this;
+    }
+    if (overflow.empty()) overflow.assign(buffer, length);
+    overflow += text;
+    return *this;
+}
+
+// Appends a number in std::ostream's default format (%g with 6 significant digits)
+LogLine& LogLine::operator<<(double value)
+{
+    char digits[32];
+    int written = std::snprintf(digits, sizeof(digits), "%g", value);
+    return *this << std::string_view{digits, static_cast<size_t>(written)};
+}
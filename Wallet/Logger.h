@@ -0,0 +1,91 @@
+#pragma once
+
+#include <atomic>
+#include <charconv>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+enum class LogLevel{debug, info, warn, error, off};
+
+/** the part of the program a message comes from, each with its own level */
+enum class LogModule{csv, book, matching, app, count};
+
+/** Diagnostic messages, written to stdout by a background thread.
+ * Callers format a message only if its module's level lets it through,
+ * then copy it into a lock-free ring; the writer thread drains the ring
+ * in batches, so logging never blocks on the console. Messages carry
+ * their own context and are written as they are, one per line.
+ */
+class Logger
+{
+    public:
+        /** true if a message at this level from this module would be written */
+        static bool enabled(LogModule module, LogLevel level)
+        {
+            return level >= levels[static_cast<size_t>(module)].load(std::memory_order_relaxed);
+        }
+        /** set the level of every module */
+        static void setLevel(LogLevel level);
+        static void setLevel(LogModule module, LogLevel level);
+        /** parse "debug", "info", "warn", "error" or "off", false if it is none of them */
+        static bool parseLevel(std::string_view text, LogLevel& level);
+        /** parse a module name such as "matching", false if there is no such module */
+        static bool parseModule(std::string_view text, LogModule& module);
+
+        /** queue one message. Waits only if the ring is full. */
+        static void write(LogModule module, LogLevel level, std::string_view text);
+        /** wait until every message queued so far has been written.
+         * Call before printing to the console directly so output stays in order.
+         */
+        static void flush();
+
+    private:
+        /** the lowest level written for each module */
+        static std::atomic<LogLevel> levels[static_cast<size_t>(LogModule::count)];
+};
+
+/** Builds one message with <<, queuing it when the statement ends.
+ * Use it through LOG so nothing is formatted for disabled levels.
+ */
+class LogLine
+{
+    public:
+        LogLine(LogModule module, LogLevel level) : module(module), level(level) {}
+        ~LogLine();
+
+        LogLine(const LogLine&) = delete;
+        LogLine& operator=(const LogLine&) = delete;
+
+        LogLine& operator<<(std::string_view text);
+        LogLine& operator<<(const char* text) { return *this << std::string_view{text}; }
+        LogLine& operator<<(const std::string& text) { return *this << std::string_view{text}; }
+        LogLine& operator<<(char c) { return *this << std::string_view{&c, 1}; }
+        /** written like std::ostream does by default, e.g. 0.02187 or 1e-08 */
+        LogLine& operator<<(double value);
+
+        template <typename T>
+        requires std::is_integral_v<T>
+        LogLine& operator<<(T value)
+        {
+            char digits[24];
+            std::to_chars_result result = std::to_chars(digits, digits + sizeof(digits), value);
+            return *this << std::string_view{digits, static_cast<size_t>(result.ptr - digits)};
+        }
+
+    private:
+        LogModule module;
+        LogLevel level;
+        /** short messages stay on the stack; longer ones move to overflow */
+        char buffer[256];
+        size_t length = 0;
+        std::string overflow;
+};
+
+/** LOG(matching, info) << "Sales: " << n;
+ * The message is only formatted if the module's level lets it through.
+ */
+#define LOG(module, level) \
+    for (bool logEnabled = Logger::enabled(LogModule::module, LogLevel::level); logEnabled; logEnabled = false) \
+        LogLine(LogModule::module, LogLevel::level)
@@ -0,0 +1,63 @@
+#include "MappedFile.h"
+#include <fstream>
+#include <sstream>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#define MAPPEDFILE_HAS_MMAP 1
+#endif
+
+// Maps the whole file read-only, or reads it into memory where mmap is unavailable
+MappedFile::MappedFile(const std::string& filename)
+{
+#ifdef MAPPEDFILE_HAS_MMAP
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) return; // Leave the file closed, callers check isOpen()
+
+    struct stat info;
+    if (::fstat(fd, &info) == 0)
+    {
+        opened = true;
+        length = static_cast<size_t>(info.st_size);
+        if (length > 0)
+        {
+            void* region = ::mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+            if (region != MAP_FAILED)
+            {
+                ::madvise(region, length, MADV_SEQUENTIAL); // We read front to back, so let the kernel read ahead
+                bytes = static_cast<const char*>(region);
+                mapped = true;
+            }
+        }
+    }
+    ::close(fd); // The mapping stays valid after the descriptor is closed
+    if (opened && length > 0 && !mapped)
+    {
+        opened = false; // Fall through to the stream reader below
+    }
+    if (opened) return;
+#endif
+
+    std::ifstream file{filename, std::ios::binary};
+    if (!file.is_open()) return;
+    std::ostringstream contents;
+    contents << file.rdbuf();
+    fallback = contents.str();
+    bytes = fallback.data();
+    length = fallback.size();
+    opened = true;
+}
+
+// Releases the mapping, if there is one
+MappedFile::~MappedFile()
+{
+#ifdef MAPPEDFILE_HAS_MMAP
+    if (mapped)
+    {
+        ::munmap(const_cast<char*>(bytes), length);
+    }
+#endif
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+
+/** A read-only view of a whole file. Uses mmap where the platform
+ * has it, so the bytes are shared with the page cache instead of
+ * being copied; elsewhere it falls back to reading the file in.
+ */
+class MappedFile
+{
+    public:
+        MappedFile(const std::string& filename);
+        ~MappedFile();
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        /** true if the file was opened, same meaning as ifstream::is_open */
+        bool isOpen() const { return opened; }
+        const char* data() const { return bytes; }
+        size_t size() const { return length; }
+        std::string_view view() const { return std::string_view{bytes, length}; }
+
+    private:
+        bool opened = false;
+        const char* bytes = nullptr;
+        size_t length = 0;
+        /** true if bytes points at an mmap region that must be unmapped */
+        bool mapped = false;
+        /** holds the contents when mmap is not available */
+        std::string fallback;
+};
@@ -0,0 +1,239 @@
+#include "MarketFeed.h"
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cerrno>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+    const char feedMagic[8] = {'M', 'R', 'K', 'L', 'F', 'E', 'E', 'D'};
+    const uint32_t feedVersion = 1;
+    const size_t productNameLength = 32;
+
+    /** FeedRing::state */
+    enum : uint32_t {ringCreating = 0, ringLive = 1, ringClosed = 2};
+
+    std::runtime_error feedError(const std::string& what)
+    {
+        return std::runtime_error{what + ": " + std::strerror(errno)};
+    }
+
+    // shm_open wants one leading slash and no others
+    std::string sharedName(const std::string& name)
+    {
+        return name.empty() || name[0] != '/' ? "/" + name : name;
+    }
+
+    /** One message's place in the ring. sequence is the message's sequence
+     * once it is whole, 0 while it is being written; the message's other
+     * 56 bytes follow, as words so both sides can copy them as atomics.
+     */
+    struct alignas(64) FeedSlot
+    {
+        std::atomic<uint64_t> sequence{0};
+        std::atomic<uint64_t> words[7] = {};
+    };
+    static_assert(sizeof(FeedSlot) == sizeof(FeedMessage), "a slot holds one message");
+}
+
+// The start of the shared memory; capacity slots follow it
+struct alignas(64) FeedRing
+{
+    char magic[8];
+    uint32_t version = feedVersion;
+    /** Decimal::places of the writer, so readers scale prices the same */
+    uint32_t decimalPlaces = Decimal::places;
+    uint64_t capacity = 0;
+    std::atomic<uint32_t> state{ringCreating};
+    /** sequence of the last whole message; on a line of its own, as readers poll it */
+    alignas(64) std::atomic<uint64_t> published{0};
+    alignas(64) char productNames[FeedPublisher::maxProducts][productNameLength] = {};
+};
+
+namespace
+{
+    FeedSlot* slotsOf(FeedRing* ring)
+    {
+        return reinterpret_cast<FeedSlot*>(ring + 1);
+    }
+
+    const FeedSlot* slotsOf(const FeedRing* ring)
+    {
+        return reinterpret_cast<const FeedSlot*>(ring + 1);
+    }
+}
+
+// Creates the shared memory, lays out the ring in it and marks it live for readers
+FeedPublisher::FeedPublisher(const Options& options)
+: name(sharedName(options.name))
+{
+    if (options.capacity == 0 || (options.capacity & (options.capacity - 1)) != 0)
+    {
+        throw std::invalid_argument{"FeedPublisher: capacity must be a power of two"};
+    }
+    bytes = sizeof(FeedRing) + options.capacity * sizeof(FeedSlot);
+    mask = options.capacity - 1;
+
+    ::shm_unlink(name.c_str()); // A feed left by an earlier run; its readers keep their mapping and see it close
+    int fd = ::shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR | O_CLOEXEC, 0644);
+    if (fd < 0) throw feedError("FeedPublisher: could not create " + name);
+    if (::ftruncate(fd, static_cast<off_t>(bytes)) != 0)
+    {
+        std::runtime_error error = feedError("FeedPublisher: could not size " + name);
+        ::close(fd);
+        ::shm_unlink(name.c_str());
+        throw error;
+    }
+    void* memory = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (memory == MAP_FAILED)
+    {
+        std::runtime_error error = feedError("FeedPublisher: could not map " + name);
+        ::shm_unlink(name.c_str());
+        throw error;
+    }
+
+    // Constructing every slot also faults every page in now, not on the matching thread later
+    ring = new (memory) FeedRing{};
+    std::memcpy(ring->magic, feedMagic, sizeof(feedMagic));
+    ring->capacity = options.capacity;
+    FeedSlot* slots = slotsOf(ring);
+    for (size_t i = 0; i < options.capacity; ++i) new (&slots[i]) FeedSlot{};
+    ring->state.store(ringLive, std::memory_order_release);
+}
+
+FeedPublisher::~FeedPublisher()
+{
+    ring->state.store(ringClosed, std::memory_order_release);
+    ::munmap(ring, bytes);
+    ::shm_unlink(name.c_str());
+}
+
+bool FeedPublisher::nameProduct(uint16_t productId, std::string_view productName)
+{
+    if (productId >= maxProducts || productName.size() >= productNameLength) return false;
+    char* slot = ring->productNames[productId];
+    std::memset(slot, 0, productNameLength);
+    std::memcpy(slot, productName.data(), productName.size());
+    return true;
+}
+
+// Seqlock write: mark the slot busy, fill it, then stamp it with its sequence
+uint64_t FeedPublisher::publish(const FeedMessage& message)
+{
+    uint64_t next = ++sequence;
+    FeedSlot& slot = slotsOf(ring)[(next - 1) & mask];
+    std::array<uint64_t, 8> words = std::bit_cast<std::array<uint64_t, 8>>(message);
+
+    slot.sequence.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release); // A reader seeing any new word then sees the busy mark
+    for (size_t i = 0; i < 7; ++i) slot.words[i].store(words[i + 1], std::memory_order_relaxed);
+    slot.sequence.store(next, std::memory_order_release);
+    ring->published.store(next, std::memory_order_release);
+    return next;
+}
+
+// Maps an existing feed read-only and starts at the next message, or the oldest one held
+FeedSubscriber::FeedSubscriber(const Options& options)
+{
+    std::string name = sharedName(options.name);
+    int fd = ::shm_open(name.c_str(), O_RDONLY | O_CLOEXEC, 0);
+    if (fd < 0) throw feedError("FeedSubscriber: could not open " + name);
+    struct stat info;
+    if (::fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < sizeof(FeedRing))
+    {
+        ::close(fd);
+        throw std::runtime_error{"FeedSubscriber: " + name + " is not ready"};
+    }
+    bytes = static_cast<size_t>(info.st_size);
+    void* memory = ::mmap(nullptr, bytes, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (memory == MAP_FAILED) throw feedError("FeedSubscriber: could not map " + name);
+    ring = static_cast<const FeedRing*>(memory);
+
+    std::string problem;
+    if (ring->state.load(std::memory_order_acquire) == ringCreating) problem = " is not ready";
+    else if (std::memcmp(ring->magic, feedMagic, sizeof(feedMagic)) != 0 || ring->version != feedVersion) problem = " is not a feed";
+    else if (ring->decimalPlaces != static_cast<uint32_t>(Decimal::places))
+    {
+        problem = " was written with DECIMAL_PLACES=" + std::to_string(ring->decimalPlaces)
+                + ", this build has " + std::to_string(Decimal::places);
+    }
+    else if (bytes < sizeof(FeedRing) + ring->capacity * sizeof(FeedSlot)) problem = " is cut short";
+    if (!problem.empty())
+    {
+        ::munmap(memory, bytes);
+        throw std::runtime_error{"FeedSubscriber: " + name + problem};
+    }
+
+    mask = ring->capacity - 1;
+    uint64_t published = ring->published.load(std::memory_order_acquire);
+    if (!options.fromOldest) cursor = published + 1;
+    else cursor = published > mask ? published - mask : 1;
+}
+
+FeedSubscriber::~FeedSubscriber()
+{
+    ::munmap(const_cast<FeedRing*>(ring), bytes);
+}
+
+// Seqlock read: a copy is good only if the slot held this sequence before and after it
+bool FeedSubscriber::next(FeedMessage& message)
+{
+    const FeedSlot* slots = slotsOf(ring);
+    while (true)
+    {
+        uint64_t published = ring->published.load(std::memory_order_acquire);
+        if (cursor > published) return false;
+        if (published - cursor > mask)
+        {
+            uint64_t oldest = published - mask; // The writer has reused the slots of everything before it
+            skipped += oldest - cursor;
+            cursor = oldest;
+        }
+
+        const FeedSlot& slot = slots[(cursor - 1) & mask];
+        std::array<uint64_t, 8> words;
+        uint64_t before = slot.sequence.load(std::memory_order_acquire);
+        for (size_t i = 0; i < 7; ++i) words[i + 1] = slot.words[i].load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        uint64_t after = slot.sequence.load(std::memory_order_relaxed);
+        if (before == cursor && after == cursor)
+        {
+            words[0] = cursor;
+            message = std::bit_cast<FeedMessage>(words);
+            ++cursor;
+            return true;
+        }
+        // The writer came round to this slot while it was being copied: it is lost, try the next
+        ++skipped;
+        ++cursor;
+    }
+}
+
+uint64_t FeedSubscriber::lag() const
+{
+    uint64_t published = ring->published.load(std::memory_order_acquire);
+    return published >= cursor ? published - cursor + 1 : 0;
+}
+
+bool FeedSubscriber::closed() const
+{
+    if (ring->state.load(std::memory_order_acquire) != ringClosed) return false;
+    return cursor > ring->published.load(std::memory_order_acquire);
+}
+
+std::string_view FeedSubscriber::productName(uint16_t productId) const
+{
+    if (productId >= FeedPublisher::maxProducts) return {};
+    const char* name = ring->productNames[productId];
+    return std::string_view{name, ::strnlen(name, productNameLength)};
+}
@@ -0,0 +1,151 @@
+#pragma once
+
+#include "Decimal.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+/** One trade or top-of-book change on the market-data feed. Plain data
+ * of a fixed 64 bytes, so it goes into shared memory as it is and every
+ * consumer sees the same layout.
+ */
+struct FeedMessage
+{
+    enum class Type : uint8_t
+    {
+        /** one fill from matching */
+        trade = 1,
+        /** a product's best bid or best ask changed */
+        quote
+    };
+
+    /** numbers the feed's messages from 1 with no gaps; FeedPublisher::publish sets it */
+    uint64_t sequence = 0;
+    /** the timeframe, microseconds since the epoch */
+    int64_t timestamp = 0;
+    Type type = Type::trade;
+    uint8_t reserved = 0;
+    /** SymbolTable product id; FeedSubscriber::productName gives its name */
+    uint16_t productId = 0;
+    /** trades: SymbolTable user ids of the bid's and the ask's owners */
+    uint32_t buyer = 0;
+    uint32_t seller = 0;
+    uint32_t reserved2 = 0;
+    /** trades: the price and amount traded. Quotes: the best bid and the
+     * amount at it, zero if there are no bids.
+     */
+    Decimal price;
+    Decimal amount;
+    /** quotes: the best ask and the amount at it, zero if there are no asks */
+    Decimal askPrice;
+    Decimal askAmount;
+};
+static_assert(sizeof(FeedMessage) == 64, "FeedMessage is one slot of the feed");
+
+/** the feed's shared memory layout, defined in MarketFeed.cpp */
+struct FeedRing;
+
+/** Publishes FeedMessages to other processes on the machine through a
+ * ring buffer in POSIX shared memory (shm_open), so any number of them
+ * can read one feed.
+ *
+ * There is one writer and no locks. Each slot carries the sequence of
+ * the message in it, and a slot is rewritten like a seqlock, so a
+ * reader can tell a torn copy from a good one. Publishing only writes
+ * memory: there is no syscall, no wait on readers and no cost per reader.
+ * A reader that falls a whole ring behind loses the oldest messages,
+ * never holds up the writer, and sees the gap in the sequence numbers.
+ */
+class FeedPublisher
+{
+    public:
+        struct Options
+        {
+            /** shared memory object name, e.g. "merkel-feed" for /dev/shm/merkel-feed */
+            std::string name = "merkel-feed";
+            /** messages the ring holds, a power of two; how far a reader may fall behind */
+            size_t capacity = 1 << 16;
+        };
+
+        /** most products the feed can name */
+        static constexpr size_t maxProducts = 256;
+
+        /** create the feed, replacing any left by an earlier run under the
+         * same name. Throws std::invalid_argument for a bad capacity and
+         * std::runtime_error if the shared memory can not be set up.
+         */
+        FeedPublisher(const Options& options);
+        /** marks the feed closed for its readers and removes the name */
+        ~FeedPublisher();
+
+        FeedPublisher(const FeedPublisher&) = delete;
+        FeedPublisher& operator=(const FeedPublisher&) = delete;
+
+        /** give readers the name of a product id before its first message.
+         * False if the id is past maxProducts or the name is too long.
+         */
+        bool nameProduct(uint16_t productId, std::string_view productName);
+        /** write a message to the next slot, setting its sequence, and return that */
+        uint64_t publish(const FeedMessage& message);
+        /** sequence of the last message published, 0 for none */
+        uint64_t published() const { return sequence; }
+
+    private:
+        std::string name;
+        FeedRing* ring = nullptr;
+        size_t bytes = 0;
+        uint64_t mask = 0;
+        uint64_t sequence = 0;
+};
+
+/** Reads a feed written by a FeedPublisher in another process (or this
+ * one). Each subscriber keeps its own place, so readers do not affect
+ * each other or the writer. Link MarketFeed.cpp; nothing else is needed.
+ */
+class FeedSubscriber
+{
+    public:
+        struct Options
+        {
+            /** the publisher's Options::name */
+            std::string name = "merkel-feed";
+            /** start from the oldest message the ring still holds, rather than the next one published */
+            bool fromOldest = false;
+        };
+
+        /** open the feed read-only. Throws std::runtime_error if there is
+         * no such feed, it is not ready yet, or it was written by a build
+         * with other DECIMAL_PLACES.
+         */
+        FeedSubscriber(const Options& options);
+        ~FeedSubscriber();
+
+        FeedSubscriber(const FeedSubscriber&) = delete;
+        FeedSubscriber& operator=(const FeedSubscriber&) = delete;
+
+        /** copy the next message out, false if there is none yet. Never
+         * blocks: poll it, backing off as suits the reader. After falling
+         * a ring behind it skips to the oldest message still held, so the
+         * sequence jumps and lost() counts what was skipped.
+         */
+        bool next(FeedMessage& message);
+        /** messages skipped for falling behind, so far */
+        uint64_t lost() const { return skipped; }
+        /** messages published and not yet read */
+        uint64_t lag() const;
+        /** true once the publisher has gone and every message has been read */
+        bool closed() const;
+        /** the name the publisher gave a product id, "" if none */
+        std::string_view productName(uint16_t productId) const;
+        /** messages the ring holds */
+        size_t capacity() const { return static_cast<size_t>(mask + 1); }
+
+    private:
+        const FeedRing* ring = nullptr;
+        size_t bytes = 0;
+        uint64_t mask = 0;
+        /** sequence of the next message to read */
+        uint64_t cursor = 1;
+        uint64_t skipped = 0;
+};
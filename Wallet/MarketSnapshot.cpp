@@ -0,0 +1,337 @@
+#include "MarketSnapshot.h"
+#include "CSVReader.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <numeric>
+#include <string>
+#include <stdexcept>
+#include <vector>
+
+namespace
+{
+    const char snapshotMagic[8] = {'M', 'R', 'K', 'L', 'S', 'N', 'A', 'P'};
+    const uint32_t snapshotVersion = 4;
+
+    // Fixed header at the start of the file. Section offsets are in bytes from the start and 8-byte aligned.
+    struct SnapshotHeader
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t productCount;
+        uint64_t rowCount;
+        uint64_t timeframeCount;
+        uint64_t nameOffsetsAt;   // uint32[productCount + 1]
+        uint64_t namesAt;         // product names, back to back
+        uint64_t timeframesAt;    // int64[timeframeCount]
+        uint64_t bucketStartsAt;  // uint64[timeframeCount * productCount * sideCount + 1]
+        uint64_t timestampsAt;    // int64[rowCount]
+        uint64_t productsAt;      // uint16[rowCount]
+        uint64_t sidesAt;         // uint8[rowCount]
+        uint64_t pricesAt;        // Decimal[rowCount]
+        uint64_t amountsAt;       // Decimal[rowCount]
+        uint64_t priceOrderAt;    // uint32[rowCount]
+        uint64_t statsAt;         // OrderStats[timeframeCount * productCount * sideCount]
+        uint64_t levelStartsAt;   // uint64[timeframeCount * productCount * sideCount + 1]
+        uint64_t levelsAt;        // DepthLevel[levelStarts[bucketCount]]
+        uint64_t decimalPlaces;   // Decimal::places of the price and amount columns
+        uint64_t fileSize;
+    };
+
+    uint64_t alignTo8(uint64_t offset)
+    {
+        return (offset + 7) & ~uint64_t{7};
+    }
+
+    // Writes a column at its offset, padding the gap before it with zeros
+    template <typename T>
+    void writeSection(std::ofstream& out, uint64_t at, const T* data, size_t count)
+    {
+        static const char zeros[8] = {};
+        uint64_t position = static_cast<uint64_t>(out.tellp());
+        out.write(zeros, static_cast<std::streamsize>(at - position));
+        out.write(reinterpret_cast<const char*>(data), static_cast<std::streamsize>(count * sizeof(T)));
+    }
+}
+
+// Converts an order type to the side id stored in the file
+int MarketSnapshot::sideOf(OrderBookType type)
+{
+    if (type == OrderBookType::bid) return bidSide;
+    if (type == OrderBookType::ask) return askSide;
+    return otherSide;
+}
+
+// Checks the magic without mapping the whole file
+bool MarketSnapshot::isSnapshot(const std::string& filename)
+{
+    std::ifstream in{filename, std::ios::binary};
+    char magic[8] = {};
+    in.read(magic, sizeof(magic));
+    return in.gcount() == sizeof(magic) && std::memcmp(magic, snapshotMagic, sizeof(magic)) == 0;
+}
+
+// Reads the csv, groups its rows into buckets and writes every column out
+size_t MarketSnapshot::convert(const std::string& csvFilename,
+                               const std::string& snapshotFilename,
+                               unsigned loaderThreads)
+{
+    CSVReadSummary summary;
+    std::vector<OrderBookEntry> entries = CSVReader::readCSV(csvFilename, summary, loaderThreads);
+
+    // Product ids follow name order, so the products come out in the order getKnownProducts lists them
+    std::map<std::string, uint16_t> productIds;
+    for (const OrderBookEntry& e : entries) productIds[e.product()] = 0;
+    if (productIds.size() > UINT16_MAX) throw std::runtime_error{"too many products for a snapshot"};
+    std::vector<std::string> productNames;
+    for (auto& product : productIds)
+    {
+        product.second = static_cast<uint16_t>(productNames.size());
+        productNames.push_back(product.first);
+    }
+
+    std::vector<int64_t> timeframes;
+    for (const OrderBookEntry& e : entries) timeframes.push_back(e.timestamp);
+    std::sort(timeframes.begin(), timeframes.end());
+    timeframes.erase(std::unique(timeframes.begin(), timeframes.end()), timeframes.end());
+
+    // Bucket number of every row, then a stable sort so each bucket keeps file order
+    const size_t productCount = productNames.size();
+    const size_t bucketCount = timeframes.size() * productCount * sideCount;
+    std::vector<uint64_t> rowBucket(entries.size());
+    for (size_t i = 0; i < entries.size(); ++i)
+    {
+        size_t tf = std::lower_bound(timeframes.begin(), timeframes.end(), entries[i].timestamp) - timeframes.begin();
+        rowBucket[i] = (tf * productCount + productIds[entries[i].product()]) * sideCount + sideOf(entries[i].orderType);
+    }
+    std::vector<size_t> order(entries.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return rowBucket[a] < rowBucket[b]; });
+
+    std::vector<uint64_t> bucketStarts(bucketCount + 1, 0);
+    for (uint64_t bucket : rowBucket) ++bucketStarts[bucket + 1];
+    std::partial_sum(bucketStarts.begin(), bucketStarts.end(), bucketStarts.begin());
+
+    std::vector<int64_t> timestamps(entries.size());
+    std::vector<uint16_t> products(entries.size());
+    std::vector<uint8_t> sides(entries.size());
+    std::vector<Decimal> prices(entries.size());
+    std::vector<Decimal> amounts(entries.size());
+    for (size_t row = 0; row < order.size(); ++row)
+    {
+        const OrderBookEntry& e = entries[order[row]];
+        timestamps[row] = e.timestamp;
+        products[row] = productIds[e.product()];
+        sides[row] = static_cast<uint8_t>(sideOf(e.orderType));
+        prices[row] = e.price;
+        amounts[row] = e.amount;
+    }
+
+    // Within each bucket, row offsets in price order, ties kept in file order
+    std::vector<uint32_t> priceOrder(entries.size());
+    for (size_t bucket = 0; bucket < bucketCount; ++bucket)
+    {
+        uint64_t first = bucketStarts[bucket];
+        uint64_t last = bucketStarts[bucket + 1];
+        std::iota(priceOrder.begin() + first, priceOrder.begin() + last, 0);
+        std::stable_sort(priceOrder.begin() + first, priceOrder.begin() + last, [&](uint32_t a, uint32_t b)
+        {
+            return prices[first + a] < prices[first + b];
+        });
+    }
+
+    // Stats of each bucket, the median read straight off the price order
+    std::vector<OrderStats> stats(bucketCount);
+    for (size_t bucket = 0; bucket < bucketCount; ++bucket)
+    {
+        uint64_t first = bucketStarts[bucket];
+        uint64_t count = bucketStarts[bucket + 1] - first;
+        if (count == 0) continue;
+        const uint32_t* sorted = priceOrder.data() + first;
+        OrderStats& s = stats[bucket];
+        s.count = count;
+        s.low = prices[first + sorted[0]].toDouble();
+        s.high = prices[first + sorted[count - 1]].toDouble();
+        for (uint64_t row = first; row < first + count; ++row)
+        {
+            s.volume += amounts[row].toDouble();
+            s.notional += prices[row].toDouble() * amounts[row].toDouble();
+        }
+        s.median = prices[first + sorted[(count - 1) / 2]].toDouble();
+        if (count % 2 == 0) s.median = (s.median + prices[first + sorted[count / 2]].toDouble()) / 2;
+    }
+
+    // Depth ladder of each bucket: the price order with equal prices run together
+    std::vector<uint64_t> levelStarts{0};
+    std::vector<DepthLevel> levels;
+    for (size_t bucket = 0; bucket < bucketCount; ++bucket)
+    {
+        uint64_t first = bucketStarts[bucket];
+        uint64_t last = bucketStarts[bucket + 1];
+        for (uint64_t i = first; i < last; ++i)
+        {
+            uint64_t row = first + priceOrder[i];
+            double price = prices[row].toDouble();
+            double amount = amounts[row].toDouble();
+            bool sameLevel = i > first && prices[first + priceOrder[i - 1]] == prices[row];
+            if (!sameLevel)
+            {
+                DepthLevel level{price, 0, 0, 0};
+                if (levels.size() > levelStarts.back())
+                {
+                    level.cumulativeAmount = levels.back().cumulativeAmount;
+                    level.cumulativeNotional = levels.back().cumulativeNotional;
+                }
+                levels.push_back(level);
+            }
+            levels.back().amount += amount;
+            levels.back().cumulativeAmount += amount;
+            levels.back().cumulativeNotional += price * amount;
+        }
+        levelStarts.push_back(levels.size());
+    }
+
+    std::vector<uint32_t> nameOffsets{0};
+    std::string names;
+    for (const std::string& name : productNames)
+    {
+        names += name;
+        nameOffsets.push_back(static_cast<uint32_t>(names.size()));
+    }
+
+    SnapshotHeader header{};
+    std::memcpy(header.magic, snapshotMagic, sizeof(snapshotMagic));
+    header.version = snapshotVersion;
+    header.productCount = static_cast<uint32_t>(productCount);
+    header.rowCount = entries.size();
+    header.timeframeCount = timeframes.size();
+    header.nameOffsetsAt = alignTo8(sizeof(SnapshotHeader));
+    header.namesAt = alignTo8(header.nameOffsetsAt + nameOffsets.size() * sizeof(uint32_t));
+    header.timeframesAt = alignTo8(header.namesAt + names.size());
+    header.bucketStartsAt = alignTo8(header.timeframesAt + timeframes.size() * sizeof(int64_t));
+    header.timestampsAt = alignTo8(header.bucketStartsAt + bucketStarts.size() * sizeof(uint64_t));
+    header.productsAt = alignTo8(header.timestampsAt + entries.size() * sizeof(int64_t));
+    header.sidesAt = alignTo8(header.productsAt + entries.size() * sizeof(uint16_t));
+    header.pricesAt = alignTo8(header.sidesAt + entries.size() * sizeof(uint8_t));
+    header.amountsAt = alignTo8(header.pricesAt + entries.size() * sizeof(Decimal));
+    header.priceOrderAt = alignTo8(header.amountsAt + entries.size() * sizeof(Decimal));
+    header.statsAt = alignTo8(header.priceOrderAt + entries.size() * sizeof(uint32_t));
+    header.levelStartsAt = alignTo8(header.statsAt + stats.size() * sizeof(OrderStats));
+    header.levelsAt = alignTo8(header.levelStartsAt + levelStarts.size() * sizeof(uint64_t));
+    header.decimalPlaces = Decimal::places;
+    header.fileSize = header.levelsAt + levels.size() * sizeof(DepthLevel);
+
+    std::ofstream out{snapshotFilename, std::ios::binary | std::ios::trunc};
+    if (!out.is_open()) throw std::runtime_error{"cannot write " + snapshotFilename};
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    writeSection(out, header.nameOffsetsAt, nameOffsets.data(), nameOffsets.size());
+    writeSection(out, header.namesAt, names.data(), names.size());
+    writeSection(out, header.timeframesAt, timeframes.data(), timeframes.size());
+    writeSection(out, header.bucketStartsAt, bucketStarts.data(), bucketStarts.size());
+    writeSection(out, header.timestampsAt, timestamps.data(), timestamps.size());
+    writeSection(out, header.productsAt, products.data(), products.size());
+    writeSection(out, header.sidesAt, sides.data(), sides.size());
+    writeSection(out, header.pricesAt, prices.data(), prices.size());
+    writeSection(out, header.amountsAt, amounts.data(), amounts.size());
+    writeSection(out, header.priceOrderAt, priceOrder.data(), priceOrder.size());
+    writeSection(out, header.statsAt, stats.data(), stats.size());
+    writeSection(out, header.levelStartsAt, levelStarts.data(), levelStarts.size());
+    writeSection(out, header.levelsAt, levels.data(), levels.size());
+    if (!out) throw std::runtime_error{"failed writing " + snapshotFilename};
+    return entries.size();
+}
+
+// Maps the file and points each column at its section, without copying anything
+MarketSnapshot::MarketSnapshot(const std::string& filename)
+: file(filename)
+{
+    if (!file.isOpen() || file.size() < sizeof(SnapshotHeader))
+    {
+        throw std::runtime_error{"cannot open snapshot " + filename};
+    }
+    SnapshotHeader header;
+    std::memcpy(&header, file.data(), sizeof(header));
+    if (std::memcmp(header.magic, snapshotMagic, sizeof(snapshotMagic)) != 0)
+    {
+        throw std::runtime_error{"not a snapshot: " + filename};
+    }
+    // A snapshot from another build is stale rather than broken, so say how to remake it
+    const std::string reconvert = "; re-run --convert on its csv file";
+    if (header.version != snapshotVersion)
+    {
+        throw std::runtime_error{"snapshot " + filename + " is format version " + std::to_string(header.version) +
+                                 ", this build reads version " + std::to_string(snapshotVersion) + reconvert};
+    }
+    if (header.decimalPlaces != static_cast<uint64_t>(Decimal::places))
+    {
+        throw std::runtime_error{"snapshot " + filename + " was written with DECIMAL_PLACES=" +
+                                 std::to_string(header.decimalPlaces) + ", this build has " +
+                                 std::to_string(Decimal::places) + reconvert};
+    }
+    if (header.fileSize != file.size())
+    {
+        throw std::runtime_error{"snapshot " + filename + " is cut short or damaged" + reconvert};
+    }
+
+    const char* base = file.data();
+    rows = header.rowCount;
+    timeframes = header.timeframeCount;
+    products = header.productCount;
+    nameOffsets = reinterpret_cast<const uint32_t*>(base + header.nameOffsetsAt);
+    names = base + header.namesAt;
+    timeframeColumn = reinterpret_cast<const int64_t*>(base + header.timeframesAt);
+    bucketStarts = reinterpret_cast<const uint64_t*>(base + header.bucketStartsAt);
+    timestampColumn = reinterpret_cast<const int64_t*>(base + header.timestampsAt);
+    productColumn = reinterpret_cast<const uint16_t*>(base + header.productsAt);
+    sideColumn = reinterpret_cast<const uint8_t*>(base + header.sidesAt);
+    priceColumn = reinterpret_cast<const Decimal*>(base + header.pricesAt);
+    amountColumn = reinterpret_cast<const Decimal*>(base + header.amountsAt);
+    priceOrderColumn = reinterpret_cast<const uint32_t*>(base + header.priceOrderAt);
+    bucketStats = reinterpret_cast<const OrderStats*>(base + header.statsAt);
+    levelStarts = reinterpret_cast<const uint64_t*>(base + header.levelStartsAt);
+    levels = reinterpret_cast<const DepthLevel*>(base + header.levelsAt);
+}
+
+std::string_view MarketSnapshot::productName(size_t product) const
+{
+    return std::string_view{names + nameOffsets[product], nameOffsets[product + 1] - nameOffsets[product]};
+}
+
+// Products are stored in name order, so this is a binary search
+int MarketSnapshot::findProduct(std::string_view name) const
+{
+    size_t low = 0;
+    size_t high = products;
+    while (low < high)
+    {
+        size_t mid = (low + high) / 2;
+        if (productName(mid) < name) low = mid + 1;
+        else high = mid;
+    }
+    return low < products && productName(low) == name ? static_cast<int>(low) : -1;
+}
+
+long MarketSnapshot::findTimeframe(int64_t timestamp) const
+{
+    const int64_t* found = std::lower_bound(timeframeColumn, timeframeColumn + timeframes, timestamp);
+    if (found == timeframeColumn + timeframes || *found != timestamp) return -1;
+    return static_cast<long>(found - timeframeColumn);
+}
+
+std::pair<size_t, size_t> MarketSnapshot::bucket(size_t timeframe, size_t product, int side) const
+{
+    size_t b = (timeframe * products + product) * sideCount + side;
+    return {bucketStarts[b], bucketStarts[b + 1]};
+}
+
+const OrderStats& MarketSnapshot::stats(size_t timeframe, size_t product, int side) const
+{
+    return bucketStats[(timeframe * products + product) * sideCount + side];
+}
+
+std::span<const DepthLevel> MarketSnapshot::depth(size_t timeframe, size_t product, int side) const
+{
+    size_t b = (timeframe * products + product) * sideCount + side;
+    return std::span<const DepthLevel>{levels + levelStarts[b], levels + levelStarts[b + 1]};
+}
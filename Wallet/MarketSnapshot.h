@@ -0,0 +1,90 @@
+#pragma once
+
+#include "OrderBookEntry.h"
+#include "MappedFile.h"
+#include "OrderStats.h"
+#include "DepthLadder.h"
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+
+/** A day of market data in a binary columnar file, converted once
+ * from csv and then mapped read-only, so loading it costs nothing
+ * and every process replaying the day shares one page cache copy.
+ *
+ * Rows are grouped by timeframe, then product, then side, keeping
+ * file order within each group. Each column is a contiguous array:
+ * timestamps (int64 microseconds), product ids, side ids, prices and
+ * amounts (Decimals; a file only opens in a build with the same
+ * DECIMAL_PLACES). A directory gives the first row of every
+ * (timeframe, product, side) bucket, a per-bucket permutation
+ * gives its rows in price order. Each bucket's stats and depth ladder
+ * are worked out once at conversion.
+ */
+class MarketSnapshot
+{
+    public:
+        /** side ids used in the side column and bucket lookups */
+        static constexpr int bidSide = 0;
+        static constexpr int askSide = 1;
+        static constexpr int otherSide = 2;
+        static constexpr int sideCount = 3;
+
+        /** map a snapshot file; throws std::runtime_error if it is not one */
+        MarketSnapshot(const std::string& filename);
+
+        /** true if the file starts with the snapshot magic */
+        static bool isSnapshot(const std::string& filename);
+        /** read a csv data file and write it out as a snapshot.
+         * Returns the number of rows written.
+         */
+        static size_t convert(const std::string& csvFilename,
+                              const std::string& snapshotFilename,
+                              unsigned loaderThreads = 0);
+        static int sideOf(OrderBookType type);
+
+        size_t rowCount() const { return rows; }
+        size_t timeframeCount() const { return timeframes; }
+        size_t productCount() const { return products; }
+        int64_t timeframe(size_t i) const { return timeframeColumn[i]; }
+        std::string_view productName(size_t product) const;
+        /** product id by name, or -1 if the snapshot has no such product */
+        int findProduct(std::string_view name) const;
+        /** position of the timeframe with exactly this timestamp, or -1 */
+        long findTimeframe(int64_t timestamp) const;
+        /** rows [first, second) of one bucket, in file order */
+        std::pair<size_t, size_t> bucket(size_t timeframe, size_t product, int side) const;
+        /** count, range, volume, VWAP and median of one bucket */
+        const OrderStats& stats(size_t timeframe, size_t product, int side) const;
+        /** one bucket's price levels, cheapest first, with running totals */
+        std::span<const DepthLevel> depth(size_t timeframe, size_t product, int side) const;
+
+        const int64_t* timestamps() const { return timestampColumn; }
+        const uint16_t* productIds() const { return productColumn; }
+        const uint8_t* sides() const { return sideColumn; }
+        const Decimal* prices() const { return priceColumn; }
+        const Decimal* amounts() const { return amountColumn; }
+        /** for each bucket, the offsets of its rows from the bucket's first row, cheapest first */
+        const uint32_t* priceOrder() const { return priceOrderColumn; }
+
+    private:
+        MappedFile file;
+        size_t rows = 0;
+        size_t timeframes = 0;
+        size_t products = 0;
+        const uint32_t* nameOffsets = nullptr;
+        const char* names = nullptr;
+        const int64_t* timeframeColumn = nullptr;
+        const uint64_t* bucketStarts = nullptr;
+        const int64_t* timestampColumn = nullptr;
+        const uint16_t* productColumn = nullptr;
+        const uint8_t* sideColumn = nullptr;
+        const Decimal* priceColumn = nullptr;
+        const Decimal* amountColumn = nullptr;
+        const uint32_t* priceOrderColumn = nullptr;
+        const OrderStats* bucketStats = nullptr;
+        const uint64_t* levelStarts = nullptr;
+        const DepthLevel* levels = nullptr;
+};
@@ -3,11 +3,77 @@
 #include <vector>
 #include "OrderBookEntry.h"
 #include "CSVReader.h"
+#include "Logger.h"
+#include "Backtester.h"
+#include "SampleStrategies.h"
+#include <chrono>
+#include <fstream>
+#include <algorithm>
+#include <stdexcept>
+#include <charconv>
+#include <unordered_map>
+#include <csignal>
 
-// Constructor for the MerkelMain class
+// Opens the data file as a mapped snapshot if it is one, otherwise loads or streams it as csv
+static OrderBook openOrderBook(const MerkelMain::Options& options)
+{
+    if (MarketSnapshot::isSnapshot(options.dataFile))
+    {
+        return OrderBook{std::make_shared<const MarketSnapshot>(options.dataFile)};
+    }
+    if (options.streaming)
+    {
+        return OrderBook{options.dataFile, OrderBook::Streaming{options.lookahead}};
+    }
+    return OrderBook{options.dataFile, options.loaderThreads};
+}
+
+// A journal record of one of the user's orders
+static Journal::Record orderRecord(Journal::RecordType type, const OrderBookEntry& order, uint64_t id)
+{
+    Journal::Record record;
+    record.type = type;
+    record.side = order.orderType;
+    record.orderId = id;
+    record.timestamp = order.timestamp;
+    record.price = order.price;
+    record.amount = order.amount;
+    record.name = order.product();
+    return record;
+}
+
+// A feed message of one fill
+static FeedMessage tradeMessage(const Fill& sale)
+{
+    FeedMessage trade;
+    trade.type = FeedMessage::Type::trade;
+    trade.timestamp = sale.timestamp;
+    trade.productId = sale.productId;
+    trade.buyer = sale.buyer;
+    trade.seller = sale.seller;
+    trade.price = sale.price;
+    trade.amount = sale.amount;
+    return trade;
+}
+
+// Constructor for the MerkelMain class, using the default data file
 MerkelMain::MerkelMain()
+: MerkelMain(Options{})
+{
+}
+
+// Constructor for the MerkelMain class
+MerkelMain::MerkelMain(const Options& options)
+: orderBook(openOrderBook(options)),
+  wallet(agents.add(SymbolTable::simulatedUser)),
+  matchPool(options.matchThreads),
+  candleFile(options.candleFile),
+  candleInterval(options.candleInterval),
+  strategyThreads(options.strategyThreads),
+  journalDir(options.journalDir),
+  snapshotEvery(options.snapshotEvery),
+  feedName(options.feedName)
 {
-    // Constructor body is empty as no initialization is done here
 }
 
 // Initial setup function for the MerkelMain class
@@ -16,7 +82,34 @@ void MerkelMain::init()
     int input;
     currentTime = orderBook.getEarliestTime();  // Set the current time to the earliest time available in the order book
 
-    wallet.insertCurrency("BTC", 10);  // Insert initial currency into the wallet
+    if (journalDir != "")
+    {
+        try {
+            journal = std::make_unique<Journal>(journalDir);
+        } catch (const std::runtime_error& e) {
+            std::cout << e.what() << std::endl;  // A damaged journal is left alone for the user to look at
+            return;
+        }
+    }
+    if (!openFeed()) return;
+    if (journal && journal->recovered().found)
+    {
+        recover();  // Carry on from where the last run stopped
+    }
+    else
+    {
+        Journal::Record deposit;
+        deposit.type = Journal::RecordType::deposit;
+        deposit.amount = Decimal::whole(10);
+        deposit.name = "BTC";
+        wallet.insertCurrency(deposit.name, deposit.amount);  // Insert initial currency into the wallet
+        if (journal)
+        {
+            journal->append(deposit);
+            journal->commit();
+        }
+    }
+    publishQuotes();
 
     while(true)  // Enter an infinite loop to continuously interact with the user
     {
@@ -29,14 +122,16 @@ void MerkelMain::init()
 // Prints the main menu to the console
 void MerkelMain::printMenu()
 {
+    Logger::flush();  // Let the last choice's messages out before the menu
     std::cout << "1: Print help " << std::endl;  // Option to print help
     std::cout << "2: Print exchange stats" << std::endl;  // Option to print exchange stats
     std::cout << "3: Make an offer " << std::endl;  // Option to make an offer
     std::cout << "4: Make a bid " << std::endl;  // Option to make a bid
     std::cout << "5: Print wallet " << std::endl;  // Option to print wallet contents
     std::cout << "6: Continue " << std::endl;  // Option to move to the next timeframe
+    std::cout << "7: Cancel or amend an order " << std::endl;  // Option to change an order placed this timeframe
     std::cout << "============== " << std::endl;
-    std::cout << "Current time is: " << currentTime << std::endl;  // Displays the current time
+    std::cout << "Current time is: " << OrderBookEntry::timestampToString(currentTime) << std::endl;  // Displays the current time
 }
 
 // Prints help information
@@ -50,11 +145,13 @@ void MerkelMain::printMarketStats()
 {
     for (const std::string& p : orderBook.getKnownProducts())  // Loop through each product known to the order book
     {
-        std::vector<OrderBookEntry> entries = orderBook.getOrders(OrderBookType::ask, p, currentTime);  // Get ask orders for the current time and product
+        OrderStats asks = orderBook.getStats(OrderBookType::ask, p, currentTime);  // Ask stats for the current time and product
         std::cout << "Product: " << p << std::endl;  // Print the product name
-        std::cout << "Asks seen: " << entries.size() << std::endl;  // Print the number of ask entries
-        std::cout << "Max ask: " << OrderBook::getHighPrice(entries) << std::endl;  // Print the highest ask price
-        std::cout << "Min ask: " << OrderBook::getLowPrice(entries) << std::endl;  // Print the lowest ask price
+        std::cout << "Asks seen: " << asks.count << std::endl;  // Print the number of ask entries
+        std::cout << "Max ask: " << asks.high << std::endl;  // Print the highest ask price
+        std::cout << "Min ask: " << asks.low << std::endl;  // Print the lowest ask price
+        std::cout << "Median ask: " << asks.median << std::endl;  // Print the middle ask price
+        std::cout << "VWAP ask: " << asks.vwap() << std::endl;  // Print the volume-weighted average ask price
     }
 }
 
@@ -68,22 +165,22 @@ void MerkelMain::enterAsk()
     std::vector<std::string> tokens = CSVReader::tokenise(input, ',');  // Tokenise the input string
     if (tokens.size() != 3)
     {
-        std::cout << "MerkelMain::enterAsk Bad input! " << input << std::endl;  // Print error if input format is incorrect
+        LOG(app, warn) << "MerkelMain::enterAsk Bad input! " << input;  // Report the error if input format is incorrect
     }
     else {
         try {
             OrderBookEntry obe = CSVReader::stringsToOBE(tokens[1], tokens[2], currentTime, tokens[0], OrderBookType::ask);  // Create an OrderBookEntry from tokens
-            obe.username = "simuser";  // Set the username for the order
-            if (wallet.canFulfillOrder(obe))
+            SizeQuote impact;
+            if (uint64_t id = placeUserOrder(obe, &impact))
             {
-                std::cout << "Wallet looks good. " << std::endl;
-                orderBook.insertOrder(obe);  // Insert the order into the order book
+                std::cout << "Wallet looks good. Order id " << id << std::endl;
+                printImpact(obe, impact);
             }
             else {
                 std::cout << "Wallet has insufficient funds. " << std::endl;  // Warn if wallet has insufficient funds
             }
         } catch (const std::exception& e) {
-            std::cout << "MerkelMain::enterAsk Bad input" << std::endl;  // Handle any exceptions from creating an order
+            LOG(app, warn) << "MerkelMain::enterAsk Bad input";  // Handle any exceptions from creating an order
         }
     }
 }
@@ -98,22 +195,22 @@ void MerkelMain::enterBid()
     std::vector<std::string> tokens = CSVReader::tokenise(input, ',');  // Tokenise the input string
     if (tokens.size() != 3)
     {
-        std::cout << "MerkelMain::enterBid Bad input! " << input << std::endl;  // Print error if input format is incorrect
+        LOG(app, warn) << "MerkelMain::enterBid Bad input! " << input;  // Report the error if input format is incorrect
     }
     else {
         try {
             OrderBookEntry obe = CSVReader::stringsToOBE(tokens[1], tokens[2], currentTime, tokens[0], OrderBookType::bid);  // Create an OrderBookEntry from tokens
-            obe.username = "simuser";  // Set the username for the order
-            if (wallet.canFulfillOrder(obe))
+            SizeQuote impact;
+            if (uint64_t id = placeUserOrder(obe, &impact))
             {
-                std::cout << "Wallet looks good. " << std::endl;
-                orderBook.insertOrder(obe);  // Insert the order into the order book
+                std::cout << "Wallet looks good. Order id " << id << std::endl;
+                printImpact(obe, impact);
             }
             else {
                 std::cout << "Wallet has insufficient funds. " << std::endl;  // Warn if wallet has insufficient funds
             }
         } catch (const std::exception& e) {
-            std::cout << "MerkelMain::enterBid Bad input" << std::endl;  // Handle any exceptions from creating an order
+            LOG(app, warn) << "MerkelMain::enterBid Bad input";  // Handle any exceptions from creating an order
         }
     }
 }
@@ -128,21 +225,678 @@ void MerkelMain::printWallet()
 void MerkelMain::gotoNextTimeframe()
 {
     std::cout << "Going to next time frame. " << std::endl;
-    for (std::string p : orderBook.getKnownProducts())
+    std::vector<std::pair<int, Decimal>> before;
+    if (journal) before = wallet.holdings();
+    size_t userSaleCount;
+    matchTimeframe(userSaleCount);
+    int64_t matched = currentTime;
+    currentTime = orderBook.getNextTime(currentTime);  // Move to the next available time frame
+    if (journal) journalTimeframe(matched, before);
+    publishQuotes();
+}
+
+// Journals what matching did to the user, as one write committed in the background
+void MerkelMain::journalTimeframe(int64_t matched, const std::vector<std::pair<int, Decimal>>& before)
+{
+    std::vector<Journal::Record> records;
+    for (const std::vector<Fill>& sales : productSales)
+    {
+        for (const Fill& sale : sales)
+        {
+            if (sale.timestamp != matched || !sale.involves(SymbolTable::simulatedUser)) continue;  // Skip buffers left from an earlier timeframe
+            Journal::Record fill;
+            fill.type = Journal::RecordType::fill;
+            fill.side = sale.buyer == SymbolTable::simulatedUser ? OrderBookType::bid : OrderBookType::ask;
+            fill.timestamp = sale.timestamp;
+            fill.price = sale.price;
+            fill.amount = sale.amount;
+            fill.name = SymbolTable::productName(sale.productId);
+            records.push_back(fill);
+        }
+    }
+
+    // Matching only moves currencies the wallet already has, so both lists are in the same id order
+    std::vector<std::pair<int, Decimal>> after = wallet.holdings();
+    for (size_t i = 0, j = 0; i < after.size(); ++i)
+    {
+        Decimal was;
+        bool held = j < before.size() && before[j].first == after[i].first;
+        if (held) was = before[j++].second;
+        if (held && after[i].second == was) continue;
+        Journal::Record change;
+        change.type = Journal::RecordType::walletChange;
+        change.timestamp = matched;
+        change.amount = after[i].second - was;
+        change.name = SymbolTable::currencyName(after[i].first);
+        records.push_back(change);
+    }
+
+    Journal::Record timeframe;
+    timeframe.type = Journal::RecordType::timeframe;
+    timeframe.timestamp = matched;
+    timeframe.nextTime = currentTime;
+    records.push_back(timeframe);
+    journal->append(records);
+    journal->commit();  // The sync runs in the background, so the next timeframe does not wait for the disk
+
+    if (snapshotEvery > 0 && ++timeframesSinceSnapshot >= snapshotEvery) writeSnapshot();
+}
+
+// Snapshots the balances and the user's orders still on the book, which starts a new journal
+void MerkelMain::writeSnapshot()
+{
+    std::vector<Journal::Record> state;
+    for (const std::pair<int, Decimal>& holding : wallet.holdings())
+    {
+        Journal::Record deposit;
+        deposit.type = Journal::RecordType::deposit;
+        deposit.amount = holding.second;
+        deposit.name = SymbolTable::currencyName(holding.first);
+        state.push_back(deposit);
+    }
+    uint64_t nextId = orderBook.nextOrderId();
+    for (uint64_t id = 1; id < nextId; ++id)
+    {
+        const OrderBookEntry* order = orderBook.findOrder(id);
+        if (order != nullptr && order->userId == SymbolTable::simulatedUser)
+        {
+            state.push_back(orderRecord(Journal::RecordType::order, *order, id));
+        }
+    }
+    journal->writeSnapshot(currentTime, nextId, state);
+    timeframesSinceSnapshot = 0;
+}
+
+// Rebuilds the wallet, the user's orders and the time from the snapshot and the journal after it
+void MerkelMain::recover()
+{
+    const Journal::Recovery& recovery = journal->recovered();
+    if (recovery.fromSnapshot) currentTime = recovery.currentTime;
+    // A snapshot is taken as a timeframe starts, so none of its orders hold funds
+    for (const Journal::Record& record : recovery.state) applyRecord(record, false);
+    orderBook.skipOrderIds(recovery.nextOrderId);
+    for (const Journal::Record& record : recovery.tail) applyRecord(record, true);
+
+    if (orderBook.seekTime(currentTime) != currentTime)
+    {
+        LOG(app, warn) << "MerkelMain::recover the data file has no timeframe at "
+                       << OrderBookEntry::timestampToString(currentTime) << "; was the journal made with another one?";
+    }
+    if (recovery.discardedBytes > 0)
     {
-        std::cout << "matching " << p << std::endl;
-        std::vector<OrderBookEntry> sales = orderBook.matchAsksToBids(p, currentTime);  // Match asks and bids for the product
-        std::cout << "Sales: " << sales.size() << std::endl;  // Print the number of sales
-        for (OrderBookEntry& sale : sales)
+        LOG(app, warn) << "MerkelMain::recover dropped " << recovery.discardedBytes
+                       << " bytes of unfinished records from the end of the journal";
+    }
+    Logger::flush();
+    std::cout << "Recovered " << recovery.state.size() + recovery.tail.size() << " records from " << journalDir
+              << ", resuming at " << OrderBookEntry::timestampToString(currentTime) << std::endl;
+}
+
+// Redoes what one record says happened, the way the menu did it the first time
+void MerkelMain::applyRecord(const Journal::Record& record, bool reserve)
+{
+    switch (record.type)
+    {
+        case Journal::RecordType::deposit:
+            wallet.insertCurrency(record.name, record.amount);
+            break;
+        case Journal::RecordType::order:
+        {
+            OrderBookEntry order{record.price, record.amount, record.timestamp,
+                                 SymbolTable::productId(record.name), record.side, SymbolTable::simulatedUser};
+            orderBook.skipOrderIds(record.orderId);  // Ids given to orders cancelled before a snapshot stay unused
+            if (reserve) agents.reserve(order, record.orderId);
+            if (orderBook.insertOrder(order) != record.orderId)
+            {
+                LOG(app, warn) << "MerkelMain::recover order " << record.orderId << " came back with another id";
+            }
+            break;
+        }
+        case Journal::RecordType::cancel:
+        case Journal::RecordType::amend:
         {
-            std::cout << "Sale price: " << sale.price << " amount " << sale.amount << std::endl;  // Print details of each sale
-            if (sale.username == "simuser")
+            const OrderBookEntry* found = orderBook.findOrder(record.orderId);
+            if (found == nullptr) break;
+            OrderBookEntry order = *found;
+            agents.release(record.orderId);
+            if (record.type == Journal::RecordType::cancel)
             {
-                wallet.processSale(sale);  // Update wallet based on the sale
+                orderBook.cancelOrder(record.orderId);
+                break;
             }
+            OrderBookEntry amended = order;
+            amended.amount = record.amount;
+            agents.reserve(amended, record.orderId);
+            orderBook.amendOrder(record.orderId, record.amount);
+            break;
         }
+        case Journal::RecordType::fill:
+            break;  // Kept for the record; the wallet changes after it are what settle it
+        case Journal::RecordType::walletChange:
+            if (record.amount >= Decimal{}) wallet.insertCurrency(record.name, record.amount);
+            else wallet.removeCurrency(record.name, -record.amount);
+            break;
+        case Journal::RecordType::timeframe:
+            agents.release(record.timestamp);
+            currentTime = record.nextTime;
+            break;
     }
-    currentTime = orderBook.getNextTime(currentTime);  // Move to the next available time frame
+}
+
+// Matches every product at the current time, settling the user's sales in one batch
+size_t MerkelMain::matchTimeframe(size_t& userSaleCount)
+{
+    bool printSales = Logger::enabled(LogModule::matching, LogLevel::info);  // Checked once so quiet runs skip the loop below
+    std::vector<std::string> products = orderBook.getKnownProducts();
+    if (productSales.size() < products.size()) productSales.resize(products.size());
+
+    // Each product is matched into its own buffer, so the threads share nothing but the book
+    matchPool.parallelFor(products.size(), [&](size_t i)
+    {
+        productSales[i].clear();
+        orderBook.matchAsksToBids(products[i], currentTime, productSales[i]);  // Match asks and bids for the product
+    });
+
+    // Walk the buffers in product order so the output and the wallets match a serial run exactly
+    size_t saleCount = 0;
+    userSaleCount = 0;
+    for (size_t i = 0; i < products.size(); ++i)
+    {
+        const std::vector<Fill>& sales = productSales[i];
+        if (printSales)
+        {
+            LOG(matching, info) << "matching " << products[i];
+            LOG(matching, info) << "Sales: " << sales.size();  // Log the number of sales
+            for (const Fill& sale : sales)
+            {
+                LOG(matching, info) << "Sale price: " << sale.price.toDouble() << " amount " << sale.amount.toDouble();  // Log details of each sale
+            }
+        }
+        for (const Fill& sale : sales)
+        {
+            if (sale.involves(SymbolTable::simulatedUser)) ++userSaleCount;
+        }
+        agents.settle(sales);  // Update the wallets on both sides of each fill
+        if (feed)
+        {
+            for (const Fill& sale : sales) feed->publish(tradeMessage(sale));
+        }
+        if (candles) candles->add(products[i], currentTime, std::span<const Fill>{sales});  // Fold the fills into the product's candle
+        saleCount += sales.size();
+    }
+    agents.release(currentTime);  // The timeframe's orders have filled or expired, so nothing they held is still needed
+    return saleCount;
+}
+
+// Checks the user's order against the wallet and puts it on the book if it can be covered
+uint64_t MerkelMain::placeUserOrder(OrderBookEntry& order, SizeQuote* impact)
+{
+    order.userId = SymbolTable::simulatedUser;  // Set the user for the order
+    bool covered = impact != nullptr ? wallet.canFulfillOrder(order, orderBook, *impact) : wallet.canFulfillOrder(order);
+    if (!covered || !agents.reserve(order, orderBook.nextOrderId()))  // Hold the funds so a second order this timeframe can not spend them too
+    {
+        return 0;
+    }
+    uint64_t id = orderBook.insertOrder(order);  // Insert the order into the order book
+    if (journal) journal->append(orderRecord(Journal::RecordType::order, order, id));
+    publishQuote(order.productId);
+    return id;
+}
+
+// Cancels or resizes one of the user's orders from this timeframe, moving its hold on the wallet to match
+void MerkelMain::changeOrder()
+{
+    std::cout << "Cancel or amend an order - enter the id, or the id and a new amount, eg 3 or 3,0.25" << std::endl;
+    std::string input;
+    std::getline(std::cin, input);
+
+    std::vector<std::string> tokens = CSVReader::tokenise(input, ',');
+    uint64_t id = 0;
+    Decimal amount;
+    try {
+        if (tokens.size() != 1 && tokens.size() != 2) throw std::invalid_argument{"wrong field count"};
+        id = std::stoull(tokens[0]);
+        if (tokens.size() == 2 && !Decimal::parse(tokens[1], amount)) throw std::invalid_argument{"bad amount"};
+    } catch (const std::exception& e) {
+        LOG(app, warn) << "MerkelMain::changeOrder Bad input! " << input;
+        return;
+    }
+
+    switch (changeOrder(SymbolTable::simulatedUser, id, amount))  // Just an id leaves the amount at 0, a cancel
+    {
+        case OrderChange::cancelled:
+            std::cout << "Order " << id << " cancelled. " << std::endl;
+            break;
+        case OrderChange::amended:
+            std::cout << "Order " << id << " amended. " << std::endl;
+            break;
+        case OrderChange::notFound:
+            std::cout << "No order " << id << " of yours in this timeframe. " << std::endl;
+            break;
+        case OrderChange::insufficientFunds:
+            std::cout << "Wallet has insufficient funds. " << std::endl;
+            break;
+    }
+}
+
+// Cancels or resizes an order, releasing its hold and taking the new one
+MerkelMain::OrderChange MerkelMain::changeOrder(uint32_t user, uint64_t id, Decimal amount)
+{
+    // Only this timeframe's orders can still trade, and only they hold funds
+    const OrderBookEntry* found = orderBook.findOrder(id);
+    if (found == nullptr || found->userId != user || found->timestamp != currentTime)
+    {
+        return OrderChange::notFound;
+    }
+    OrderBookEntry order = *found;
+    bool journalled = journal && user == SymbolTable::simulatedUser;
+    if (amount <= Decimal{})
+    {
+        orderBook.cancelOrder(id);
+        agents.release(id);
+        if (journalled) journal->append(orderRecord(Journal::RecordType::cancel, order, id));
+        publishQuote(order.productId);
+        return OrderChange::cancelled;
+    }
+
+    OrderBookEntry amended = order;
+    amended.amount = amount;
+    agents.release(id);
+    if (!agents.reserve(amended, id))
+    {
+        agents.reserve(order, id);  // Put the old hold back; it fitted before
+        return OrderChange::insufficientFunds;
+    }
+    orderBook.amendOrder(id, amount);
+    if (journalled) journal->append(orderRecord(Journal::RecordType::amend, amended, id));
+    publishQuote(order.productId);
+    return OrderChange::amended;
+}
+
+// Creates the feed and names the products on it, so readers can tell what each id is
+bool MerkelMain::openFeed()
+{
+    if (feedName == "") return true;
+    try {
+        FeedPublisher::Options options;
+        options.name = feedName;
+        feed = std::make_unique<FeedPublisher>(options);
+    } catch (const std::runtime_error& e) {
+        std::cout << e.what() << std::endl;
+        return false;
+    }
+    for (const std::string& product : orderBook.getKnownProducts())
+    {
+        if (!feed->nameProduct(static_cast<uint16_t>(SymbolTable::productId(product)), product))
+        {
+            LOG(app, warn) << "MerkelMain::openFeed can not name " << product << " on the feed";
+        }
+    }
+    return true;
+}
+
+void MerkelMain::publishQuotes()
+{
+    if (!feed) return;
+    for (const std::string& product : orderBook.getKnownProducts())
+    {
+        publishQuote(static_cast<uint16_t>(SymbolTable::productId(product)));
+    }
+}
+
+// Reads the top level of each side and publishes it unless it is what readers already have
+void MerkelMain::publishQuote(uint16_t productId)
+{
+    if (!feed) return;
+    const std::string& product = SymbolTable::productName(productId);
+    std::vector<DepthLevel> bids = orderBook.getDepth(OrderBookType::bid, product, currentTime, 1);
+    std::vector<DepthLevel> asks = orderBook.getDepth(OrderBookType::ask, product, currentTime, 1);
+    FeedMessage quote;
+    quote.type = FeedMessage::Type::quote;
+    quote.timestamp = currentTime;
+    quote.productId = productId;
+    if (!bids.empty())
+    {
+        quote.price = Decimal::fromDouble(bids.front().price);
+        quote.amount = Decimal::fromDouble(bids.front().amount);
+    }
+    if (!asks.empty())
+    {
+        quote.askPrice = Decimal::fromDouble(asks.front().price);
+        quote.askAmount = Decimal::fromDouble(asks.front().amount);
+    }
+
+    if (quotes.size() <= productId) quotes.resize(productId + 1);
+    FeedMessage& last = quotes[productId];
+    if (quote.price == last.price && quote.amount == last.amount &&
+        quote.askPrice == last.askPrice && quote.askAmount == last.askAmount)
+    {
+        return;
+    }
+    last = quote;
+    feed->publish(quote);
+}
+
+// Prints how much of the order the other side could fill now and how far that would move the price
+void MerkelMain::printImpact(const OrderBookEntry& order, const SizeQuote& impact)
+{
+    if (impact.filled <= 0)
+    {
+        std::cout << "Market impact: nothing on the other side to fill against" << std::endl;
+        return;
+    }
+    std::cout << "Market impact: " << impact.filled << " of " << order.amount
+              << " would fill at " << impact.averagePrice << " on average, "
+              << impact.impact() * 100 << "% from the best price of " << impact.bestPrice << std::endl;
+}
+
+// Runs the whole dataset once without the menu, then prints a summary
+void MerkelMain::replay(const std::string& scriptFile)
+{
+    std::vector<OrderBookEntry> script;
+    if (scriptFile != "")
+    {
+        script = CSVReader::readCSV(scriptFile);  // The user's orders, in the same format as the data
+        std::stable_sort(script.begin(), script.end(), [](const OrderBookEntry& a, const OrderBookEntry& b)
+        {
+            return a.timestamp < b.timestamp;
+        });
+    }
+
+    if (!openFeed()) return;
+    wallet.insertCurrency("BTC", Decimal::whole(10));  // Same starting wallet as the interactive sim
+    currentTime = orderBook.getEarliestTime();
+    if (candleFile != "") candles = std::make_unique<CandleEngine>(candleInterval);
+
+    size_t timeframes = 0;
+    size_t saleCount = 0;
+    size_t userSaleCount = 0;
+    size_t placed = 0;
+    size_t refused = 0;
+    size_t nextScripted = 0;
+    std::vector<OrderBookEntry> due;  // This timeframe's scripted orders, reserved and filed as one batch
+    std::vector<uint8_t> accepted;
+    auto start = std::chrono::steady_clock::now();
+    while (true)
+    {
+        // Gather every scripted order that is due by now, stamped with the current timeframe
+        due.clear();
+        while (nextScripted < script.size() && script[nextScripted].timestamp <= currentTime)
+        {
+            OrderBookEntry order = script[nextScripted++];
+            order.timestamp = currentTime;
+            if (order.userId == SymbolTable::datasetUser) order.userId = SymbolTable::simulatedUser;  // Unnamed orders are the user's
+            agentWallet(order.userId);
+            due.push_back(order);
+        }
+        if (!due.empty())
+        {
+            size_t held = agents.reserve(due, accepted, orderBook.nextOrderId());  // insertOrders gives the kept ones these ids
+            placed += held;
+            refused += due.size() - held;
+            // Keep only the orders the wallets could cover, in script order
+            size_t kept = 0;
+            for (size_t i = 0; i < due.size(); ++i)
+            {
+                if (accepted[i]) due[kept++] = due[i];
+            }
+            due.erase(due.begin() + kept, due.end());
+            orderBook.insertOrders(due);
+        }
+        publishQuotes();  // The new timeframe's book, with the scripted orders in it
+
+        size_t userSales;
+        saleCount += matchTimeframe(userSales);
+        userSaleCount += userSales;
+        ++timeframes;
+
+        int64_t nextTime = orderBook.getNextTime(currentTime);
+        if (nextTime <= currentTime) break;  // The book wrapped round, so every timeframe has been run
+        currentTime = nextTime;
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    if (candles)
+    {
+        std::ofstream out{candleFile};
+        candles->writeCSV(out);
+        if (!out) LOG(app, error) << "MerkelMain::replay could not write " << candleFile;
+    }
+
+    Logger::flush();  // Let any queued messages out before the summary
+    std::cout << "Replay finished at " << OrderBookEntry::timestampToString(currentTime) << "\n"
+              << "Timeframes: " << timeframes << "\n"
+              << "Matches: " << saleCount << " (" << userSaleCount << " for the user)\n"
+              << "User orders: " << placed << " placed, " << refused << " refused for insufficient funds\n"
+              << (agents.size() > 1 ? "Agents: " + std::to_string(agents.size()) + "\n" : "")
+              << (feed ? "Feed: " + std::to_string(feed->published()) + " messages\n" : "")
+              << "Time: " << seconds << " s, "
+              << (seconds > 0 ? timeframes / seconds : 0) << " timeframes/sec, "
+              << (seconds > 0 ? saleCount / seconds : 0) << " matches/sec\n"
+              << "Wallet:\n" << wallet.toString() << std::flush;
+}
+
+// Builds the strategies, runs them side by side over the whole book and prints the results
+bool MerkelMain::backtest(const std::vector<std::string>& strategySpecs)
+{
+    std::vector<std::unique_ptr<Strategy>> strategies;
+    try
+    {
+        for (const std::string& spec : strategySpecs) strategies.push_back(StrategyFactory::create(spec));
+        Backtester::Options options;
+        options.threads = strategyThreads;
+        Backtester backtester{orderBook, options};
+
+        auto start = std::chrono::steady_clock::now();
+        std::vector<Backtester::Result> results = backtester.run(strategies);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        Logger::flush();
+        std::cout << "Backtest of " << strategies.size() << " strategies over "
+                  << orderBook.getTimeframes().size() << " timeframes in " << seconds << " s\n"
+                  << Backtester::report(results) << std::flush;
+    }
+    catch (const std::invalid_argument& e)
+    {
+        std::cout << e.what() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Finds an agent's wallet, giving a new agent the same starting funds as the user
+Wallet& MerkelMain::agentWallet(uint32_t user)
+{
+    if (Wallet* existing = agents.find(user)) return *existing;
+    Wallet& wallet = agents.add(user);
+    wallet.insertCurrency("BTC", Decimal::whole(10));
+    return wallet;
+}
+
+// Turns gateway requests into orders, cancels and amends, and runs the matching on each tick
+class MerkelMain::GatewaySession : public Gateway::Handler
+{
+    public:
+        GatewaySession(MerkelMain& app)
+        : app(app),
+          products(app.orderBook.getKnownProducts())
+        {
+        }
+
+        void onRequest(uint64_t client, std::string_view request, std::string& reply) override
+        {
+            std::string_view tokens[4];
+            size_t count = CSVReader::tokenise(request, ',', tokens, 4);
+            std::string_view command = count > 0 ? tokens[0] : std::string_view{};
+            if ((command == "bid" || command == "ask") && count == 4) placeOrder(client, command, tokens, reply);
+            else if ((command == "cancel" && count == 2) || (command == "amend" && count == 3)) changeOrder(client, tokens, count, reply);
+            else if (command == "login" && count == 2 && !tokens[1].empty())
+            {
+                uint32_t user = static_cast<uint32_t>(SymbolTable::userId(tokens[1]));
+                if (user == SymbolTable::datasetUser || user == SymbolTable::simulatedUser)
+                {
+                    reply += "err,name taken\n";  // The dataset and the menu's user are not for clients
+                    return;
+                }
+                app.agentWallet(user);
+                users[client] = user;
+                reply.append("ok,").append(tokens[1]).append("\n");
+            }
+            else reply += "err,unknown request\n";
+        }
+
+        void onDisconnect(uint64_t client) override
+        {
+            users.erase(client);  // The agent and its orders stay; logging in again picks them up
+        }
+
+        void onTick() override
+        {
+            size_t userSales;
+            size_t sales = app.matchTimeframe(userSales);
+            ++timeframes;
+            matches += sales;
+            LOG(app, info) << "Gateway matched " << OrderBookEntry::timestampToString(app.currentTime) << ": "
+                           << placedThisTimeframe << " orders, " << sales << " sales";
+            placedThisTimeframe = 0;
+            app.currentTime = app.orderBook.getNextTime(app.currentTime);
+            app.publishQuotes();
+        }
+
+        size_t placed = 0;
+        size_t refused = 0;
+        size_t timeframes = 0;
+        size_t matches = 0;
+
+    private:
+        // The client's agent, named after the connection until it logs in
+        uint32_t userOf(uint64_t client)
+        {
+            auto found = users.find(client);
+            if (found != users.end()) return found->second;
+            uint32_t user = static_cast<uint32_t>(SymbolTable::userId("client" + std::to_string(client)));
+            app.agentWallet(user);
+            users.emplace(client, user);
+            return user;
+        }
+
+        // The same checks as the menu: a known product, numbers that parse, and funds to cover it
+        void placeOrder(uint64_t client, std::string_view side, const std::string_view* tokens, std::string& reply)
+        {
+            if (std::find(products.begin(), products.end(), tokens[1]) == products.end())
+            {
+                ++refused;
+                reply += "err,unknown product\n";
+                return;
+            }
+            OrderBookType type = side == "bid" ? OrderBookType::bid : OrderBookType::ask;
+            try {
+                OrderBookEntry order = CSVReader::stringsToOBE(std::string{tokens[2]}, std::string{tokens[3]},
+                                                               app.currentTime, std::string{tokens[1]}, type);
+                if (order.price <= Decimal{} || order.amount <= Decimal{}) throw std::invalid_argument{"not positive"};
+                order.userId = userOf(client);
+                if (!app.agents.reserve(order, app.orderBook.nextOrderId()))
+                {
+                    ++refused;
+                    reply += "err,insufficient funds\n";
+                    return;
+                }
+                replyId(reply, app.orderBook.insertOrder(order));
+                app.publishQuote(order.productId);
+                ++placed;
+                ++placedThisTimeframe;
+            } catch (const std::exception& e) {
+                ++refused;
+                reply += "err,bad input\n";
+            }
+        }
+
+        void changeOrder(uint64_t client, const std::string_view* tokens, size_t count, std::string& reply)
+        {
+            uint64_t id = 0;
+            Decimal amount;
+            std::from_chars_result parsed = std::from_chars(tokens[1].data(), tokens[1].data() + tokens[1].size(), id);
+            if (parsed.ec != std::errc{} || (count == 3 && !Decimal::parse(tokens[2], amount)))
+            {
+                reply += "err,bad input\n";
+                return;
+            }
+            switch (app.changeOrder(userOf(client), id, amount))  // A cancel leaves the amount at 0
+            {
+                case OrderChange::cancelled:
+                case OrderChange::amended:
+                    replyId(reply, id);
+                    break;
+                case OrderChange::notFound:
+                    reply += "err,no such order\n";
+                    break;
+                case OrderChange::insufficientFunds:
+                    reply += "err,insufficient funds\n";
+                    break;
+            }
+        }
+
+        static void replyId(std::string& reply, uint64_t id)
+        {
+            char digits[24];
+            std::to_chars_result written = std::to_chars(digits, digits + sizeof(digits), id);
+            reply.append("ok,").append(digits, written.ptr).append("\n");
+        }
+
+        MerkelMain& app;
+        std::vector<std::string> products;
+        /** each connected client's agent */
+        std::unordered_map<uint64_t, uint32_t> users;
+        size_t placedThisTimeframe = 0;
+};
+
+// The gateway being served, so an interrupt can stop it
+static Gateway* servingGateway = nullptr;
+
+extern "C" void stopServing(int)
+{
+    if (servingGateway != nullptr) servingGateway->stop();  // Only an atomic store and a write, so safe in a signal handler
+}
+
+// Serves gateway clients until interrupted, then prints what they did
+bool MerkelMain::serve(const Gateway::Options& options)
+{
+    currentTime = orderBook.getEarliestTime();
+    if (!openFeed()) return false;
+    publishQuotes();
+    uint64_t fileLimit = Gateway::raiseFileLimit();
+    std::unique_ptr<Gateway> gateway;
+    try {
+        gateway = std::make_unique<Gateway>(options);
+    } catch (const std::runtime_error& e) {
+        std::cout << e.what() << std::endl;
+        return false;
+    }
+    GatewaySession session{*this};
+    Logger::flush();
+    std::cout << "Serving orders on " << options.address << ", a timeframe every " << options.tickMillis
+              << " ms, up to " << fileLimit << " open files" << std::endl;
+
+    servingGateway = gateway.get();
+    std::signal(SIGINT, stopServing);
+    std::signal(SIGTERM, stopServing);
+    auto start = std::chrono::steady_clock::now();
+    gateway->run(session);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::signal(SIGINT, SIG_DFL);
+    std::signal(SIGTERM, SIG_DFL);
+    servingGateway = nullptr;
+
+    Gateway::Stats stats = gateway->stats();
+    Logger::flush();
+    std::cout << "Gateway stopped at " << OrderBookEntry::timestampToString(currentTime) << "\n"
+              << "Clients: " << stats.accepted << " (" << stats.open << " still connected)\n"
+              << "Requests: " << stats.requests << ", " << (seconds > 0 ? stats.requests / seconds : 0) << "/sec\n"
+              << "Orders: " << session.placed << " placed, " << session.refused << " refused\n"
+              << "Timeframes: " << session.timeframes << ", matches: " << session.matches << "\n"
+              << "Agents: " << agents.size() << "\n"
+              << (feed ? "Feed: " + std::to_string(feed->published()) + " messages\n" : "") << std::flush;
+    return true;
 }
 
 // Gets a user option from standard input
@@ -150,7 +904,7 @@ int MerkelMain::getUserOption()
 {
     int userOption = 0;
     std::string line;
-    std::cout << "Type in 1-6" << std::endl;
+    std::cout << "Type in 1-7" << std::endl;
     std::getline(std::cin, line);  // Get the full input line from user
     try {
         userOption = std::stoi(line);  // Convert input to an integer
@@ -166,7 +920,7 @@ void MerkelMain::processUserOption(int userOption)
 {
     if (userOption == 0) // Handle bad input
     {
-        std::cout << "Invalid choice. Choose 1-6" << std::endl;
+        std::cout << "Invalid choice. Choose 1-7" << std::endl;
     }
     if (userOption == 1) // Option 1: Print help
     {
@@ -192,4 +946,8 @@ void MerkelMain::processUserOption(int userOption)
     {
         gotoNextTimeframe();
     }
+    if (userOption == 7) // Option 7: Cancel or amend an order
+    {
+        changeOrder();
+    }
 }
@@ -1,18 +1,89 @@
 #pragma once
 
+#include <memory>
 #include <vector>
 #include "OrderBookEntry.h"
 #include "OrderBook.h"
 #include "Wallet.h"
+#include "AgentRegistry.h"
+#include "ThreadPool.h"
+#include "CandleEngine.h"
+#include "Journal.h"
+#include "Gateway.h"
+#include "MarketFeed.h"
 
 
 class MerkelMain
 {
     public:
+        /** how to load the market data */
+        struct Options
+        {
+            /** a csv file or a snapshot made by MarketSnapshot::convert */
+            std::string dataFile = "20200317.csv";
+            /** threads used to parse a csv file, 0 for one per hardware thread */
+            unsigned loaderThreads = 1;
+            /** stream a csv file instead of loading it all */
+            bool streaming = false;
+            /** timeframes to read ahead when streaming */
+            size_t lookahead = 1;
+            /** threads used to match the products of a timeframe, 0 for one per hardware thread */
+            unsigned matchThreads = 1;
+            /** --replay writes candles of the fills to this csv file, "" for none */
+            std::string candleFile;
+            /** candle length in microseconds, 0 for one candle per timeframe */
+            int64_t candleInterval = 60000000;
+            /** threads running --backtest strategies, 0 for one per hardware thread */
+            unsigned strategyThreads = 0;
+            /** directory the interactive sim journals the user's orders and
+             * wallet to, and recovers them from on the next start; "" for none
+             */
+            std::string journalDir;
+            /** timeframes between snapshots of the journalled state, 0 for none */
+            size_t snapshotEvery = 100;
+            /** shared memory name to publish every fill and top-of-book change
+             * on for other processes (see FeedPublisher), "" for none
+             */
+            std::string feedName;
+        };
+
         MerkelMain();
-        /** Call this to start the sim */
+        MerkelMain(const Options& options);
+        /** Call this to start the sim. With a journal directory set, the
+         * sim first recovers the wallet, orders and time it left off at.
+         */
         void init();
+        /** Run every timeframe once, start to finish, without the menu.
+         * scriptFile (optional, "" for none) holds the user's orders in the
+         * data file format; each is placed when the replay reaches its time.
+         * A sixth column names the agent placing the order, so a script can
+         * run many traders: each new name gets the starting wallet, and the
+         * due orders of each timeframe are reserved against the agents'
+         * wallets as one batch.
+         * Prints a summary at the end; sales are logged as in the menu, so
+         * set the matching module's level to choose whether they are shown.
+         */
+        void replay(const std::string& scriptFile);
+        /** Run each strategy (a StrategyFactory spec) over every timeframe,
+         * all against the loaded book at once, and print how each did.
+         * Returns false, printing why, if a spec or the book will not do.
+         */
+        bool backtest(const std::vector<std::string>& strategySpecs);
+        /** Take orders from clients over a socket instead of the menu (see
+         * Gateway for the protocol), moving on to the next timeframe every
+         * options.tickMillis. Each client trades as its own agent, named by
+         * login or after its connection, and starts with the same wallet as
+         * the user. Orders go through the menu's checks onto the book at the
+         * current time. Serves until interrupted, then prints a summary.
+         * Returns false, printing why, if the socket can not be opened.
+         */
+        bool serve(const Gateway::Options& options);
     private: 
+        /** what changeOrder did */
+        enum class OrderChange {cancelled, amended, notFound, insufficientFunds};
+        /** answers gateway clients on behalf of the sim */
+        class GatewaySession;
+
         void printMenu();
         void printHelp();
         void printMarketStats();
@@ -20,13 +91,81 @@ class MerkelMain
         void enterBid();
         void printWallet();
         void gotoNextTimeframe();
+        /** match every product at the current time, settle the fills to the
+         * agents on either side and release the holds of the timeframe's orders.
+         * Each sale is logged at info level in the matching module.
+         * Returns the number of sales; userSaleCount gets the user's share.
+         */
+        size_t matchTimeframe(size_t& userSaleCount);
+        /** put an order from the user on the book if the wallet can cover it,
+         * holding its cost until the timeframe has been matched.
+         * Returns the order's id, 0 if it was refused.
+         * If impact is sent it gets the order's estimated market impact.
+         */
+        uint64_t placeUserOrder(OrderBookEntry& order, SizeQuote* impact = nullptr);
+        /** cancel one of the user's orders in this timeframe, or change its amount */
+        void changeOrder();
+        /** cancel (amount <= 0) or resize one of a user's orders in this
+         * timeframe, moving its hold on the user's wallet to match
+         */
+        OrderChange changeOrder(uint32_t user, uint64_t id, Decimal amount);
+        /** the wallet of an agent, added with the starting funds if it is new */
+        Wallet& agentWallet(uint32_t user);
+        /** apply the state and journal tail read from the journal directory */
+        void recover();
+        /** redo one journalled record; holds are taken for orders only if reserve is set */
+        void applyRecord(const Journal::Record& record, bool reserve);
+        /** journal the user's fills and wallet changes from matching the
+         * timeframe, then the move on to currentTime, and commit them.
+         * before is the wallet's holdings ahead of matching.
+         */
+        void journalTimeframe(int64_t matched, const std::vector<std::pair<int, Decimal>>& before);
+        /** write the wallet and the user's orders on the book to a new snapshot */
+        void writeSnapshot();
+        /** start the feed if options.feedName was set, naming every product
+         * on it. Returns false, printing why, if it can not be set up.
+         */
+        bool openFeed();
+        /** publish each product's best bid and ask at the current time, if they changed */
+        void publishQuotes();
+        /** publish one product's best bid and ask at the current time, if they changed */
+        void publishQuote(uint16_t productId);
+        /** print what an order would do to the price if it were filled now */
+        void printImpact(const OrderBookEntry& order, const SizeQuote& impact);
         int getUserOption();
         void processUserOption(int userOption);
 
-        std::string currentTime;
+        /** microseconds since the epoch */
+        int64_t currentTime;
+
+        OrderBook orderBook;
+
+        /** every trading agent's wallet, the user's included */
+        AgentRegistry agents;
+        /** the user's wallet in agents */
+        Wallet& wallet;
+
+        /** matches the products of a timeframe in parallel */
+        ThreadPool matchPool;
+        /** each product's fills for the current timeframe, reused between timeframes */
+        std::vector<std::vector<Fill>> productSales;
+
+        std::string candleFile;
+        int64_t candleInterval;
+        /** candles of the fills, built during --replay if candleFile is set */
+        std::unique_ptr<CandleEngine> candles;
+        unsigned strategyThreads;
 
-        OrderBook orderBook{"20200317.csv"};
+        std::string journalDir;
+        /** journal of the user's orders and wallet, nullptr when not journalling */
+        std::unique_ptr<Journal> journal;
+        size_t snapshotEvery;
+        size_t timeframesSinceSnapshot = 0;
 
-        Wallet wallet;
+        std::string feedName;
+        /** fills and quotes for other processes, nullptr when there is no feed */
+        std::unique_ptr<FeedPublisher> feed;
+        /** the quote last published for each product id */
+        std::vector<FeedMessage> quotes;
 
 };
@@ -1,171 +1,935 @@
 #include "OrderBook.h"
 #include "CSVReader.h"
+#include "Logger.h"
+#include "PriceKernels.h"
 #include <map>
 #include <algorithm>
-#include <iostream>
+#include <cstdint>
+#include <iterator>
 
 /** Construct, reading a csv data file */
-OrderBook::OrderBook(std::string filename)
+OrderBook::OrderBook(std::string filename, unsigned loaderThreads)
 {
-    orders = CSVReader::readCSV(filename); // Load the orders from the specified CSV file
+    std::vector<OrderBookEntry> entries = CSVReader::readCSV(filename, loaderThreads); // Load the orders from the specified CSV file
+    indexOrders(entries); // File each order under its product, side and timeframe
+}
+
+/** Construct over a csv data file, holding only a window of timeframes in memory */
+OrderBook::OrderBook(std::string filename, Streaming streaming)
+: stream(std::make_unique<CSVStreamReader>(filename)),
+  lookahead(streaming.lookahead)
+{
+    fillWindow(); // Read just the first few timeframes, however long the file is
+}
+
+/** Construct over a mapped snapshot, copying only its table of timeframes */
+OrderBook::OrderBook(std::shared_ptr<const MarketSnapshot> _snapshot)
+: snapshot(std::move(_snapshot))
+{
+    timeframes.reserve(snapshot->timeframeCount());
+    for (size_t i = 0; i < snapshot->timeframeCount(); ++i)
+    {
+        timeframes.push_back(snapshot->timeframe(i));
+    }
 }
 
 /** Return a vector of all known products in the dataset */
-std::vector<std::string> OrderBook::getKnownProducts()
+std::vector<std::string> OrderBook::getKnownProducts() const
 {
     std::vector<std::string> products;
-    std::map<std::string,bool> prodMap; // Use a map to track unique products
+    products.reserve(index.size());
 
-    for (OrderBookEntry& e : orders) // Iterate through all orders
+    // The index is keyed by product, so its keys are already unique and sorted
+    for (auto const& e : index)
     {
-        prodMap[e.product] = true; // Map each product name to true (existence)
+        products.push_back(e.first);
     }
-    
-    // Convert the map keys to a vector of strings (product names)
-    for (auto const& e : prodMap)
+
+    if (snapshot)
     {
-        products.push_back(e.first);
+        // Snapshot products are stored in name order too, so merge the two lists
+        std::vector<std::string> merged;
+        size_t i = 0;
+        for (size_t p = 0; p < snapshot->productCount(); ++p)
+        {
+            std::string name{snapshot->productName(p)};
+            while (i < products.size() && products[i] < name) merged.push_back(products[i++]);
+            if (i < products.size() && products[i] == name) ++i;
+            merged.push_back(name);
+        }
+        merged.insert(merged.end(), products.begin() + i, products.end());
+        products.swap(merged);
     }
 
     return products; // Return the list of unique product names
 }
 
-/** Return vector of Orders according to the sent filters */
-std::vector<OrderBookEntry> OrderBook::getOrders(OrderBookType type, 
-                                                 std::string product, 
-                                                 std::string timestamp)
+/** Return a view of the Orders that match the sent filters */
+OrderView OrderBook::getOrders(OrderBookType type, 
+                               const std::string& product, 
+                               int64_t timestamp) const
+{
+    const OrderBucket* bucket = findBucket(type, product, timestamp);
+    std::span<const OrderBookEntry> held;
+    if (bucket != nullptr) held = bucket->entries;
+    std::pair<size_t, size_t> rows = findSnapshotRows(type, product, timestamp);
+    if (rows.first == rows.second) return OrderView{held}; // Only orders held in memory
+
+    // Snapshot rows came before anything inserted since, so they go first
+    return OrderView{snapshot->prices() + rows.first, snapshot->amounts() + rows.first, rows.second - rows.first,
+                     timestamp, SymbolTable::productId(product), type, held};
+}
+
+/** Return the bucket an order belongs in, making it if need be */
+OrderBook::OrderBucket& OrderBook::bucketFor(const OrderBookEntry& order)
+{
+    return index[order.product()][order.orderType][order.timestamp];
+}
+
+/** Keep the table of distinct timeframes sorted; data files arrive in time order so this is usually an append */
+void OrderBook::noteTimeframe(int64_t timestamp)
+{
+    if (timeframes.empty() || timeframes.back() < timestamp)
+    {
+        timeframes.push_back(timestamp);
+        return;
+    }
+    auto it = std::lower_bound(timeframes.begin(), timeframes.end(), timestamp);
+    if (*it != timestamp)
+    {
+        timeframes.insert(it, timestamp);
+    }
+}
+
+/** Add an order to its product/side/timeframe bucket */
+OrderBook::OrderHandle OrderBook::indexOrder(const OrderBookEntry& order)
+{
+    OrderBucket& bucket = bucketFor(order);
+    uint32_t slot = bucket.add(order);
+    noteTimeframe(order.timestamp);
+    return OrderHandle{&bucket, slot};
+}
+
+/** Add a batch of orders, appending to each bucket and sorting it once */
+void OrderBook::indexOrders(std::span<const OrderBookEntry> orders, uint64_t firstId)
+{
+    std::vector<OrderBucket*> touched;
+    for (size_t i = 0; i < orders.size(); ++i)
+    {
+        const OrderBookEntry& order = orders[i];
+        OrderBucket& bucket = bucketFor(order);
+        if (bucket.entries.size() == bucket.links.size()) touched.push_back(&bucket); // First new order since it was sorted
+        bucket.entries.push_back(order);
+        if (firstId != 0) setHandle(firstId + i, bucket, static_cast<uint32_t>(bucket.entries.size() - 1));
+        noteTimeframe(order.timestamp);
+    }
+    for (OrderBucket* bucket : touched) bucket->rebuild(); // Slots stay where they are, so the handles hold
+}
+
+void OrderBook::setHandle(uint64_t id, OrderBucket& bucket, uint32_t slot)
+{
+    if (handles.size() < id) handles.resize(id);
+    handles[id - 1] = OrderHandle{&bucket, slot};
+    if (bucket.ids.size() <= slot) bucket.ids.resize(slot + 1, 0);
+    bucket.ids[slot] = id;
+}
+
+void OrderBook::dropHandles(const OrderBucket& bucket)
+{
+    for (uint64_t id : bucket.ids)
+    {
+        if (id != 0) handles[id - 1] = OrderHandle{};
+    }
+}
+
+/** Find the level of a price by binary search */
+size_t OrderBook::OrderBucket::findLevel(Decimal price) const
+{
+    auto at = std::lower_bound(levels.begin(), levels.end(), price,
+                               [](const PriceLevel& level, Decimal p) { return level.price < p; });
+    return at != levels.end() && at->price == price ? static_cast<size_t>(at - levels.begin()) : levels.size();
+}
+
+void OrderBook::OrderBucket::enqueue(PriceLevel& level, uint32_t slot)
+{
+    links[slot] = QueueLink{level.tail, noSlot};
+    if (level.tail != noSlot) links[level.tail].next = slot;
+    else level.head = slot;
+    level.tail = slot;
+    ++level.count;
+}
+
+void OrderBook::OrderBucket::unlink(PriceLevel& level, uint32_t slot)
+{
+    QueueLink link = links[slot];
+    if (link.prev != noSlot) links[link.prev].next = link.next;
+    else level.head = link.next;
+    if (link.next != noSlot) links[link.next].prev = link.prev;
+    else level.tail = link.prev;
+    --level.count;
+}
+
+/** Add an order to the back of the queue at its price, making the level if it is new */
+uint32_t OrderBook::OrderBucket::add(const OrderBookEntry& order)
+{
+    uint32_t slot = static_cast<uint32_t>(entries.size());
+    entries.push_back(order);
+    links.emplace_back();
+
+    // The stats and depth are for reporting, so they are kept as doubles
+    double price = order.price.toDouble();
+    double amount = order.amount.toDouble();
+    auto at = std::lower_bound(levels.begin(), levels.end(), order.price,
+                               [](const PriceLevel& level, Decimal p) { return level.price < p; });
+    size_t i = at - levels.begin();
+    if (at == levels.end() || at->price != order.price)
+    {
+        levels.insert(at, PriceLevel{order.price});
+        depth.insert(depth.begin() + i, DepthLevel{price, 0, 0, 0});
+        if (slot > 0 && i <= medianLevel) ++medianLevel; // The median's level moved up one
+    }
+    enqueue(levels[i], slot); // After any equal prices, so ties stay in arrival order
+    depth[i].amount += amount;
+    markStale(i);
+    if (slot > 0 && i < medianLevel) ++medianRank; // Filed below the median; at its level it joins the back, above it
+
+    stats.low = levels.front().price.toDouble();
+    stats.high = levels.back().price.toDouble();
+    ++stats.count;
+    stats.volume += amount;
+    stats.notional += price * amount;
+    updateMedian();
+    return slot;
+}
+
+/** Sort the whole bucket by price and redo everything derived from it */
+void OrderBook::OrderBucket::rebuild()
+{
+    std::vector<uint32_t> byPrice(entries.size());
+    for (uint32_t i = 0; i < byPrice.size(); ++i) byPrice[i] = i;
+    std::stable_sort(byPrice.begin(), byPrice.end(), [this](uint32_t a, uint32_t b)
+    {
+        return entries[a].price < entries[b].price;
+    });
+
+    links.assign(entries.size(), QueueLink{});
+    levels.clear();
+    stats = OrderStats{};
+    depth.clear();
+    staleFrom.store(SIZE_MAX, std::memory_order_release);
+    if (entries.empty()) return;
+    stats.count = entries.size();
+    stats.low = entries[byPrice.front()].price.toDouble();
+    stats.high = entries[byPrice.back()].price.toDouble();
+    for (const OrderBookEntry& e : entries) // Arrival order, the same order add() sums in
+    {
+        stats.volume += e.amount.toDouble();
+        stats.notional += e.price.toDouble() * e.amount.toDouble();
+    }
+
+    for (uint32_t slot : byPrice)
+    {
+        const OrderBookEntry& e = entries[slot];
+        double price = e.price.toDouble();
+        double amount = e.amount.toDouble();
+        if (levels.empty() || levels.back().price != e.price) // Levels split on exact price
+        {
+            levels.push_back(PriceLevel{e.price});
+            DepthLevel level{price, 0, 0, 0};
+            if (!depth.empty())
+            {
+                level.cumulativeAmount = depth.back().cumulativeAmount;
+                level.cumulativeNotional = depth.back().cumulativeNotional;
+            }
+            depth.push_back(level);
+        }
+        enqueue(levels.back(), slot);
+        depth.back().amount += amount;
+        depth.back().cumulativeAmount += amount;
+        depth.back().cumulativeNotional += price * amount;
+    }
+    staleFrom.store(SIZE_MAX, std::memory_order_release);
+
+    // Count through the levels once to place the median cursor; adds and removes then step it
+    medianRank = (entries.size() - 1) / 2;
+    medianLevel = 0;
+    size_t below = 0;
+    while (below + levels[medianLevel].count <= medianRank) below += levels[medianLevel++].count;
+    medianOffset = static_cast<uint32_t>(medianRank - below);
+    updateMedian();
+}
+
+/** Unlink the order, take it out of the totals, and fill its slot with the last order */
+uint64_t OrderBook::OrderBucket::remove(uint32_t slot)
 {
-    std::vector<OrderBookEntry> orders_sub;
-    for (OrderBookEntry& e : orders) // Filter orders based on type, product, and timestamp
+    const OrderBookEntry& order = entries[slot];
+    size_t i = findLevel(order.price);
+    // Orders at one price are alike to the median, so count this one as its level's last
+    if (i < medianLevel) --medianRank;
+    else if (i == medianLevel && medianOffset + 1 == levels[i].count)
+    {
+        ++medianLevel; // The median's order goes; the next one up takes its rank
+        medianOffset = 0;
+    }
+    unlink(levels[i], slot);
+    depth[i].amount -= order.amount.toDouble();
+    markStale(i);
+    if (levels[i].count == 0)
+    {
+        levels.erase(levels.begin() + i);
+        depth.erase(depth.begin() + i);
+        if (i < medianLevel) --medianLevel;
+    }
+
+    if (levels.empty())
+    {
+        stats = OrderStats{}; // Start clean rather than keep the rounding left by the subtractions
+        medianLevel = 0;
+        medianOffset = 0;
+        medianRank = 0;
+    }
+    else
+    {
+        double price = order.price.toDouble();
+        double amount = order.amount.toDouble();
+        --stats.count;
+        stats.volume -= amount;
+        stats.notional -= price * amount;
+        stats.low = levels.front().price.toDouble();
+        stats.high = levels.back().price.toDouble();
+    }
+
+    // Move the last slot's order into the hole, repointing its neighbours and its level's ends at it
+    uint32_t last = static_cast<uint32_t>(entries.size() - 1);
+    uint64_t moved = 0;
+    if (slot != last)
     {
-        if (e.orderType == type && e.product == product && e.timestamp == timestamp)
+        entries[slot] = entries[last];
+        links[slot] = links[last];
+        QueueLink link = links[slot];
+        PriceLevel& level = levels[findLevel(entries[slot].price)];
+        if (link.prev != noSlot) links[link.prev].next = slot;
+        else level.head = slot;
+        if (link.next != noSlot) links[link.next].prev = slot;
+        else level.tail = slot;
+        moved = idAt(last);
+        if (moved != 0 || slot < ids.size())
         {
-            orders_sub.push_back(e); // Add matching orders to the subset vector
+            if (ids.size() <= slot) ids.resize(slot + 1, 0);
+            ids[slot] = moved;
         }
     }
-    return orders_sub; // Return the filtered orders
+    entries.pop_back();
+    links.pop_back();
+    if (ids.size() > entries.size()) ids.resize(entries.size());
+    if (!levels.empty()) updateMedian();
+    return moved;
 }
 
-/** Return the highest price from a vector of orders */
-double OrderBook::getHighPrice(std::vector<OrderBookEntry>& orders)
+/** Change an order's amount in place, keeping its time priority only if it shrank */
+void OrderBook::OrderBucket::setAmount(uint32_t slot, Decimal amount)
+{
+    OrderBookEntry& order = entries[slot];
+    size_t i = findLevel(order.price);
+    if (amount > order.amount && levels[i].tail != slot)
+    {
+        unlink(levels[i], slot);
+        enqueue(levels[i], slot);
+    }
+    double change = (amount - order.amount).toDouble();
+    depth[i].amount += change;
+    markStale(i);
+    stats.volume += change;
+    stats.notional += order.price.toDouble() * change;
+    order.amount = amount;
+}
+
+/** Step the cursor to the middle rank, then read the middle price, or the mean of the two middle prices for an even count */
+void OrderBook::OrderBucket::updateMedian()
+{
+    size_t n = entries.size();
+    size_t middle = (n - 1) / 2;
+    while (medianRank < middle) stepMedian(true);
+    while (medianRank > middle) stepMedian(false);
+    stats.median = levels[medianLevel].price.toDouble();
+    if (n % 2 == 0)
+    {
+        const PriceLevel& next = medianOffset + 1 < levels[medianLevel].count ? levels[medianLevel] : levels[medianLevel + 1];
+        stats.median = (stats.median + next.price.toDouble()) / 2;
+    }
+}
+
+void OrderBook::OrderBucket::stepMedian(bool up)
+{
+    if (up)
+    {
+        if (medianOffset + 1 < levels[medianLevel].count) ++medianOffset;
+        else
+        {
+            ++medianLevel;
+            medianOffset = 0;
+        }
+        ++medianRank;
+    }
+    else
+    {
+        if (medianOffset > 0) --medianOffset;
+        else medianOffset = levels[--medianLevel].count - 1; // Also steps back in from past the last level
+        --medianRank;
+    }
+}
+
+/** Only the writer marks, so a plain load and store will do; the store publishes the change to readers */
+void OrderBook::OrderBucket::markStale(size_t i)
+{
+    if (i < staleFrom.load(std::memory_order_relaxed)) staleFrom.store(i, std::memory_order_release);
+}
+
+/** Redo the running totals from the lowest level changed up, from each level's own amount */
+void OrderBook::OrderBucket::settleDepth() const
+{
+    size_t i = staleFrom.load(std::memory_order_acquire);
+    for (; i < depth.size(); ++i)
+    {
+        DepthLevel& level = depth[i];
+        level.cumulativeAmount = level.amount;
+        level.cumulativeNotional = level.price * level.amount;
+        if (i > 0)
+        {
+            level.cumulativeAmount += depth[i - 1].cumulativeAmount;
+            level.cumulativeNotional += depth[i - 1].cumulativeNotional;
+        }
+    }
+    staleFrom.store(SIZE_MAX, std::memory_order_release);
+}
+
+/** Return the stats of one side of a product at a time, adding in a snapshot's */
+OrderStats OrderBook::getStats(OrderBookType type,
+                               const std::string& product,
+                               int64_t timestamp) const
+{
+    OrderStats stats;
+    if (snapshot)
+    {
+        int productId = snapshot->findProduct(product);
+        long timeframe = snapshot->findTimeframe(timestamp);
+        if (productId >= 0 && timeframe >= 0)
+        {
+            stats = snapshot->stats(timeframe, productId, MarketSnapshot::sideOf(type));
+        }
+    }
+    const OrderBucket* bucket = findBucket(type, product, timestamp);
+    if (bucket != nullptr) stats.combine(bucket->stats);
+    return stats;
+}
+
+/** Return the depth ladder for these filters, merging the snapshot's and the bucket's if both have one */
+std::span<const DepthLevel> OrderBook::findLadder(OrderBookType type,
+                                                  const std::string& product,
+                                                  int64_t timestamp,
+                                                  std::vector<DepthLevel>& merged) const
 {
-    double max = orders[0].price; // Start with the first order's price as the maximum
-    for (OrderBookEntry& e : orders)
+    std::span<const DepthLevel> mapped;
+    if (snapshot)
+    {
+        int productId = snapshot->findProduct(product);
+        long timeframe = snapshot->findTimeframe(timestamp);
+        if (productId >= 0 && timeframe >= 0)
+        {
+            mapped = snapshot->depth(timeframe, productId, MarketSnapshot::sideOf(type));
+        }
+    }
+    const OrderBucket* bucket = findBucket(type, product, timestamp);
+    if (bucket == nullptr || bucket->depth.empty()) return mapped;
+    if (bucket->staleFrom.load(std::memory_order_acquire) < bucket->depth.size())
     {
-        if (e.price > max) max = e.price; // Update max if a higher price is found
+        std::lock_guard<std::mutex> lock{depthMutex}; // Two readers may find it stale; the second finds nothing left to do
+        bucket->settleDepth();
     }
-    return max; // Return the highest price
+    if (mapped.empty()) return bucket->depth;
+    merged = DepthLadder::merge(mapped, bucket->depth); // Orders were inserted into a snapshot timeframe
+    return merged;
+}
+
+/** Return the best levels of one side in fill order */
+std::vector<DepthLevel> OrderBook::getDepth(OrderBookType type,
+                                            const std::string& product,
+                                            int64_t timestamp,
+                                            size_t maxLevels) const
+{
+    std::vector<DepthLevel> merged;
+    return DepthLadder::top(findLadder(type, product, timestamp, merged), type == OrderBookType::bid, maxLevels);
+}
+
+/** Return the cost of taking an amount from one side */
+SizeQuote OrderBook::getPriceForSize(OrderBookType type,
+                                     const std::string& product,
+                                     int64_t timestamp,
+                                     double size) const
+{
+    std::vector<DepthLevel> merged;
+    return DepthLadder::priceForSize(findLadder(type, product, timestamp, merged), type == OrderBookType::bid, size);
+}
+
+/** Return the amount on one side up to a limit price */
+double OrderBook::getSizeWithin(OrderBookType type,
+                                const std::string& product,
+                                int64_t timestamp,
+                                double limitPrice) const
+{
+    std::vector<DepthLevel> merged;
+    return DepthLadder::sizeWithin(findLadder(type, product, timestamp, merged), type == OrderBookType::bid, limitPrice);
+}
+
+/** Return the gap between the best bid and the best ask */
+double OrderBook::getSpread(const std::string& product, int64_t timestamp) const
+{
+    std::vector<DepthLevel> mergedAsks;
+    std::vector<DepthLevel> mergedBids;
+    std::span<const DepthLevel> asks = findLadder(OrderBookType::ask, product, timestamp, mergedAsks);
+    std::span<const DepthLevel> bids = findLadder(OrderBookType::bid, product, timestamp, mergedBids);
+    if (asks.empty() || bids.empty()) return 0;
+    return asks.front().price - bids.back().price; // Cheapest ask less dearest bid
+}
+
+/** Return the price halfway between the best bid and the best ask */
+double OrderBook::getMidPrice(const std::string& product, int64_t timestamp) const
+{
+    std::vector<DepthLevel> mergedAsks;
+    std::vector<DepthLevel> mergedBids;
+    std::span<const DepthLevel> asks = findLadder(OrderBookType::ask, product, timestamp, mergedAsks);
+    std::span<const DepthLevel> bids = findLadder(OrderBookType::bid, product, timestamp, mergedBids);
+    if (asks.empty() || bids.empty()) return 0;
+    return (asks.front().price + bids.back().price) / 2;
+}
+
+/** Return the bucket for these filters, or nullptr if there is none */
+const OrderBook::OrderBucket* OrderBook::findBucket(OrderBookType type,
+                                                    const std::string& product,
+                                                    int64_t timestamp) const
+{
+    auto productIt = index.find(product);
+    if (productIt == index.end()) return nullptr;
+    auto sideIt = productIt->second.find(type);
+    if (sideIt == productIt->second.end()) return nullptr;
+    auto timeIt = sideIt->second.find(timestamp);
+    if (timeIt == sideIt->second.end()) return nullptr;
+    return &timeIt->second;
+}
+
+/** Return the highest price from a vector of orders */
+Decimal OrderBook::getHighPrice(std::vector<OrderBookEntry>& orders)
+{
+    if (orders.empty()) return Decimal{}; // No orders, no price
+    return PriceKernels::max(&orders[0].price, orders.size(), sizeof(OrderBookEntry)); // Read the price field of each entry in place
 }
 
 /** Return the lowest price from a vector of orders */
-double OrderBook::getLowPrice(std::vector<OrderBookEntry>& orders)
+Decimal OrderBook::getLowPrice(std::vector<OrderBookEntry>& orders)
+{
+    if (orders.empty()) return Decimal{}; // No orders, no price
+    return PriceKernels::min(&orders[0].price, orders.size(), sizeof(OrderBookEntry)); // Read the price field of each entry in place
+}
+
+/** Find the snapshot rows filed under these filters */
+std::pair<size_t, size_t> OrderBook::findSnapshotRows(OrderBookType type,
+                                                      const std::string& product,
+                                                      int64_t timestamp) const
+{
+    if (!snapshot) return {0, 0};
+    int productId = snapshot->findProduct(product);
+    long timeframe = snapshot->findTimeframe(timestamp);
+    if (productId < 0 || timeframe < 0) return {0, 0};
+    return snapshot->bucket(timeframe, productId, MarketSnapshot::sideOf(type));
+}
+
+/** Position of the first timeframe at or after the given time */
+size_t OrderBook::lowerTimeframe(int64_t timestamp)
 {
-    double min = orders[0].price; // Start with the first order's price as the minimum
-    for (OrderBookEntry& e : orders)
+    // Callers mostly step forward one timeframe at a time, so try the cursor and its neighbour first
+    if (timeCursor < timeframes.size() && timeframes[timeCursor] == timestamp)
+    {
+        return timeCursor;
+    }
+    if (timeCursor + 1 < timeframes.size() && timeframes[timeCursor + 1] == timestamp)
     {
-        if (e.price < min) min = e.price; // Update min if a lower price is found
+        return ++timeCursor;
     }
-    return min; // Return the lowest price
+    timeCursor = std::lower_bound(timeframes.begin(), timeframes.end(), timestamp) - timeframes.begin();
+    return timeCursor;
 }
 
 /** Get the earliest timestamp from the order book */
-std::string OrderBook::getEarliestTime()
+int64_t OrderBook::getEarliestTime()
 {
-    return orders[0].timestamp; // Return the timestamp of the first order
+    if (timeframes.empty()) return 0; // An empty book has no time
+    return timeframes.front(); // The timeframe table is sorted, so the first one is the earliest
 }
 
 /** Get the next timestamp after the given one, or loop back to the first */
-std::string OrderBook::getNextTime(std::string timestamp)
+int64_t OrderBook::getNextTime(int64_t timestamp)
+{
+    if (stream) return streamNextTime(timestamp);
+    if (timeframes.empty()) return 0;
+    size_t i = lowerTimeframe(timestamp);
+    if (i < timeframes.size() && timeframes[i] == timestamp) ++i; // Step past the sent time itself
+    if (i >= timeframes.size())
+    {
+        return timeframes.front(); // Loop back to the first timestamp if no next timestamp is found
+    }
+    return timeframes[i];
+}
+
+/** Get the timestamp before the given one, or loop round to the last */
+int64_t OrderBook::getPreviousTime(int64_t timestamp)
 {
-    std::string next_timestamp = "";
-    for (OrderBookEntry& e : orders)
+    if (stream)
     {
-        if (e.timestamp > timestamp)
+        int64_t previous = streamSeekTime(timestamp - 1);
+        if (previous < timestamp) return previous;
+        return streamSeekTime(INT64_MAX); // Nothing earlier, so loop round to the last timestamp in the file
+    }
+    if (timeframes.empty()) return 0;
+    size_t i = lowerTimeframe(timestamp);
+    if (i == 0)
+    {
+        return timeframes.back(); // Loop round to the last timestamp if there is nothing earlier
+    }
+    return timeframes[i - 1];
+}
+
+/** Get the timeframe in force at the given time */
+int64_t OrderBook::seekTime(int64_t timestamp)
+{
+    if (stream) return streamSeekTime(timestamp);
+    if (timeframes.empty()) return 0;
+    size_t i = lowerTimeframe(timestamp);
+    if (i < timeframes.size() && timeframes[i] == timestamp) return timestamp;
+    if (i == 0) return timeframes.front(); // Before the start of the data
+    return timeframes[i - 1];
+}
+
+/** Read the next timeframe from the stream into the index */
+bool OrderBook::pullTimeframe()
+{
+    std::vector<OrderBookEntry> batch;
+    if (!stream->readTimeframe(batch))
+    {
+        if (!streamReported) // Report the rejected lines once, the first time the whole file has been seen
         {
-            next_timestamp = e.timestamp;
-            break; // Stop at the first timestamp greater than the current one
+            LOG(book, info) << "OrderBook streamed " << stream->getSummary().toString();
+            streamReported = true;
         }
+        return false;
+    }
+    indexOrders(batch);
+    return true;
+}
+
+/** Read ahead until the window holds the current timeframe and lookahead more */
+void OrderBook::fillWindow()
+{
+    while (timeframes.size() < lookahead + 1 && pullTimeframe())
+    {
     }
-    if (next_timestamp == "")
+}
+
+/** Drop every timeframe before the given time, keeping the product list */
+void OrderBook::releaseBefore(int64_t timestamp)
+{
+    for (auto& product : index)
     {
-        next_timestamp = orders[0].timestamp; // Loop back to the first timestamp if no next timestamp is found
+        for (auto& side : product.second)
+        {
+            auto end = side.second.lower_bound(timestamp);
+            for (auto bucket = side.second.begin(); bucket != end; ++bucket) dropHandles(bucket->second); // Their orders are gone with them
+            side.second.erase(side.second.begin(), end);
+        }
     }
-    return next_timestamp;
+    timeframes.erase(timeframes.begin(), std::lower_bound(timeframes.begin(), timeframes.end(), timestamp));
+    timeCursor = 0;
 }
 
-/** Insert a new order into the order book and sort by timestamp */
-void OrderBook::insertOrder(OrderBookEntry& order)
+/** Drop everything held and start reading the file from the top again */
+void OrderBook::rewindStream()
 {
-    orders.push_back(order); // Add the new order to the end of the list
-    // Sort the orders by timestamp using a defined comparator
-    std::sort(orders.begin(), orders.end(), OrderBookEntry::compareByTimestamp);
+    releaseBefore(INT64_MAX);
+    stream->rewind();
+    fillWindow();
 }
 
-/** Match ask and bid orders for a product at a specific timestamp */
-std::vector<OrderBookEntry> OrderBook::matchAsksToBids(std::string product, std::string timestamp)
+/** Move the window on to the timeframe after the given one, wrapping at the end of the file */
+int64_t OrderBook::streamNextTime(int64_t timestamp)
 {
-    std::vector<OrderBookEntry> asks = getOrders(OrderBookType::ask, product, timestamp);
-    std::vector<OrderBookEntry> bids = getOrders(OrderBookType::bid, product, timestamp);
+    auto next = std::upper_bound(timeframes.begin(), timeframes.end(), timestamp);
+    while (next == timeframes.end() && pullTimeframe())
+    {
+        next = std::upper_bound(timeframes.begin(), timeframes.end(), timestamp);
+    }
+    if (next == timeframes.end())
+    {
+        rewindStream(); // Loop back to the first timestamp if no next timestamp is found
+        return getEarliestTime();
+    }
+    int64_t nextTime = *next;
+    releaseBefore(nextTime);
+    fillWindow();
+    return nextTime;
+}
 
-    std::vector<OrderBookEntry> sales; // List to store matched sales
+/** Move the window to the timeframe in force at the given time */
+int64_t OrderBook::streamSeekTime(int64_t timestamp)
+{
+    if (timeframes.empty() || timestamp < timeframes.front())
+    {
+        rewindStream(); // Earlier timeframes have been dropped, so read them again
+    }
+    while (true)
+    {
+        // Only the latest timeframe at or before the sent time can be the answer, so drop the rest as we go
+        auto after = std::upper_bound(timeframes.begin(), timeframes.end(), timestamp);
+        if (after - timeframes.begin() >= 2) releaseBefore(*(after - 1));
+        after = std::upper_bound(timeframes.begin(), timeframes.end(), timestamp);
+        if (after != timeframes.end() || !pullTimeframe()) break;
+    }
+    fillWindow();
+    if (timeframes.empty()) return 0;
+    auto after = std::upper_bound(timeframes.begin(), timeframes.end(), timestamp);
+    if (after == timeframes.begin()) return timeframes.front(); // Before the start of the data
+    return *(after - 1);
+}
+
+/** Insert a new order into the order book */
+uint64_t OrderBook::insertOrder(const OrderBookEntry& order)
+{
+    OrderHandle at = indexOrder(order); // Straight into its level's queue, so nothing is re-sorted
+    uint64_t id = handles.size() + 1;
+    setHandle(id, *at.bucket, at.slot);
+    return id;
+}
+
+/** Insert many orders at once, e.g. every agent's orders for a timeframe */
+uint64_t OrderBook::insertOrders(std::span<const OrderBookEntry> orders)
+{
+    uint64_t firstId = handles.size() + 1;
+    handles.reserve(handles.size() + orders.size());
+    indexOrders(orders, firstId);
+    return firstId;
+}
+
+/** Remove an order through its handle */
+bool OrderBook::cancelOrder(uint64_t id)
+{
+    if (id == 0 || id > handles.size() || handles[id - 1].bucket == nullptr) return false;
+    OrderHandle at = handles[id - 1];
+    uint64_t moved = at.bucket->remove(at.slot);
+    if (moved != 0) handles[moved - 1].slot = at.slot; // The bucket's last order took the slot
+    handles[id - 1] = OrderHandle{};
+    return true;
+}
+
+/** Resize an order through its handle */
+bool OrderBook::amendOrder(uint64_t id, Decimal newAmount)
+{
+    if (newAmount <= Decimal{}) return cancelOrder(id);
+    if (id == 0 || id > handles.size() || handles[id - 1].bucket == nullptr) return false;
+    OrderHandle at = handles[id - 1];
+    at.bucket->setAmount(at.slot, newAmount);
+    return true;
+}
+
+const OrderBookEntry* OrderBook::findOrder(uint64_t id) const
+{
+    if (id == 0 || id > handles.size() || handles[id - 1].bucket == nullptr) return nullptr;
+    const OrderHandle& at = handles[id - 1];
+    return &at.bucket->entries[at.slot];
+}
 
-    if (asks.size() == 0 || bids.size() == 0)
+void OrderBook::skipOrderIds(uint64_t nextId)
+{
+    if (nextId > handles.size() + 1) handles.resize(nextId - 1); // Empty handles, so the skipped ids find nothing
+}
+
+/** Match ask and bid orders for a product at a specific timestamp */
+std::vector<OrderBookEntry> OrderBook::matchAsksToBids(std::string product, int64_t timestamp)
+{
+    std::vector<Fill> fills;
+    matchAsksToBids(product, timestamp, fills);
+    std::vector<OrderBookEntry> sales; // List to store matched sales
+    sales.reserve(fills.size());
+    for (const Fill& fill : fills)
     {
-        std::cout << "OrderBook::matchAsksToBids no bids or asks" << std::endl;
-        return sales; // Exit early if no asks or bids
+        bool toBuyer = fill.buyer != SymbolTable::datasetUser;
+        sales.emplace_back(fill.price, fill.amount, fill.timestamp, fill.productId,
+                           toBuyer ? OrderBookType::bidsale : OrderBookType::asksale,
+                           static_cast<int>(toBuyer ? fill.buyer : fill.seller));
     }
+    return sales; // Return all matched sales
+}
 
-    // Sort asks and bids by price to facilitate matching
-    std::sort(asks.begin(), asks.end(), OrderBookEntry::compareByPriceAsc);
-    std::sort(bids.begin(), bids.end(), OrderBookEntry::compareByPriceDesc);
+/** Gather one side of the book in fill order, from the snapshot and from the index */
+void OrderBook::collectSide(OrderBookType type,
+                            const std::string& product,
+                            int64_t timestamp,
+                            std::vector<MatchOrder>& orders) const
+{
+    const bool descending = type == OrderBookType::bid;
+    std::vector<MatchOrder> inserted;
+    std::vector<MatchOrder>& indexed = snapshot ? inserted : orders; // Without a snapshot there is nothing to merge
 
-    // Display the highest and lowest asks and bids
-    std::cout << "max ask " << asks[asks.size()-1].price << std::endl;
-    std::cout << "min ask " << asks[0].price << std::endl;
-    std::cout << "max bid " << bids[0].price << std::endl;
-    std::cout << "min bid " << bids[bids.size()-1].price << std::endl;
-    
-    // Match asks to bids
-    for (OrderBookEntry& ask : asks)
+    const OrderBucket* bucket = findBucket(type, product, timestamp);
+    if (bucket != nullptr)
     {
-        for (OrderBookEntry& bid : bids)
+        // Each level's queue is already in arrival order, so bids just take the levels from the dearest
+        indexed.reserve(indexed.size() + bucket->entries.size());
+        auto addLevel = [&](const PriceLevel& level)
         {
-            if (bid.price >= ask.price) // Check for a price match
+            for (uint32_t slot = level.head; slot != noSlot; slot = bucket->links[slot].next)
             {
-                OrderBookEntry sale{ask.price, 0, timestamp, product, OrderBookType::asksale};
-
-                if (bid.username == "simuser" || ask.username == "simuser")
-                {
-                    sale.username = "simuser";
-                    sale.orderType = bid.price >= ask.price ? OrderBookType::bidsale : OrderBookType::asksale;
-                }
-
-                // Determine how much of the ask and bid can be fulfilled
-                if (bid.amount == ask.amount)
-                {
-                    sale.amount = ask.amount;
-                    sales.push_back(sale);
-                    bid.amount = 0;
-                    break; // Complete match, move to the next ask
-                }
-                else if (bid.amount > ask.amount)
-                {
-                    sale.amount = ask.amount;
-                    sales.push_back(sale);
-                    bid.amount -= ask.amount;
-                    break; // Partial match, adjust bid and move to next ask
-                }
-                else if (bid.amount < ask.amount)
-                {
-                    sale.amount = bid.amount;
-                    sales.push_back(sale);
-                    ask.amount -= bid.amount;
-                    bid.amount = 0;
-                    continue; // Partial match, adjust ask and check next bid
-                }
+                const OrderBookEntry& e = bucket->entries[slot];
+                indexed.push_back({e.price, e.amount, e.userId});
             }
+        };
+        if (descending)
+        {
+            for (auto level = bucket->levels.rbegin(); level != bucket->levels.rend(); ++level) addLevel(*level);
+        }
+        else
+        {
+            for (const PriceLevel& level : bucket->levels) addLevel(level);
         }
     }
-    return sales; // Return all matched sales
+
+    std::pair<size_t, size_t> rows = findSnapshotRows(type, product, timestamp);
+    if (rows.first == rows.second)
+    {
+        if (snapshot) orders.insert(orders.end(), inserted.begin(), inserted.end());
+        return;
+    }
+
+    // The snapshot's price order is ascending with ties in file order. Bids want the
+    // prices reversed but each tie still in file order, so walk runs of equal prices backwards.
+    const Decimal* prices = snapshot->prices() + rows.first;
+    const Decimal* amounts = snapshot->amounts() + rows.first;
+    const uint32_t* byPrice = snapshot->priceOrder() + rows.first;
+    const size_t count = rows.second - rows.first;
+    std::vector<MatchOrder> mapped;
+    mapped.reserve(count);
+    if (descending)
+    {
+        size_t end = count;
+        while (end > 0)
+        {
+            size_t start = end - 1;
+            while (start > 0 && prices[byPrice[start - 1]] == prices[byPrice[end - 1]]) --start;
+            for (size_t i = start; i < end; ++i) mapped.push_back({prices[byPrice[i]], amounts[byPrice[i]], SymbolTable::datasetUser});
+            end = start;
+        }
+    }
+    else
+    {
+        for (size_t i = 0; i < count; ++i) mapped.push_back({prices[byPrice[i]], amounts[byPrice[i]], SymbolTable::datasetUser});
+    }
+
+    // Snapshot rows arrived first, so they win ties against inserted orders
+    auto better = [descending](const MatchOrder& a, const MatchOrder& b)
+    {
+        return descending ? a.price > b.price : a.price < b.price;
+    };
+    orders.reserve(orders.size() + mapped.size() + inserted.size());
+    std::merge(mapped.begin(), mapped.end(), inserted.begin(), inserted.end(), std::back_inserter(orders), better);
+}
+
+/** Match ask and bid orders for a product at a specific timestamp, appending the fills to a caller's buffer */
+size_t OrderBook::matchAsksToBids(const std::string& product, int64_t timestamp, std::vector<Fill>& fills) const
+{
+    std::vector<MatchOrder> asks;
+    std::vector<MatchOrder> bids;
+    collectSide(OrderBookType::ask, product, timestamp, asks);
+    collectSide(OrderBookType::bid, product, timestamp, bids);
+    return sweep(asks, bids, timestamp, static_cast<uint16_t>(SymbolTable::productId(product)), fills);
+}
+
+/** Match a product's orders together with orders that are not in the book, leaving the book as it is */
+size_t OrderBook::matchAsksToBids(const std::string& product,
+                                  int64_t timestamp,
+                                  std::span<const OrderBookEntry> extra,
+                                  std::vector<Fill>& fills) const
+{
+    const int productId = SymbolTable::productId(product);
+    std::vector<MatchOrder> asks;
+    std::vector<MatchOrder> bids;
+    collectSide(OrderBookType::ask, product, timestamp, asks);
+    collectSide(OrderBookType::bid, product, timestamp, bids);
+
+    std::vector<MatchOrder> extraAsks;
+    std::vector<MatchOrder> extraBids;
+    for (const OrderBookEntry& e : extra)
+    {
+        if (e.productId != productId || e.timestamp != timestamp) continue;
+        if (e.orderType == OrderBookType::ask) extraAsks.push_back({e.price, e.amount, e.userId});
+        else if (e.orderType == OrderBookType::bid) extraBids.push_back({e.price, e.amount, e.userId});
+    }
+
+    // Put the extra orders in fill order and merge them in behind the book's, which win ties as earlier arrivals
+    auto cheaper = [](const MatchOrder& a, const MatchOrder& b) { return a.price < b.price; };
+    auto dearer = [](const MatchOrder& a, const MatchOrder& b) { return a.price > b.price; };
+    auto mergeIn = [](std::vector<MatchOrder>& side, std::vector<MatchOrder>& added, auto better)
+    {
+        if (added.empty()) return;
+        std::stable_sort(added.begin(), added.end(), better);
+        std::vector<MatchOrder> merged;
+        merged.reserve(side.size() + added.size());
+        std::merge(side.begin(), side.end(), added.begin(), added.end(), std::back_inserter(merged), better);
+        side.swap(merged);
+    };
+    mergeIn(asks, extraAsks, cheaper);
+    mergeIn(bids, extraBids, dearer);
+    return sweep(asks, bids, timestamp, static_cast<uint16_t>(productId), fills);
 }
 
+/** The matching itself: best prices first on both sides until the best bid no longer reaches the best ask */
+size_t OrderBook::sweep(std::vector<MatchOrder>& asks,
+                        std::vector<MatchOrder>& bids,
+                        int64_t timestamp,
+                        uint16_t productId,
+                        std::vector<Fill>& fills)
+{
+    // One cursor per side walks the orders in fill order. Amounts are updated in these
+    // working copies, so partial fills never change the orders in the book.
+    size_t a = 0;
+    size_t b = 0;
+    size_t before = fills.size();
+    while (a < asks.size() && b < bids.size() &&
+           bids[b].price >= asks[a].price) // Stop once the best bid no longer reaches the best ask
+    {
+        MatchOrder& ask = asks[a];
+        MatchOrder& bid = bids[b];
+        if (ask.amount <= Decimal{}) { ++a; continue; } // Skip orders with nothing left to fill
+        if (bid.amount <= Decimal{}) { ++b; continue; }
+
+        Fill fill{ask.price, Decimal{}, timestamp, bid.user, ask.user, productId};
+
+        // Determine how much of the ask and bid can be fulfilled. Amounts are exact, so equal means equal
+        if (bid.amount == ask.amount)
+        {
+            fill.amount = ask.amount;
+            ++a; // Complete match, move both sides on
+            ++b;
+        }
+        else if (bid.amount > ask.amount)
+        {
+            fill.amount = ask.amount;
+            bid.amount -= ask.amount;
+            ++a; // Partial match, the rest of the bid waits for the next ask
+        }
+        else
+        {
+            fill.amount = bid.amount;
+            ask.amount -= bid.amount;
+            ++b; // Partial match, the rest of the ask goes to the next bid
+        }
+        fills.push_back(fill);
+    }
+    return fills.size() - before;
+}
@@ -1,38 +1,366 @@
 #pragma once
 #include "OrderBookEntry.h"
 #include "CSVReader.h"
+#include "CSVStreamReader.h"
+#include "MarketSnapshot.h"
+#include "OrderStats.h"
+#include "DepthLadder.h"
+#include "OrderView.h"
+#include "Fill.h"
 #include <string>
 #include <vector>
+#include <map>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <span>
 
 class OrderBook
 {
     public:
-    /** construct, reading a csv data file */
-        OrderBook(std::string filename);
+    /** construct, reading a csv data file
+     * loaderThreads > 1 parses the file in that many chunks at once,
+     * 0 means one per hardware thread
+     */
+        OrderBook(std::string filename, unsigned loaderThreads = 1);
+
+    /** options for a book that streams its data file instead of loading it */
+        struct Streaming
+        {
+            /** how many timeframes past the current one to hold in memory */
+            size_t lookahead = 1;
+        };
+    /** construct over a csv data file without loading all of it.
+     * Only the current timeframe and the next streaming.lookahead ones
+     * are held in memory; getNextTime reads the next one in and drops
+     * the ones before it. Going back in time re-reads the file from the
+     * top, and wrapping round to the start reloads it, so orders
+     * inserted by users do not survive a wrap.
+     */
+        OrderBook(std::string filename, Streaming streaming);
+    /** construct over a mapped snapshot file (see MarketSnapshot::convert).
+     * Queries read the snapshot's columns in place; inserted orders are
+     * kept alongside them in memory. Several books may share one snapshot.
+     */
+        OrderBook(std::shared_ptr<const MarketSnapshot> snapshot);
     /** return vector of all know products in the dataset*/
-        std::vector<std::string> getKnownProducts();
-    /** return vector of Orders according to the sent filters*/
-        std::vector<OrderBookEntry> getOrders(OrderBookType type, 
-                                              std::string product, 
-                                              std::string timestamp);
-
-        /** returns the earliest time in the orderbook*/
-        std::string getEarliestTime();
+        std::vector<std::string> getKnownProducts() const;
+    /** every timeframe held in memory, oldest first. For a book that is
+     * not streaming that is every timeframe in the data, so a driver can
+     * walk them without the time-cursor queries below.
+     */
+        const std::vector<int64_t>& getTimeframes() const { return timeframes; }
+    /** true if the book streams its data file rather than holding all of it */
+        bool isStreaming() const { return stream != nullptr; }
+    /** return the Orders that match the sent filters, as a view into the
+     * book rather than a copy; call toVector() on it to keep them.
+     * A cancelled order's place is taken by the newest order held, so
+     * after a cancel they are not strictly in arrival order; matching
+     * still fills them in arrival order within a price.
+     */
+        OrderView getOrders(OrderBookType type, 
+                            const std::string& product, 
+                            int64_t timestamp) const;
+        /** return the stats of the orders that getOrders would return for
+         * the same filters. O(1) for orders loaded or inserted into memory;
+         * a snapshot's stats are read from the file.
+         */
+        OrderStats getStats(OrderBookType type,
+                            const std::string& product,
+                            int64_t timestamp) const;
+
+        /** price levels of one side at the sent time in the order they
+         * would fill (asks cheapest first, bids dearest first), each with
+         * totals counted from the best level. At most maxLevels of them.
+         */
+        std::vector<DepthLevel> getDepth(OrderBookType type,
+                                         const std::string& product,
+                                         int64_t timestamp,
+                                         size_t maxLevels = SIZE_MAX) const;
+        /** cost of taking size from one side, best levels first: e.g. selling
+         * size into the bids. O(log levels).
+         */
+        SizeQuote getPriceForSize(OrderBookType type,
+                                  const std::string& product,
+                                  int64_t timestamp,
+                                  double size) const;
+        /** amount on one side at prices no worse than limitPrice, e.g. how
+         * much can be sold into the bids before the price drops to it.
+         * O(log levels).
+         */
+        double getSizeWithin(OrderBookType type,
+                             const std::string& product,
+                             int64_t timestamp,
+                             double limitPrice) const;
+        /** best ask minus best bid, 0 if either side is empty */
+        double getSpread(const std::string& product, int64_t timestamp) const;
+        /** halfway between the best bid and best ask, 0 if either side is empty */
+        double getMidPrice(const std::string& product, int64_t timestamp) const;
+
+        /** returns the earliest time in the orderbook
+         * (for a streaming book, the earliest time still held in memory)
+         */
+        int64_t getEarliestTime();
         /** returns the next time after the 
          * sent time in the orderbook  
          * If there is no next timestamp, wraps around to the start
          * */
-        std::string getNextTime(std::string timestamp);
+        int64_t getNextTime(int64_t timestamp);
+        /** returns the time before the sent time in the orderbook
+         * If there is no earlier timestamp, wraps around to the end
+         * */
+        int64_t getPreviousTime(int64_t timestamp);
+        /** returns the timeframe in force at the sent time: the latest
+         * one at or before it, or the earliest if it is before the start
+         * */
+        int64_t seekTime(int64_t timestamp);
 
-        void insertOrder(OrderBookEntry& order);
+        /** put an order straight into its price level and return its id.
+         * Ids start at 1 and are never reused. Finding the level is
+         * O(log levels) and the bucket's stats and median are then
+         * updated in O(1). The depth's running totals are redone by the
+         * next depth query, from the lowest level changed. A new price
+         * level still moves the bucket's levels above it along one.
+         */
+        uint64_t insertOrder(const OrderBookEntry& order);
+        /** insert a batch of orders, sorting each bucket they land in once.
+         * The orders get consecutive ids in order, starting from the one returned.
+         */
+        uint64_t insertOrders(std::span<const OrderBookEntry> orders);
+        /** take an inserted order off the book. O(1) to find and unlink
+         * it and to update its bucket's stats, median and depth as for
+         * insertOrder, plus moving the levels along if its level empties.
+         * False if there is no such order, e.g. it was already cancelled
+         * or a streaming book has dropped its timeframe.
+         */
+        bool cancelOrder(uint64_t id);
+        /** change the amount of an inserted order. Less keeps its place
+         * in the queue at its price; more sends it to the back. An amount
+         * of zero or less cancels it. False if there is no such order.
+         */
+        bool amendOrder(uint64_t id, Decimal newAmount);
+        /** the inserted order with this id, nullptr if there is none.
+         * Valid until the book next changes.
+         */
+        const OrderBookEntry* findOrder(uint64_t id) const;
+        /** the id the next inserted order will get */
+        uint64_t nextOrderId() const { return handles.size() + 1; }
+        /** make the next inserted order get id nextId, leaving the ids
+         * skipped unused, so orders restored from a journal keep their ids.
+         * Does nothing if nextId has already been given out.
+         */
+        void skipOrderIds(uint64_t nextId);
 
-        std::vector<OrderBookEntry> matchAsksToBids(std::string product, std::string timestamp);
+        /** match the product's asks to its bids at the sent time,
+         * best prices first and in arrival order within a price.
+         * The orders in the book are left as they were. A sale is booked
+         * to the bid's user as a bidsale if that is not "dataset", else
+         * to the ask's user as an asksale.
+         */
+        std::vector<OrderBookEntry> matchAsksToBids(std::string product, int64_t timestamp);
+        /** same matching, appending a Fill naming both sides to the sent
+         * buffer so it can be reused between calls. Returns how many fills
+         * were appended. Only reads the book, so products can be matched on
+         * several threads at once as long as nothing is inserted meanwhile.
+         */
+        size_t matchAsksToBids(const std::string& product, int64_t timestamp, std::vector<Fill>& fills) const;
+        /** same matching, as if the extra orders had been inserted after
+         * everything in the book: those of the product and time take part
+         * and lose price ties to the book's own. The book is not changed,
+         * so one book can be matched against many sets of extra orders at once.
+         */
+        size_t matchAsksToBids(const std::string& product,
+                               int64_t timestamp,
+                               std::span<const OrderBookEntry> extra,
+                               std::vector<Fill>& fills) const;
 
-        static double getHighPrice(std::vector<OrderBookEntry>& orders);
-        static double getLowPrice(std::vector<OrderBookEntry>& orders);
+        /** highest price in the orders, 0 if there are none */
+        static Decimal getHighPrice(std::vector<OrderBookEntry>& orders);
+        /** lowest price in the orders, 0 if there are none */
+        static Decimal getLowPrice(std::vector<OrderBookEntry>& orders);
 
     private:
-        std::vector<OrderBookEntry> orders;
+        /** marks the end of a level's queue */
+        static constexpr uint32_t noSlot = UINT32_MAX;
+
+        /** a slot's neighbours in its price level's queue */
+        struct QueueLink
+        {
+            uint32_t prev = noSlot;
+            uint32_t next = noSlot;
+        };
+
+        /** the orders at one price, a queue in arrival order threaded through the slots */
+        struct PriceLevel
+        {
+            Decimal price;
+            uint32_t head = noSlot;
+            uint32_t tail = noSlot;
+            uint32_t count = 0;
+        };
+
+        /** all orders of one product and side within one timeframe */
+        struct OrderBucket
+        {
+            /** one slot per order, in the order they arrived; a cancelled
+             * order's slot is taken by the last one so the slots stay dense
+             */
+            std::vector<OrderBookEntry> entries;
+            /** each slot's place in its level's queue */
+            std::vector<QueueLink> links;
+            /** each slot's order id, 0 for orders read from the data file.
+             * Only as long as the last slot with an id, so a loaded bucket
+             * pays nothing for it.
+             */
+            std::vector<uint64_t> ids;
+            /** cheapest first, at the same positions as depth */
+            std::vector<PriceLevel> levels;
+            OrderStats stats;
+            /** the price levels with their running totals, cheapest first.
+             * Each level's amount is kept up to date; the totals from
+             * staleFrom up are redone when the depth is next read.
+             */
+            mutable std::vector<DepthLevel> depth;
+            /** first level of depth whose totals are out of date, SIZE_MAX if none */
+            mutable std::atomic<size_t> staleFrom{SIZE_MAX};
+            /** the lower middle order in price order: its level, its place
+             * in that level and its rank among all the bucket's orders
+             */
+            size_t medianLevel = 0;
+            uint32_t medianOffset = 0;
+            size_t medianRank = 0;
+
+            /** file one order at the back of its level's queue, updating the
+             * stats and depth; returns its slot
+             */
+            uint32_t add(const OrderBookEntry& order);
+            /** sort in orders appended to entries since the last rebuild,
+             * redoing the levels, stats and depth in one pass
+             */
+            void rebuild();
+            /** take the order in a slot out, moving the last slot's order
+             * into it. Returns the id of the order that moved, 0 if none did.
+             */
+            uint64_t remove(uint32_t slot);
+            /** change the amount of the order in a slot, sending it to the
+             * back of its queue if the amount grew
+             */
+            void setAmount(uint32_t slot, Decimal amount);
+            /** position in levels of the price, levels.size() if it has no level */
+            size_t findLevel(Decimal price) const;
+            uint64_t idAt(uint32_t slot) const { return slot < ids.size() ? ids[slot] : 0; }
+            /** move the median cursor to the middle rank, a step or so
+             * after one add or remove, and set the median from it
+             */
+            void updateMedian();
+            /** move the median cursor one order up or down in price order */
+            void stepMedian(bool up);
+            /** note that the depth totals from level i up need redoing */
+            void markStale(size_t i);
+            /** redo the depth totals marked stale; callers hold depthMutex */
+            void settleDepth() const;
+            /** append a slot to the back of a level's queue */
+            void enqueue(PriceLevel& level, uint32_t slot);
+            /** take a slot out of its level's queue */
+            void unlink(PriceLevel& level, uint32_t slot);
+        };
+
+        /** where an inserted order is: its bucket and slot */
+        struct OrderHandle
+        {
+            OrderBucket* bucket = nullptr;
+            uint32_t slot = 0;
+        };
+
+        /** an order as the matching sweep sees it */
+        struct MatchOrder
+        {
+            Decimal price;
+            Decimal amount;
+            /** SymbolTable user id of the order's owner */
+            uint32_t user;
+        };
+
+        /** add an order to its product/side/timeframe bucket, returning the bucket and slot */
+        OrderHandle indexOrder(const OrderBookEntry& order);
+        /** add a batch of orders, sorting each bucket they touch once at the end.
+         * A firstId other than 0 gives the orders ids from it on.
+         */
+        void indexOrders(std::span<const OrderBookEntry> orders, uint64_t firstId = 0);
+        /** point the handle for an id at a slot, recording the id in the slot */
+        void setHandle(uint64_t id, OrderBucket& bucket, uint32_t slot);
+        /** forget the handles of every order with an id in the bucket, before it is dropped */
+        void dropHandles(const OrderBucket& bucket);
+        /** the bucket for an order, made if it is new */
+        OrderBucket& bucketFor(const OrderBookEntry& order);
+        /** add a timestamp to the sorted table of timeframes if it is new */
+        void noteTimeframe(int64_t timestamp);
+        /** return the bucket for these filters, or nullptr if there is none */
+        const OrderBucket* findBucket(OrderBookType type,
+                                      const std::string& product,
+                                      int64_t timestamp) const;
+        /** position of the first timeframe at or after the sent time,
+         * checking the last position used before binary searching
+         * */
+        size_t lowerTimeframe(int64_t timestamp);
+        /** the snapshot rows for these filters, empty if there is no snapshot or no such rows */
+        std::pair<size_t, size_t> findSnapshotRows(OrderBookType type,
+                                                   const std::string& product,
+                                                   int64_t timestamp) const;
+        /** the depth ladder for these filters. A bucket's own ladder or a
+         * snapshot's is returned in place; if both have levels they are
+         * merged into the sent buffer, which the result then points into.
+         */
+        std::span<const DepthLevel> findLadder(OrderBookType type,
+                                               const std::string& product,
+                                               int64_t timestamp,
+                                               std::vector<DepthLevel>& merged) const;
+        /** append one side's orders in the order they fill: asks cheapest
+         * first, bids dearest first, arrival order within a price
+         */
+        void collectSide(OrderBookType type,
+                         const std::string& product,
+                         int64_t timestamp,
+                         std::vector<MatchOrder>& orders) const;
+        /** walk two sides gathered by collectSide against each other, appending the fills */
+        static size_t sweep(std::vector<MatchOrder>& asks,
+                            std::vector<MatchOrder>& bids,
+                            int64_t timestamp,
+                            uint16_t productId,
+                            std::vector<Fill>& fills);
+
+        /** streaming only: read one more timeframe into the index, false at end of file */
+        bool pullTimeframe();
+        /** streaming only: read ahead until lookahead timeframes follow the first one held */
+        void fillWindow();
+        /** streaming only: drop every timeframe before the sent time */
+        void releaseBefore(int64_t timestamp);
+        /** streaming only: drop everything and start again from the top of the file */
+        void rewindStream();
+        /** streaming forms of getNextTime and seekTime */
+        int64_t streamNextTime(int64_t timestamp);
+        int64_t streamSeekTime(int64_t timestamp);
+
+        /** product -> side -> timestamp -> orders */
+        std::map<std::string, std::map<OrderBookType, std::map<int64_t, OrderBucket>>> index;
+        /** every distinct timestamp in the book, sorted */
+        std::vector<int64_t> timeframes;
+        /** position in timeframes of the last lookup, so stepping through time is O(1) */
+        size_t timeCursor = 0;
+
+        /** the data file reader for a streaming book, nullptr if the whole file was loaded */
+        std::unique_ptr<CSVStreamReader> stream;
+        size_t lookahead = 0;
+        /** set once the reader's summary has been printed */
+        bool streamReported = false;
+
+        /** the mapped data for a snapshot book, nullptr otherwise */
+        std::shared_ptr<const MarketSnapshot> snapshot;
 
+        /** where each inserted order is, at position id - 1; a null bucket once it is gone */
+        std::vector<OrderHandle> handles;
+        /** held while a reader redoes a bucket's depth totals, as the book may be shared by reading threads */
+        mutable std::mutex depthMutex;
 
 };
@@ -1,24 +1,39 @@
 #include "OrderBookEntry.h"
+#include <stdexcept>
+#include <cstdio>
+#include <utility>
 
-// Constructor for creating an OrderBookEntry object with initial values for each member variable.
-OrderBookEntry::OrderBookEntry(double _price, 
-                               double _amount, 
-                               std::string _timestamp, 
-                               std::string _product, 
+// Constructor for creating an OrderBookEntry object, interning the product and user names
+OrderBookEntry::OrderBookEntry(Decimal _price, 
+                               Decimal _amount, 
+                               int64_t _timestamp, 
+                               std::string_view _product, 
                                OrderBookType _orderType, 
-                               std::string _username)
+                               std::string_view _username)
+: OrderBookEntry(_price, _amount, _timestamp, SymbolTable::productId(_product), _orderType,
+                 _username == "dataset" ? SymbolTable::datasetUser : SymbolTable::userId(_username))
+{
+}
+
+// Constructor for creating an OrderBookEntry object from interned ids
+OrderBookEntry::OrderBookEntry(Decimal _price,
+                               Decimal _amount,
+                               int64_t _timestamp,
+                               int _productId,
+                               OrderBookType _orderType,
+                               int _userId)
 : price(_price),         // Initialize price with _price
   amount(_amount),       // Initialize amount with _amount
   timestamp(_timestamp), // Initialize timestamp with _timestamp
-  product(_product),     // Initialize product with _product
-  orderType(_orderType), // Initialize orderType with _orderType
-  username(_username)    // Initialize username with _username
+  userId(static_cast<uint32_t>(_userId)),
+  productId(static_cast<uint16_t>(_productId)),
+  orderType(_orderType)  // Initialize orderType with _orderType
 {
-    // Constructor body is empty as all initialization is done in the initializer list.
+    if (_productId < 0 || _productId > UINT16_MAX) throw std::length_error{"too many products for an OrderBookEntry"};
 }
 
 // Converts a string to an OrderBookType enumeration. The string represents the type of order: "ask" or "bid".
-OrderBookType OrderBookEntry::stringToOrderBookType(std::string s)
+OrderBookType OrderBookEntry::stringToOrderBookType(std::string_view s)
 {
   if (s == "ask") 
   {
@@ -30,3 +45,98 @@ OrderBookType OrderBookEntry::stringToOrderBookType(std::string s)
   }
   return OrderBookType::unknown; // Return 'unknown' type if the string does not match expected values
 }
+
+// Reads a fixed number of digits starting at pos, returning false if any of them is not a digit.
+static bool readDigits(std::string_view s, size_t pos, size_t count, int& value)
+{
+  if (pos + count > s.size()) return false;
+  value = 0;
+  for (size_t i = pos; i < pos + count; ++i)
+  {
+    if (s[i] < '0' || s[i] > '9') return false;
+    value = value * 10 + (s[i] - '0');
+  }
+  return true;
+}
+
+// Days between 1970/01/01 and the given civil date (proleptic Gregorian calendar).
+static int64_t daysFromCivil(int64_t y, unsigned m, unsigned d)
+{
+  y -= m <= 2;
+  const int64_t era = (y >= 0 ? y : y - 399) / 400;
+  const unsigned yoe = static_cast<unsigned>(y - era * 400);
+  const unsigned doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+  const unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  return era * 146097 + static_cast<int64_t>(doe) - 719468;
+}
+
+// Parses "YYYY/MM/DD HH:MM:SS.ffffff" into microseconds since the epoch. The fraction may have 0-6 digits.
+bool OrderBookEntry::parseTimestamp(std::string_view s, int64_t& timestamp)
+{
+  if (s.size() < 19 || s[4] != '/' || s[7] != '/' || s[10] != ' ' || s[13] != ':' || s[16] != ':')
+  {
+    return false;
+  }
+  int year, month, day, hour, minute, second;
+  if (!readDigits(s, 0, 4, year) || !readDigits(s, 5, 2, month) || !readDigits(s, 8, 2, day) ||
+      !readDigits(s, 11, 2, hour) || !readDigits(s, 14, 2, minute) || !readDigits(s, 17, 2, second))
+  {
+    return false;
+  }
+  if (month < 1 || month > 12 || day < 1 || day > 31 || hour > 23 || minute > 59 || second > 60)
+  {
+    return false;
+  }
+
+  int micros = 0;
+  if (s.size() > 19)
+  {
+    size_t digits = s.size() - 20;
+    if (s[19] != '.' || digits > 6 || !readDigits(s, 20, digits, micros)) return false;
+    for (size_t i = digits; i < 6; ++i) micros *= 10; // Scale a short fraction up to microseconds
+  }
+
+  int64_t seconds = daysFromCivil(year, month, day) * 86400 + hour * 3600 + minute * 60 + second;
+  timestamp = seconds * 1000000 + micros;
+  return true;
+}
+
+// Throwing form of parseTimestamp, for single values such as user input.
+int64_t OrderBookEntry::stringToTimestamp(std::string_view s)
+{
+  int64_t timestamp;
+  if (!parseTimestamp(s, timestamp))
+  {
+    throw std::invalid_argument{"bad timestamp: " + std::string{s}};
+  }
+  return timestamp;
+}
+
+// Formats microseconds since the epoch as "YYYY/MM/DD HH:MM:SS.ffffff".
+std::string OrderBookEntry::timestampToString(int64_t timestamp)
+{
+  int64_t micros = timestamp % 1000000;
+  int64_t seconds = timestamp / 1000000;
+  if (micros < 0) { micros += 1000000; seconds -= 1; }
+  int64_t days = seconds / 86400;
+  int64_t secondOfDay = seconds % 86400;
+  if (secondOfDay < 0) { secondOfDay += 86400; days -= 1; }
+
+  // Inverse of daysFromCivil
+  days += 719468;
+  const int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+  const unsigned doe = static_cast<unsigned>(days - era * 146097);
+  const unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+  const unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+  const unsigned mp = (5 * doy + 2) / 153;
+  const unsigned day = doy - (153 * mp + 2) / 5 + 1;
+  const unsigned month = mp < 10 ? mp + 3 : mp - 9;
+  const int64_t year = static_cast<int64_t>(yoe) + era * 400 + (month <= 2);
+
+  char buffer[64];
+  std::snprintf(buffer, sizeof(buffer), "%04lld/%02u/%02u %02d:%02d:%02d.%06lld",
+                static_cast<long long>(year), month, day,
+                static_cast<int>(secondOfDay / 3600), static_cast<int>(secondOfDay / 60 % 60),
+                static_cast<int>(secondOfDay % 60), static_cast<long long>(micros));
+  return buffer;
+}
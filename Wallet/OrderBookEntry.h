@@ -1,22 +1,52 @@
 #pragma once
 
 #include <string>
+#include <string_view>
+#include <cstdint>
+#include "SymbolTable.h"
+#include "Decimal.h"
 
-enum class OrderBookType{bid, ask, unknown, asksale, bidsale};
+enum class OrderBookType : uint8_t {bid, ask, unknown, asksale, bidsale};
 
+/** An order or a sale in 32 bytes with nothing on the heap: the price
+ * and amount are Decimals, the product and the user SymbolTable ids,
+ * so entries copy like plain data.
+ */
 class OrderBookEntry
 {
     public:
     
 
-        OrderBookEntry( double _price, 
-                        double _amount, 
-                        std::string _timestamp, 
-                        std::string _product, 
+        OrderBookEntry( Decimal _price, 
+                        Decimal _amount, 
+                        int64_t _timestamp, 
+                        std::string_view _product, 
                         OrderBookType _orderType, 
-                        std::string username = "dataset");
+                        std::string_view username = "dataset");
+        /** same, with the product and user already interned */
+        OrderBookEntry( Decimal _price,
+                        Decimal _amount,
+                        int64_t _timestamp,
+                        int _productId,
+                        OrderBookType _orderType,
+                        int _userId = SymbolTable::datasetUser);
 
-        static OrderBookType stringToOrderBookType(std::string s);
+        const std::string& product() const { return SymbolTable::productName(productId); }
+        const std::string& username() const { return SymbolTable::userName(static_cast<int>(userId)); }
+
+        static OrderBookType stringToOrderBookType(std::string_view s);
+        /** parse a "2020/03/17 17:01:24.884492" timestamp into
+         * microseconds since the epoch (UTC). Throws on bad input.
+         */
+        static int64_t stringToTimestamp(std::string_view s);
+        /** non-throwing form of stringToTimestamp for the bulk loaders,
+         * returns false if s is not a valid timestamp
+         */
+        static bool parseTimestamp(std::string_view s, int64_t& timestamp);
+        /** format microseconds since the epoch back into the
+         * "2020/03/17 17:01:24.884492" form used by the data files
+         */
+        static std::string timestampToString(int64_t timestamp);
 
         static bool compareByTimestamp(OrderBookEntry& e1, OrderBookEntry& e2)
         {
@@ -31,10 +61,15 @@ class OrderBookEntry
             return e1.price > e2.price;
         }
 
-        double price;
-        double amount;
-        std::string timestamp;
-        std::string product;
+        Decimal price;
+        Decimal amount;
+        /** microseconds since the epoch */
+        int64_t timestamp;
+        /** SymbolTable user id */
+        uint32_t userId;
+        /** SymbolTable product id */
+        uint16_t productId;
         OrderBookType orderType;
-        std::string username;
 };
+
+static_assert(sizeof(OrderBookEntry) == 32, "OrderBookEntry should stay within 32 bytes");
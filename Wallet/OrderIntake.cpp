@@ -0,0 +1,93 @@
+#include "OrderIntake.h"
+#include <algorithm>
+#include <bit>
+#include <stdexcept>
+#include <thread>
+
+OrderIntake::OrderIntake(size_t capacity)
+: slots(std::make_unique<Slot[]>(std::bit_ceil(std::max<size_t>(capacity, 1)))),
+  mask(std::bit_ceil(std::max<size_t>(capacity, 1)) - 1)
+{
+}
+
+// A full ring only empties when the consumer drains, so spin briefly and then give it the CPU
+void OrderIntake::waitForRoom(uint64_t end)
+{
+    uint64_t room = consumedCache.load(std::memory_order_acquire) + mask + 1;
+    unsigned spins = 0;
+    while (end > room)
+    {
+        uint64_t freed = consumed.load(std::memory_order_acquire);
+        consumedCache.store(freed, std::memory_order_release);
+        room = freed + mask + 1;
+        if (end <= room) break;
+        if (++spins > 64) std::this_thread::yield();
+    }
+}
+
+uint64_t OrderIntake::push(const OrderBookEntry& order)
+{
+    uint64_t sequence = claimed.fetch_add(1, std::memory_order_relaxed);
+    waitForRoom(sequence + 1);
+    Slot& slot = slots[sequence & mask];
+    slot.order = order;
+    slot.published.store(sequence + 1, std::memory_order_release);
+    return sequence;
+}
+
+uint64_t OrderIntake::push(std::span<const OrderBookEntry> orders)
+{
+    if (orders.size() > capacity()) throw std::invalid_argument{"OrderIntake::push batch larger than the ring"};
+    uint64_t first = claimed.fetch_add(orders.size(), std::memory_order_relaxed);
+    waitForRoom(first + orders.size());
+    for (size_t i = 0; i < orders.size(); ++i)
+    {
+        Slot& slot = slots[(first + i) & mask];
+        slot.order = orders[i];
+        slot.published.store(first + i + 1, std::memory_order_release);
+    }
+    return first;
+}
+
+// Claims only if the slot is free now, so a producer that can not wait never has to
+bool OrderIntake::tryPush(const OrderBookEntry& order)
+{
+    uint64_t sequence = claimed.load(std::memory_order_relaxed);
+    do
+    {
+        if (sequence + 1 > consumedCache.load(std::memory_order_acquire) + mask + 1)
+        {
+            uint64_t freed = consumed.load(std::memory_order_acquire);
+            consumedCache.store(freed, std::memory_order_release);
+            if (sequence + 1 > freed + mask + 1) return false;
+        }
+    } while (!claimed.compare_exchange_weak(sequence, sequence + 1, std::memory_order_relaxed));
+
+    Slot& slot = slots[sequence & mask];
+    slot.order = order;
+    slot.published.store(sequence + 1, std::memory_order_release);
+    return true;
+}
+
+// Takes the run of published slots from the front; one store then frees them all to the producers
+size_t OrderIntake::drain(std::vector<OrderBookEntry>& batch, size_t max)
+{
+    size_t taken = 0;
+    while (taken < max)
+    {
+        const Slot& slot = slots[next & mask];
+        if (slot.published.load(std::memory_order_acquire) != next + 1) break;  // Not written yet, so later ones wait too
+        batch.push_back(slot.order);
+        ++next;
+        ++taken;
+    }
+    if (taken > 0) consumed.store(next, std::memory_order_release);
+    return taken;
+}
+
+size_t OrderIntake::pending() const
+{
+    uint64_t claims = claimed.load(std::memory_order_relaxed);
+    uint64_t drained = consumed.load(std::memory_order_relaxed);
+    return claims > drained ? static_cast<size_t>(claims - drained) : 0;
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include "OrderBookEntry.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <vector>
+
+/** A lock-free queue of orders from any number of threads to the one
+ * thread that owns the book, after the Disruptor's multi-producer
+ * sequencer. It is meant for order sources on threads of their own,
+ * e.g. agent threads: they push, and the matching thread drains once a
+ * timeframe and applies the batch itself, as --replay applies a script's
+ * orders,
+ *
+ *   intake.drain(batch);
+ *   agents.reserve(batch, accepted, orderBook.nextOrderId());    // then drop the refused ones
+ *   orderBook.insertOrders(batch);
+ *
+ * so the book and the wallets stay single-threaded. Nothing in the app
+ * pushes to one yet: --serve runs its gateway on the matching thread and
+ * places each order as it arrives, as it replies with the order's id.
+ * bench/benchmark times it and bench/intakecheck checks its ordering.
+ *
+ * The ring is allocated once. A producer claims a sequence number with
+ * one atomic add, copies its order into that slot and marks the slot
+ * published; a slot has a cache line to itself, so producers writing
+ * neighbouring slots do not share lines. drain hands orders out in
+ * sequence order and stops at the first slot still being written, so
+ * the batch is exactly the order the claims were made in. A producer
+ * only waits when the ring is full, until the consumer next drains.
+ */
+class OrderIntake
+{
+    public:
+        /** capacity is rounded up to a power of two */
+        OrderIntake(size_t capacity = 1 << 16);
+
+        OrderIntake(const OrderIntake&) = delete;
+        OrderIntake& operator=(const OrderIntake&) = delete;
+
+        /** queue an order, waiting while the ring is full. Safe from any
+         * number of threads at once. Returns its sequence number; they
+         * start at 0 and are the order drain gives the orders out in.
+         */
+        uint64_t push(const OrderBookEntry& order);
+        /** queue a batch as one claim, so its orders stay together and
+         * in order. Throws std::invalid_argument if it is larger than
+         * the ring. Returns the first one's sequence number.
+         */
+        uint64_t push(std::span<const OrderBookEntry> orders);
+        /** queue an order if there is room now; false if the ring is full */
+        bool tryPush(const OrderBookEntry& order);
+
+        /** append the orders published so far to batch, oldest first, at
+         * most max of them, and free their slots. Only one thread may
+         * drain. Returns how many were appended.
+         */
+        size_t drain(std::vector<OrderBookEntry>& batch, size_t max = SIZE_MAX);
+
+        /** orders claimed and not yet drained; a snapshot, as producers may be adding */
+        size_t pending() const;
+        size_t capacity() const { return static_cast<size_t>(mask + 1); }
+
+    private:
+        /** one order and the sequence it was published under, plus one */
+        struct alignas(64) Slot
+        {
+            std::atomic<uint64_t> published{0};
+            OrderBookEntry order{Decimal{}, Decimal{}, 0, 0, OrderBookType::unknown};
+        };
+
+        /** wait until the sequences up to end may be written, i.e. the consumer has freed their slots */
+        void waitForRoom(uint64_t end);
+
+        std::unique_ptr<Slot[]> slots;
+        uint64_t mask;
+        /** the next sequence to claim; bumped by every producer */
+        alignas(64) std::atomic<uint64_t> claimed{0};
+        /** every sequence before this has been drained; written by the consumer only */
+        alignas(64) std::atomic<uint64_t> consumed{0};
+        /** a recent value of consumed, so producers rarely touch the consumer's line */
+        alignas(64) std::atomic<uint64_t> consumedCache{0};
+        /** the consumer's own copy of consumed */
+        alignas(64) uint64_t next = 0;
+};
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+
+/** Count, price range, volume, VWAP and median of the orders on one
+ * side of one product in one timeframe. Kept up to date as orders are
+ * added, so reading it costs nothing. All zero when there are no orders.
+ * Plain data, so snapshots can store it as it is.
+ */
+struct OrderStats
+{
+    uint64_t count = 0;
+    double low = 0;
+    double high = 0;
+    /** total amount */
+    double volume = 0;
+    /** total price * amount */
+    double notional = 0;
+    /** the middle price, or the mean of the two middle prices for an even count */
+    double median = 0;
+
+    /** volume-weighted average price, 0 if there is no volume */
+    double vwap() const { return volume > 0 ? notional / volume : 0; }
+
+    /** add another set of orders' stats to these. Everything but the
+     * median is exact; the median becomes the count-weighted mean of
+     * the two medians, which is only an estimate.
+     */
+    void combine(const OrderStats& other)
+    {
+        if (other.count == 0) return;
+        if (count == 0)
+        {
+            *this = other;
+            return;
+        }
+        median = (median * count + other.median * other.count) / (count + other.count);
+        low = std::min(low, other.low);
+        high = std::max(high, other.high);
+        count += other.count;
+        volume += other.volume;
+        notional += other.notional;
+    }
+};
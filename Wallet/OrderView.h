@@ -0,0 +1,79 @@
+#pragma once
+
+#include "OrderBookEntry.h"
+#include <cstddef>
+#include <iterator>
+#include <span>
+#include <vector>
+
+/** The orders on one side of a product at one time, read in place
+ * instead of copied: a snapshot's rows first, then the orders held in
+ * memory, each in the order they arrived. Snapshot rows are turned
+ * into entries as they are read, so elements come out by value.
+ * Valid until the book next changes.
+ */
+class OrderView
+{
+    public:
+        class iterator
+        {
+            public:
+                using iterator_category = std::input_iterator_tag;
+                using value_type = OrderBookEntry;
+                using difference_type = std::ptrdiff_t;
+                using pointer = void;
+                using reference = OrderBookEntry;
+
+                iterator() = default;
+                iterator(const OrderView* view, size_t i) : view(view), i(i) {}
+                OrderBookEntry operator*() const { return (*view)[i]; }
+                iterator& operator++() { ++i; return *this; }
+                iterator operator++(int) { iterator before = *this; ++i; return before; }
+                bool operator==(const iterator& other) const { return i == other.i; }
+
+            private:
+                const OrderView* view = nullptr;
+                size_t i = 0;
+        };
+
+        OrderView() = default;
+        /** a view of orders held in memory only */
+        OrderView(std::span<const OrderBookEntry> held) : held(held) {}
+        /** a view of a snapshot bucket's columns followed by orders held in memory */
+        OrderView(const Decimal* prices, const Decimal* amounts, size_t mappedCount,
+                  int64_t timestamp, int productId, OrderBookType type,
+                  std::span<const OrderBookEntry> held)
+        : prices(prices), amounts(amounts), mappedCount(mappedCount),
+          timestamp(timestamp), productId(productId), type(type), held(held) {}
+
+        size_t size() const { return mappedCount + held.size(); }
+        bool empty() const { return size() == 0; }
+        OrderBookEntry operator[](size_t i) const
+        {
+            if (i < mappedCount) return OrderBookEntry{prices[i], amounts[i], timestamp, productId, type};
+            return held[i - mappedCount];
+        }
+        iterator begin() const { return iterator{this, 0}; }
+        iterator end() const { return iterator{this, size()}; }
+
+        /** the orders held in memory, which can be read without building entries */
+        std::span<const OrderBookEntry> heldOrders() const { return held; }
+        /** copy the orders out */
+        std::vector<OrderBookEntry> toVector() const
+        {
+            std::vector<OrderBookEntry> orders;
+            orders.reserve(size());
+            for (size_t i = 0; i < mappedCount; ++i) orders.push_back((*this)[i]);
+            orders.insert(orders.end(), held.begin(), held.end());
+            return orders;
+        }
+
+    private:
+        const Decimal* prices = nullptr;
+        const Decimal* amounts = nullptr;
+        size_t mappedCount = 0;
+        int64_t timestamp = 0;
+        int productId = 0;
+        OrderBookType type = OrderBookType::unknown;
+        std::span<const OrderBookEntry> held;
+};
@@ -0,0 +1,209 @@
+#include "PriceKernels.h"
+#include <algorithm>
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define PRICE_KERNELS_X86 1
+#endif
+
+namespace
+{
+    // Reads the units of the value at position i of a strided array
+    inline int64_t at(const Decimal* values, size_t i, size_t stride)
+    {
+        return reinterpret_cast<const Decimal*>(reinterpret_cast<const char*>(values) + i * stride)->units();
+    }
+
+    // Plain versions, unrolled so the compiler can keep four values in flight
+    template <typename Pick>
+    int64_t reduceScalar(const Decimal* values, size_t count, size_t stride, Pick pick)
+    {
+        int64_t r0 = at(values, 0, stride), r1 = r0, r2 = r0, r3 = r0;
+        size_t i = 0;
+        for (; i + 4 <= count; i += 4)
+        {
+            r0 = pick(r0, at(values, i, stride));
+            r1 = pick(r1, at(values, i + 1, stride));
+            r2 = pick(r2, at(values, i + 2, stride));
+            r3 = pick(r3, at(values, i + 3, stride));
+        }
+        for (; i < count; ++i) r0 = pick(r0, at(values, i, stride));
+        return pick(pick(r0, r1), pick(r2, r3));
+    }
+
+    // Unsigned, so a sum too big for an int64 wraps instead of being undefined
+    uint64_t sumScalar(const Decimal* values, size_t count)
+    {
+        uint64_t s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+        size_t i = 0;
+        for (; i + 4 <= count; i += 4)
+        {
+            s0 += static_cast<uint64_t>(values[i].units());
+            s1 += static_cast<uint64_t>(values[i + 1].units());
+            s2 += static_cast<uint64_t>(values[i + 2].units());
+            s3 += static_cast<uint64_t>(values[i + 3].units());
+        }
+        for (; i < count; ++i) s0 += static_cast<uint64_t>(values[i].units());
+        return (s0 + s1) + (s2 + s3);
+    }
+
+    // There is no 64-bit multiply across AVX2 lanes, so this one is scalar on every CPU
+    double dotScalar(const Decimal* prices, const Decimal* amounts, size_t count)
+    {
+        __int128 s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+        size_t i = 0;
+        for (; i + 4 <= count; i += 4)
+        {
+            s0 += static_cast<__int128>(prices[i].units()) * amounts[i].units();
+            s1 += static_cast<__int128>(prices[i + 1].units()) * amounts[i + 1].units();
+            s2 += static_cast<__int128>(prices[i + 2].units()) * amounts[i + 2].units();
+            s3 += static_cast<__int128>(prices[i + 3].units()) * amounts[i + 3].units();
+        }
+        for (; i < count; ++i) s0 += static_cast<__int128>(prices[i].units()) * amounts[i].units();
+        const double unitsSquared = static_cast<double>(Decimal::scale) * static_cast<double>(Decimal::scale);
+        return static_cast<double>((s0 + s1) + (s2 + s3)) / unitsSquared;
+    }
+
+#ifdef PRICE_KERNELS_X86
+    // AVX2 versions: four accumulators of four lanes, so sixteen values per step
+
+    __attribute__((target("avx2")))
+    inline int64_t lanes(__m256i v, bool wantMax)
+    {
+        alignas(32) int64_t lane[4];
+        _mm256_store_si256(reinterpret_cast<__m256i*>(lane), v);
+        return wantMax ? std::max(std::max(lane[0], lane[1]), std::max(lane[2], lane[3]))
+                       : std::min(std::min(lane[0], lane[1]), std::min(lane[2], lane[3]));
+    }
+
+    // Loads four values, with a gather when they are not next to each other
+    __attribute__((target("avx2")))
+    inline __m256i load4(const Decimal* values, size_t i, size_t stride, __m256i offsets)
+    {
+        if (stride == sizeof(Decimal)) return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(values + i));
+        const char* base = reinterpret_cast<const char*>(values) + i * stride;
+        return _mm256_i64gather_epi64(reinterpret_cast<const long long*>(base), offsets, 1);
+    }
+
+    // Lane-wise max and min of signed 64-bit integers: a compare, then a blend on its mask
+    __attribute__((target("avx2")))
+    inline __m256i max4(__m256i a, __m256i b)
+    {
+        return _mm256_blendv_epi8(a, b, _mm256_cmpgt_epi64(b, a));
+    }
+
+    __attribute__((target("avx2")))
+    inline __m256i min4(__m256i a, __m256i b)
+    {
+        return _mm256_blendv_epi8(a, b, _mm256_cmpgt_epi64(a, b));
+    }
+
+    __attribute__((target("avx2")))
+    int64_t reduceAvx2(const Decimal* values, size_t count, size_t stride, bool wantMax)
+    {
+        const int64_t step = static_cast<int64_t>(stride);
+        const __m256i offsets = _mm256_set_epi64x(3 * step, 2 * step, step, 0);
+        __m256i r0 = _mm256_set1_epi64x(values[0].units()), r1 = r0, r2 = r0, r3 = r0;
+        size_t i = 0;
+        if (wantMax)
+        {
+            for (; i + 16 <= count; i += 16)
+            {
+                r0 = max4(r0, load4(values, i, stride, offsets));
+                r1 = max4(r1, load4(values, i + 4, stride, offsets));
+                r2 = max4(r2, load4(values, i + 8, stride, offsets));
+                r3 = max4(r3, load4(values, i + 12, stride, offsets));
+            }
+            for (; i + 4 <= count; i += 4) r0 = max4(r0, load4(values, i, stride, offsets));
+            r0 = max4(max4(r0, r1), max4(r2, r3));
+        }
+        else
+        {
+            for (; i + 16 <= count; i += 16)
+            {
+                r0 = min4(r0, load4(values, i, stride, offsets));
+                r1 = min4(r1, load4(values, i + 4, stride, offsets));
+                r2 = min4(r2, load4(values, i + 8, stride, offsets));
+                r3 = min4(r3, load4(values, i + 12, stride, offsets));
+            }
+            for (; i + 4 <= count; i += 4) r0 = min4(r0, load4(values, i, stride, offsets));
+            r0 = min4(min4(r0, r1), min4(r2, r3));
+        }
+        int64_t r = lanes(r0, wantMax);
+        for (; i < count; ++i) r = wantMax ? std::max(r, at(values, i, stride)) : std::min(r, at(values, i, stride));
+        return r;
+    }
+
+    __attribute__((target("avx2")))
+    uint64_t sumAvx2(const Decimal* values, size_t count)
+    {
+        const __m256i* v = reinterpret_cast<const __m256i*>(values);
+        __m256i s0 = _mm256_setzero_si256(), s1 = s0, s2 = s0, s3 = s0;
+        size_t i = 0;
+        for (; i + 16 <= count; i += 16, v += 4)
+        {
+            s0 = _mm256_add_epi64(s0, _mm256_loadu_si256(v));
+            s1 = _mm256_add_epi64(s1, _mm256_loadu_si256(v + 1));
+            s2 = _mm256_add_epi64(s2, _mm256_loadu_si256(v + 2));
+            s3 = _mm256_add_epi64(s3, _mm256_loadu_si256(v + 3));
+        }
+        for (; i + 4 <= count; i += 4, ++v) s0 = _mm256_add_epi64(s0, _mm256_loadu_si256(v));
+        alignas(32) uint64_t lane[4];
+        _mm256_store_si256(reinterpret_cast<__m256i*>(lane),
+                           _mm256_add_epi64(_mm256_add_epi64(s0, s1), _mm256_add_epi64(s2, s3)));
+        uint64_t s = (lane[0] + lane[1]) + (lane[2] + lane[3]);
+        for (; i < count; ++i) s += static_cast<uint64_t>(values[i].units());
+        return s;
+    }
+
+    bool hasAvx2()
+    {
+        static const bool supported = __builtin_cpu_supports("avx2");
+        return supported;
+    }
+#else
+    bool hasAvx2()
+    {
+        return false;
+    }
+#endif
+}
+
+bool PriceKernels::vectorised()
+{
+    return hasAvx2();
+}
+
+// Largest value, in vector lanes when the CPU allows
+Decimal PriceKernels::max(const Decimal* values, size_t count, size_t stride)
+{
+    if (count == 0) return Decimal{};
+#ifdef PRICE_KERNELS_X86
+    if (hasAvx2()) return Decimal::fromUnits(reduceAvx2(values, count, stride, true));
+#endif
+    return Decimal::fromUnits(reduceScalar(values, count, stride, [](int64_t a, int64_t b) { return b > a ? b : a; }));
+}
+
+// Smallest value, in vector lanes when the CPU allows
+Decimal PriceKernels::min(const Decimal* values, size_t count, size_t stride)
+{
+    if (count == 0) return Decimal{};
+#ifdef PRICE_KERNELS_X86
+    if (hasAvx2()) return Decimal::fromUnits(reduceAvx2(values, count, stride, false));
+#endif
+    return Decimal::fromUnits(reduceScalar(values, count, stride, [](int64_t a, int64_t b) { return b < a ? b : a; }));
+}
+
+Decimal PriceKernels::sum(const Decimal* values, size_t count)
+{
+#ifdef PRICE_KERNELS_X86
+    if (hasAvx2()) return Decimal::fromUnits(static_cast<int64_t>(sumAvx2(values, count)));
+#endif
+    return Decimal::fromUnits(static_cast<int64_t>(sumScalar(values, count)));
+}
+
+double PriceKernels::dot(const Decimal* prices, const Decimal* amounts, size_t count)
+{
+    return dotScalar(prices, amounts, count);
+}
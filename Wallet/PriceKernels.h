@@ -0,0 +1,33 @@
+#pragma once
+
+#include "Decimal.h"
+#include <cstddef>
+
+/** Min, max and sum reductions over arrays of Decimals, the inner loops
+ * of the stats and candle code. Decimals are whole numbers of units,
+ * so these are integer compares and adds and give exact answers. On
+ * x86-64 CPUs with AVX2 they run four lanes at a time with several
+ * accumulators; elsewhere they fall back to plain unrolled loops. The
+ * CPU is checked at run time, so the program needs no special
+ * compiler flags.
+ *
+ * stride is the distance between values in bytes, so a field can be
+ * read straight out of an array of structs; the default reads a
+ * contiguous array.
+ */
+class PriceKernels
+{
+    public:
+        /** largest of count values; 0 if count is 0 */
+        static Decimal max(const Decimal* values, size_t count, size_t stride = sizeof(Decimal));
+        /** smallest of count values; 0 if count is 0 */
+        static Decimal min(const Decimal* values, size_t count, size_t stride = sizeof(Decimal));
+        /** exact sum of a contiguous array */
+        static Decimal sum(const Decimal* values, size_t count);
+        /** sum of prices[i] * amounts[i] over two contiguous arrays,
+         * added up exactly in 128 bits and rounded to a double once
+         */
+        static double dot(const Decimal* prices, const Decimal* amounts, size_t count);
+        /** true if the AVX2 versions are in use */
+        static bool vectorised();
+};
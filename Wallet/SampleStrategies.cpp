@@ -0,0 +1,140 @@
+#include "SampleStrategies.h"
+#include "CSVReader.h"
+#include "SymbolTable.h"
+#include <cmath>
+#include <sstream>
+#include <stdexcept>
+
+SpreadMaker::SpreadMaker(const Params& params)
+: params(params)
+{
+}
+
+std::string SpreadMaker::name() const
+{
+    std::ostringstream out;
+    out << "maker:product=" << params.product << ",spread=" << params.spread << ",size=" << params.size;
+    return out.str();
+}
+
+void SpreadMaker::onTimeframe(const StrategyContext& context, std::vector<OrderBookEntry>& orders)
+{
+    double mid = context.book.getMidPrice(params.product, context.timestamp);
+    if (mid <= 0) return; // One side is empty, so there is nothing to quote around
+    const int product = SymbolTable::productId(params.product);
+    const Decimal amount = Decimal::fromDouble(params.size);
+    orders.emplace_back(Decimal::fromDouble(mid * (1 - params.spread)), amount, context.timestamp, product, OrderBookType::bid);
+    orders.emplace_back(Decimal::fromDouble(mid * (1 + params.spread)), amount, context.timestamp, product, OrderBookType::ask);
+}
+
+Momentum::Momentum(const Params& params)
+: params(params)
+{
+}
+
+std::string Momentum::name() const
+{
+    std::ostringstream out;
+    out << "momentum:product=" << params.product << ",lookback=" << params.lookback << ",size=" << params.size;
+    return out.str();
+}
+
+void Momentum::onTimeframe(const StrategyContext& context, std::vector<OrderBookEntry>& orders)
+{
+    double mid = context.book.getMidPrice(params.product, context.timestamp);
+    if (mid <= 0) return;
+    mids.push_back(mid);
+    if (mids.size() > params.lookback + 1) mids.pop_front();
+    if (mids.size() <= params.lookback) return; // Not enough history yet
+
+    // Cross the spread so the order fills against the best price on the other side
+    double halfSpread = context.book.getSpread(params.product, context.timestamp) / 2;
+    const int product = SymbolTable::productId(params.product);
+    const Decimal amount = Decimal::fromDouble(params.size);
+    if (mids.back() > mids.front())
+    {
+        orders.emplace_back(Decimal::fromDouble(mid + halfSpread), amount, context.timestamp, product, OrderBookType::bid);
+    }
+    else if (mids.back() < mids.front())
+    {
+        orders.emplace_back(Decimal::fromDouble(mid - halfSpread), amount, context.timestamp, product, OrderBookType::ask);
+    }
+}
+
+namespace
+{
+    // Splits "name:key=value,key=value" and hands each pair to set, which returns false for a key it does not
+    // know and throws for a value it can not use
+    template <typename Set>
+    void parseParams(std::string_view spec, std::string_view params, Set set)
+    {
+        if (params.empty()) return;
+        for (const std::string& pair : CSVReader::tokenise(std::string{params}, ','))
+        {
+            size_t equals = pair.find('=');
+            bool known = false;
+            try {
+                known = equals != std::string::npos && set(pair.substr(0, equals), pair.substr(equals + 1));
+            } catch (const std::logic_error& e) { // invalid_argument or out_of_range from the number parsers
+            }
+            if (!known) throw std::invalid_argument{"bad strategy parameter '" + pair + "' in " + std::string{spec}};
+        }
+    }
+
+    // The whole of value as a number above zero and below limit
+    double positiveNumber(const std::string& value, double limit = HUGE_VAL)
+    {
+        size_t used = 0;
+        double number = std::stod(value, &used);
+        if (used != value.size() || !(number > 0) || !(number < limit)) throw std::invalid_argument{value};
+        return number;
+    }
+
+    // The whole of value as a count of at least one
+    size_t positiveCount(const std::string& value)
+    {
+        size_t used = 0;
+        long long count = std::stoll(value, &used);
+        if (used != value.size() || count < 1) throw std::invalid_argument{value};
+        return static_cast<size_t>(count);
+    }
+}
+
+std::unique_ptr<Strategy> StrategyFactory::create(std::string_view spec)
+{
+    size_t colon = spec.find(':');
+    std::string_view kind = spec.substr(0, colon);
+    std::string_view params = colon == std::string_view::npos ? std::string_view{} : spec.substr(colon + 1);
+    if (kind == "maker")
+    {
+        SpreadMaker::Params p;
+        parseParams(spec, params, [&p](const std::string& key, const std::string& value)
+        {
+            if (key == "product") p.product = value;
+            else if (key == "spread") p.spread = positiveNumber(value, 1); // A spread of 1 or more would bid at zero or below
+            else if (key == "size") p.size = positiveNumber(value);
+            else return false;
+            return true;
+        });
+        return std::make_unique<SpreadMaker>(p);
+    }
+    if (kind == "momentum")
+    {
+        Momentum::Params p;
+        parseParams(spec, params, [&p](const std::string& key, const std::string& value)
+        {
+            if (key == "product") p.product = value;
+            else if (key == "lookback") p.lookback = positiveCount(value);
+            else if (key == "size") p.size = positiveNumber(value);
+            else return false;
+            return true;
+        });
+        return std::make_unique<Momentum>(p);
+    }
+    throw std::invalid_argument{"unknown strategy '" + std::string{kind} + "', expected one of " + names()};
+}
+
+std::string StrategyFactory::names()
+{
+    return "maker, momentum";
+}
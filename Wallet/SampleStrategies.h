@@ -0,0 +1,68 @@
+#pragma once
+
+#include "Strategy.h"
+#include <deque>
+#include <memory>
+#include <string>
+#include <string_view>
+
+/** Quotes a bid below and an ask above the mid price of one product
+ * every timeframe, hoping to be filled on both sides.
+ */
+class SpreadMaker : public Strategy
+{
+    public:
+        struct Params
+        {
+            std::string product = "ETH/BTC";
+            /** distance of each quote from the mid, as a fraction of it */
+            double spread = 0.01;
+            /** amount of each quote */
+            double size = 0.1;
+        };
+
+        SpreadMaker(const Params& params);
+        std::string name() const override;
+        void onTimeframe(const StrategyContext& context, std::vector<OrderBookEntry>& orders) override;
+
+    private:
+        Params params;
+};
+
+/** Buys at the best ask after the mid price of one product has risen
+ * over the last few timeframes and sells at the best bid after it has
+ * fallen.
+ */
+class Momentum : public Strategy
+{
+    public:
+        struct Params
+        {
+            std::string product = "ETH/BTC";
+            /** timeframes to compare the mid price across */
+            size_t lookback = 3;
+            double size = 0.1;
+        };
+
+        Momentum(const Params& params);
+        std::string name() const override;
+        void onTimeframe(const StrategyContext& context, std::vector<OrderBookEntry>& orders) override;
+
+    private:
+        Params params;
+        /** the last lookback + 1 mid prices, oldest first */
+        std::deque<double> mids;
+};
+
+class StrategyFactory
+{
+    public:
+        /** make a strategy from a spec like "maker" or
+         * "momentum:lookback=5,size=0.2,product=DOGE/BTC": a strategy name,
+         * then any parameters to change from their defaults.
+         * Throws std::invalid_argument for an unknown name or parameter.
+         */
+        static std::unique_ptr<Strategy> create(std::string_view spec);
+        /** the strategy names create knows, for usage messages */
+        static std::string names();
+};
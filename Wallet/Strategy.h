@@ -0,0 +1,47 @@
+#pragma once
+
+#include "OrderBook.h"
+#include "Wallet.h"
+#include "Fill.h"
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+/** what a strategy can see when it is asked for orders */
+struct StrategyContext
+{
+    /** the market data, shared by every strategy in the run, read only */
+    const OrderBook& book;
+    /** the timeframe being traded, microseconds since the epoch */
+    int64_t timestamp;
+    /** every product in the book, in name order */
+    const std::vector<std::string>& products;
+    /** the strategy's own funds, with nothing held: the last timeframe's orders have been released */
+    const Wallet& wallet;
+};
+
+/** A trading strategy for Backtester. It is asked for orders once per
+ * timeframe, in time order, and told about its fills once the timeframe
+ * has been matched. Each strategy is only ever called from one thread
+ * at a time, so it can keep whatever state it likes; the book it reads
+ * is shared and must not be changed.
+ */
+class Strategy
+{
+    public:
+        virtual ~Strategy() = default;
+
+        /** a name for reports; it is also interned as the strategy's user */
+        virtual std::string name() const = 0;
+        /** append this timeframe's asks and bids to orders. Only the price,
+         * amount, product and type are used: the backtester stamps each
+         * order with the timeframe and the strategy's user, and drops those
+         * the wallet can not cover.
+         */
+        virtual void onTimeframe(const StrategyContext& context, std::vector<OrderBookEntry>& orders) = 0;
+        /** the fills of the strategy's orders in the timeframe just matched,
+         * already settled into its wallet
+         */
+        virtual void onFills(std::span<const Fill> fills) { (void)fills; }
+};
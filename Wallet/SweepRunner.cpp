@@ -0,0 +1,213 @@
+#include "SweepRunner.h"
+#include "CSVReader.h"
+#include "Logger.h"
+#include "MarketSnapshot.h"
+#include "SampleStrategies.h"
+#include "WorkStealingPool.h"
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+namespace
+{
+    // Opens a day as a mapped snapshot if it is one, otherwise loads the csv
+    std::unique_ptr<const OrderBook> loadDay(const std::string& file, unsigned loaderThreads)
+    {
+        if (MarketSnapshot::isSnapshot(file))
+        {
+            return std::make_unique<const OrderBook>(std::make_shared<const MarketSnapshot>(file));
+        }
+        return std::make_unique<const OrderBook>(file, loaderThreads);
+    }
+
+    // The values one grid parameter takes: "a|b|c" or "from..to/step", numbers printed the way a spec reads them
+    std::vector<std::string> expandValues(const std::string& values, std::string_view grid)
+    {
+        size_t dots = values.find("..");
+        if (dots == std::string::npos) return CSVReader::tokenise(values, '|');
+
+        size_t slash = values.find('/', dots);
+        if (slash == std::string::npos) throw std::invalid_argument{"range without a /step in grid " + std::string{grid}};
+        double from = std::stod(values.substr(0, dots));
+        double to = std::stod(values.substr(dots + 2, slash - dots - 2));
+        double step = std::stod(values.substr(slash + 1));
+        if (step <= 0 || to < from) throw std::invalid_argument{"empty range in grid " + std::string{grid}};
+
+        std::vector<std::string> result;
+        size_t steps = static_cast<size_t>(std::floor((to - from) / step + 1e-9)); // Allow for 0.1 steps not being exact
+        for (size_t i = 0; i <= steps; ++i)
+        {
+            std::ostringstream value;
+            value << from + step * i;
+            result.push_back(value.str());
+        }
+        return result;
+    }
+
+    // Quotes a csv field if it has a comma or a quote in it
+    std::string csvField(const std::string& text)
+    {
+        if (text.find_first_of(",\"") == std::string::npos) return text;
+        std::string quoted = "\"";
+        for (char c : text)
+        {
+            if (c == '"') quoted += '"';
+            quoted += c;
+        }
+        return quoted + "\"";
+    }
+
+    std::string jsonString(const std::string& text)
+    {
+        std::string quoted = "\"";
+        for (char c : text)
+        {
+            if (c == '"' || c == '\\') quoted += '\\';
+            quoted += c;
+        }
+        return quoted + "\"";
+    }
+}
+
+SweepRunner::SweepRunner(const Options& options)
+: options(options)
+{
+}
+
+// Splits the grid at its parameters, expands each one's values and takes the cartesian product
+std::vector<std::string> SweepRunner::expand(std::string_view grid)
+{
+    size_t colon = grid.find(':');
+    std::string kind{grid.substr(0, colon)};
+    if (colon == std::string_view::npos) return {kind};
+
+    std::vector<std::string> keys;
+    std::vector<std::vector<std::string>> values;
+    for (const std::string& param : CSVReader::tokenise(std::string{grid.substr(colon + 1)}, ','))
+    {
+        size_t equals = param.find('=');
+        if (equals == std::string::npos) throw std::invalid_argument{"bad parameter '" + param + "' in grid " + std::string{grid}};
+        keys.push_back(param.substr(0, equals));
+        values.push_back(expandValues(param.substr(equals + 1), grid));
+    }
+
+    std::vector<std::string> specs;
+    std::vector<size_t> pick(keys.size(), 0);
+    while (true)
+    {
+        std::string spec = kind + ":";
+        for (size_t k = 0; k < keys.size(); ++k)
+        {
+            if (k > 0) spec += ",";
+            spec += keys[k] + "=" + values[k][pick[k]];
+        }
+        specs.push_back(spec);
+
+        // Count like an odometer, the last parameter turning fastest
+        size_t k = keys.size();
+        while (k > 0 && ++pick[k - 1] == values[k - 1].size()) pick[--k] = 0;
+        if (k == 0) break;
+    }
+    return specs;
+}
+
+SweepRunner::Summary SweepRunner::run()
+{
+    // Check every spec before loading anything, so a typo fails in a second rather than after the load
+    std::vector<std::string> specs;
+    for (const std::string& grid : options.grids)
+    {
+        for (std::string& spec : expand(grid))
+        {
+            StrategyFactory::create(spec);
+            specs.push_back(std::move(spec));
+        }
+    }
+
+    // Every day is loaded up front and shared, read only, by each job on it
+    std::vector<std::unique_ptr<const OrderBook>> books;
+    std::vector<std::unique_ptr<Backtester>> backtesters;
+    for (const std::string& day : options.days)
+    {
+        books.push_back(loadDay(day, options.loaderThreads));
+        backtesters.push_back(std::make_unique<Backtester>(*books.back(), options.backtest));
+    }
+    Logger::flush(); // Load reports before the first result
+
+    std::ofstream file;
+    out = &std::cout;
+    if (options.output != "")
+    {
+        file.open(options.output);
+        if (!file) throw std::invalid_argument{"could not write " + options.output};
+        out = &file;
+    }
+    std::streamsize oldPrecision = out->precision(12); // Enough to see a small profit on a large wallet
+    json = options.output.size() >= 5 && options.output.compare(options.output.size() - 5, 5, ".json") == 0;
+    rowsWritten = 0;
+    if (json) *out << "[\n";
+    else *out << "day,strategy,placed,refused,fills,start_value,final_value,pnl,seconds,error\n";
+
+    Summary summary;
+    summary.jobs = options.days.size() * specs.size();
+    WorkStealingPool pool{options.threads};
+    summary.threads = pool.size();
+    std::atomic<size_t> failed{0};
+    auto start = std::chrono::steady_clock::now();
+    pool.parallelFor(summary.jobs, [&](size_t job)
+    {
+        size_t day = job / specs.size();
+        Row row{&options.days[day], Backtester::Result{}, ""};
+        try
+        {
+            std::unique_ptr<Strategy> strategy = StrategyFactory::create(specs[job % specs.size()]);
+            row.result = backtesters[day]->run(*strategy);
+        }
+        catch (const std::exception& e)
+        {
+            row.result.name = specs[job % specs.size()];
+            row.error = e.what();
+            ++failed;
+        }
+        write(row);
+    });
+    summary.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    summary.steals = pool.steals();
+    summary.failed = failed;
+
+    if (json) *out << (rowsWritten > 0 ? "\n" : "") << "]\n";
+    out->flush();
+    if (!*out) LOG(app, error) << "SweepRunner could not write " << options.output;
+    out->precision(oldPrecision);
+    out = nullptr;
+    return summary;
+}
+
+// One line per job, flushed so a long sweep can be watched and a killed one keeps what it had
+void SweepRunner::write(const Row& row)
+{
+    const Backtester::Result& r = row.result;
+    std::lock_guard<std::mutex> lock{outputMutex};
+    if (json)
+    {
+        *out << (rowsWritten > 0 ? ",\n" : "")
+             << "  {\"day\": " << jsonString(*row.day) << ", \"strategy\": " << jsonString(r.name)
+             << ", \"placed\": " << r.placed << ", \"refused\": " << r.refused << ", \"fills\": " << r.fills
+             << ", \"start_value\": " << r.startValue << ", \"final_value\": " << r.finalValue
+             << ", \"pnl\": " << r.pnl() << ", \"seconds\": " << r.seconds;
+        if (row.error != "") *out << ", \"error\": " << jsonString(row.error);
+        *out << "}";
+    }
+    else
+    {
+        *out << csvField(*row.day) << "," << csvField(r.name) << "," << r.placed << "," << r.refused << ","
+             << r.fills << "," << r.startValue << "," << r.finalValue << "," << r.pnl() << ","
+             << r.seconds << "," << csvField(row.error) << "\n";
+    }
+    out->flush();
+    ++rowsWritten;
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include "Backtester.h"
+#include "OrderBook.h"
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/** Backtests every combination of a set of strategy parameters on every
+ * one of a set of days. Each day's data is loaded (or mapped, for a
+ * snapshot) once and shared by every job run on it; the jobs are spread
+ * over a WorkStealingPool, so long runs do not leave threads idle at the
+ * end. Each job's result is written out as soon as it finishes.
+ */
+class SweepRunner
+{
+    public:
+        struct Options
+        {
+            /** data files, csv or snapshot, one job set per file */
+            std::vector<std::string> days;
+            /** parameter grids, see expand() */
+            std::vector<std::string> grids;
+            /** where results go: a .json file gets a JSON array, anything
+             * else csv; "" writes csv to stdout
+             */
+            std::string output;
+            /** threads running jobs, 0 for one per hardware thread */
+            unsigned threads = 0;
+            /** threads parsing each csv day */
+            unsigned loaderThreads = 1;
+            Backtester::Options backtest;
+        };
+
+        /** what a sweep did, for the closing summary */
+        struct Summary
+        {
+            size_t jobs = 0;
+            size_t failed = 0;
+            /** jobs run by a thread other than the one they were dealt to */
+            size_t steals = 0;
+            unsigned threads = 0;
+            double seconds = 0;
+        };
+
+        SweepRunner(const Options& options);
+
+        /** load the days and run every job, writing results as they come.
+         * Throws std::invalid_argument for a bad grid, before any job runs.
+         */
+        Summary run();
+
+        /** the strategy specs a grid stands for: a StrategyFactory spec
+         * whose values may be lists, a|b|c, or ranges, from..to/step,
+         * e.g. "maker:spread=0.001..0.01/0.001,size=0.1|0.5" is 20 specs.
+         * The last parameter varies fastest.
+         */
+        static std::vector<std::string> expand(std::string_view grid);
+
+    private:
+        /** one finished job, for the output */
+        struct Row
+        {
+            const std::string* day;
+            Backtester::Result result;
+            /** why the job failed, "" if it ran */
+            std::string error;
+        };
+
+        /** write one row in the output format, under the output lock */
+        void write(const Row& row);
+
+        Options options;
+        std::ostream* out = nullptr;
+        bool json = false;
+        size_t rowsWritten = 0;
+        std::mutex outputMutex;
+};
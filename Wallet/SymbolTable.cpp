@@ -0,0 +1,164 @@
+#include "SymbolTable.h"
+#include <deque>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+
+namespace
+{
+    // Hash that lets the maps below be searched with a string_view without building a string
+    struct NameHash
+    {
+        using is_transparent = void;
+        size_t operator()(std::string_view s) const { return std::hash<std::string_view>{}(s); }
+    };
+
+    struct Product
+    {
+        std::string name;
+        int base;
+        int quote;
+    };
+
+    // Everything interned so far. Deques keep references to names valid as they grow.
+    struct Symbols
+    {
+        std::shared_mutex mutex;
+        std::unordered_map<std::string, int, NameHash, std::equal_to<>> currencyIds;
+        std::deque<std::string> currencies;
+        std::unordered_map<std::string, int, NameHash, std::equal_to<>> productIds;
+        std::deque<Product> products;
+        std::unordered_map<std::string, int, NameHash, std::equal_to<>> userIds;
+        std::deque<std::string> users{"dataset", "simuser"}; // datasetUser, simulatedUser
+
+        Symbols()
+        {
+            userIds.emplace(users[SymbolTable::datasetUser], SymbolTable::datasetUser);
+            userIds.emplace(users[SymbolTable::simulatedUser], SymbolTable::simulatedUser);
+        }
+    };
+
+    Symbols& symbols()
+    {
+        static Symbols table;
+        return table;
+    }
+
+    // Interns a currency; the caller must hold the write lock
+    int internCurrency(Symbols& table, std::string_view name)
+    {
+        auto it = table.currencyIds.find(name);
+        if (it != table.currencyIds.end()) return it->second;
+        int id = static_cast<int>(table.currencies.size());
+        table.currencies.emplace_back(name);
+        table.currencyIds.emplace(table.currencies.back(), id);
+        return id;
+    }
+}
+
+// Looks the currency up under a shared lock, only taking the write lock to add it
+int SymbolTable::currencyId(std::string_view name)
+{
+    Symbols& table = symbols();
+    {
+        std::shared_lock<std::shared_mutex> lock{table.mutex};
+        auto it = table.currencyIds.find(name);
+        if (it != table.currencyIds.end()) return it->second;
+    }
+    std::unique_lock<std::shared_mutex> lock{table.mutex};
+    return internCurrency(table, name);
+}
+
+int SymbolTable::findCurrency(std::string_view name)
+{
+    Symbols& table = symbols();
+    std::shared_lock<std::shared_mutex> lock{table.mutex};
+    auto it = table.currencyIds.find(name);
+    return it == table.currencyIds.end() ? none : it->second;
+}
+
+const std::string& SymbolTable::currencyName(int currency)
+{
+    Symbols& table = symbols();
+    std::shared_lock<std::shared_mutex> lock{table.mutex};
+    return table.currencies[currency];
+}
+
+int SymbolTable::currencyCount()
+{
+    Symbols& table = symbols();
+    std::shared_lock<std::shared_mutex> lock{table.mutex};
+    return static_cast<int>(table.currencies.size());
+}
+
+// Interns a product, splitting "BASE/QUOTE" and interning both currencies the first time it is seen
+int SymbolTable::productId(std::string_view name)
+{
+    Symbols& table = symbols();
+    {
+        std::shared_lock<std::shared_mutex> lock{table.mutex};
+        auto it = table.productIds.find(name);
+        if (it != table.productIds.end()) return it->second;
+    }
+    std::unique_lock<std::shared_mutex> lock{table.mutex};
+    auto it = table.productIds.find(name);
+    if (it != table.productIds.end()) return it->second;
+
+    size_t slash = name.find('/');
+    Product product{std::string{name}, none, none};
+    product.base = internCurrency(table, name.substr(0, slash));
+    if (slash != std::string_view::npos)
+    {
+        product.quote = internCurrency(table, name.substr(slash + 1));
+    }
+    int id = static_cast<int>(table.products.size());
+    table.products.push_back(std::move(product));
+    table.productIds.emplace(table.products.back().name, id);
+    return id;
+}
+
+const std::string& SymbolTable::productName(int product)
+{
+    Symbols& table = symbols();
+    std::shared_lock<std::shared_mutex> lock{table.mutex};
+    return table.products[product].name;
+}
+
+int SymbolTable::baseCurrency(int product)
+{
+    Symbols& table = symbols();
+    std::shared_lock<std::shared_mutex> lock{table.mutex};
+    return table.products[product].base;
+}
+
+int SymbolTable::quoteCurrency(int product)
+{
+    Symbols& table = symbols();
+    std::shared_lock<std::shared_mutex> lock{table.mutex};
+    return table.products[product].quote;
+}
+
+// Looks the user up under a shared lock, only taking the write lock to add it
+int SymbolTable::userId(std::string_view name)
+{
+    Symbols& table = symbols();
+    {
+        std::shared_lock<std::shared_mutex> lock{table.mutex};
+        auto it = table.userIds.find(name);
+        if (it != table.userIds.end()) return it->second;
+    }
+    std::unique_lock<std::shared_mutex> lock{table.mutex};
+    auto it = table.userIds.find(name);
+    if (it != table.userIds.end()) return it->second;
+    int id = static_cast<int>(table.users.size());
+    table.users.emplace_back(name);
+    table.userIds.emplace(table.users.back(), id);
+    return id;
+}
+
+const std::string& SymbolTable::userName(int user)
+{
+    Symbols& table = symbols();
+    std::shared_lock<std::shared_mutex> lock{table.mutex};
+    return table.users[user];
+}
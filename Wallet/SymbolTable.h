@@ -0,0 +1,43 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+
+/** Interns currency names ("BTC"), product names ("ETH/BTC") and user names into
+ * small dense ids, so hot paths can index arrays instead of looking
+ * strings up in maps. Ids are shared by the whole process, start at 0
+ * and are never reused. Products are split into their base and quote
+ * currencies once, when they are first interned.
+ */
+class SymbolTable
+{
+    public:
+        /** returned by the find functions for a name never interned */
+        static constexpr int none = -1;
+
+        /** id of the named currency, interning it if it is new */
+        static int currencyId(std::string_view name);
+        /** id of the named currency, or none if it has never been interned */
+        static int findCurrency(std::string_view name);
+        static const std::string& currencyName(int currency);
+        /** number of currencies interned so far; ids run from 0 to this - 1 */
+        static int currencyCount();
+
+        /** id of the named product, interning it and its currencies if it is new */
+        static int productId(std::string_view name);
+        static const std::string& productName(int product);
+        /** the currency being traded, e.g. ETH in ETH/BTC */
+        static int baseCurrency(int product);
+        /** the currency prices are quoted in, e.g. BTC in ETH/BTC.
+         * none if the product name has no '/'
+         */
+        static int quoteCurrency(int product);
+
+        /** the user every order read from a data file belongs to, "dataset" */
+        static constexpr int datasetUser = 0;
+        /** the user the menu and --replay place orders as, "simuser" */
+        static constexpr int simulatedUser = 1;
+        /** id of the named user, interning it if it is new */
+        static int userId(std::string_view name);
+        static const std::string& userName(int user);
+};
@@ -0,0 +1,73 @@
+#include "ThreadPool.h"
+#include <algorithm>
+
+// Starts the workers; the caller of parallelFor makes up the last thread
+ThreadPool::ThreadPool(unsigned threads)
+{
+    if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+    for (unsigned i = 1; i < threads; ++i)
+    {
+        workers.emplace_back([this]() { workerLoop(); });
+    }
+}
+
+// Wakes every worker to tell it to finish, then waits for them
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock{mutex};
+        stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread& worker : workers) worker.join();
+}
+
+// Hands the tasks out to the workers and works on them alongside them
+void ThreadPool::parallelFor(size_t count, const std::function<void(size_t)>& _task)
+{
+    if (count == 0) return;
+    if (workers.empty() || count == 1)
+    {
+        for (size_t i = 0; i < count; ++i) _task(i); // Nobody to share with
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock{mutex};
+    task = &_task;
+    taskCount = count;
+    nextTask = 0;
+    unfinished = count;
+    ++generation;
+    wake.notify_all();
+    runTasks(lock);
+    done.wait(lock, [this]() { return unfinished == 0; });
+    task = nullptr;
+}
+
+// Claims task numbers one at a time, running each with the lock released
+void ThreadPool::runTasks(std::unique_lock<std::mutex>& lock)
+{
+    while (task != nullptr && nextTask < taskCount)
+    {
+        size_t i = nextTask++;
+        const std::function<void(size_t)>& current = *task;
+        lock.unlock();
+        current(i);
+        lock.lock();
+        if (--unfinished == 0) done.notify_all();
+    }
+}
+
+// Sleeps until a job arrives, helps with it, and goes back to sleep
+void ThreadPool::workerLoop()
+{
+    std::unique_lock<std::mutex> lock{mutex};
+    size_t seen = 0;
+    while (true)
+    {
+        wake.wait(lock, [&]() { return stopping || generation != seen; });
+        if (stopping) return;
+        seen = generation;
+        runTasks(lock);
+    }
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/** A fixed set of worker threads for splitting one job into independent
+ * tasks. The calling thread works on the job too, so a pool of one
+ * thread runs everything inline.
+ */
+class ThreadPool
+{
+    public:
+        /** threads = 0 means one per hardware thread */
+        ThreadPool(unsigned threads = 0);
+        ~ThreadPool();
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        /** run task(i) for every i in [0, count) and return once all are done.
+         * Tasks may run in any order and on any thread.
+         */
+        void parallelFor(size_t count, const std::function<void(size_t)>& task);
+        /** number of threads working on a job, including the caller */
+        unsigned size() const { return static_cast<unsigned>(workers.size()) + 1; }
+
+    private:
+        /** take tasks from the current job until there are none left */
+        void runTasks(std::unique_lock<std::mutex>& lock);
+        void workerLoop();
+
+        std::vector<std::thread> workers;
+        std::mutex mutex;
+        std::condition_variable wake;
+        std::condition_variable done;
+        /** the job being run, nullptr between jobs */
+        const std::function<void(size_t)>* task = nullptr;
+        size_t taskCount = 0;
+        size_t nextTask = 0;
+        size_t unfinished = 0;
+        /** bumped for every job so sleeping workers can tell a new one has arrived */
+        size_t generation = 0;
+        bool stopping = false;
+};
@@ -1,6 +1,8 @@
 #include "Wallet.h"
 #include <iostream>
-#include "CSVReader.h"
+#include <algorithm>
+#include "SymbolTable.h"
+#include "OrderBook.h"
 
 // Default constructor for the Wallet class
 Wallet::Wallet()
@@ -8,107 +10,232 @@ Wallet::Wallet()
     // Constructor body is empty as there's no initial setup required
 }
 
-// Inserts or adds to the currency amount in the wallet
-void Wallet::insertCurrency(std::string type, double amount)
+// Grows the balance arrays so the currency id can be used as an index
+void Wallet::reserveCurrency(int currency)
 {
-    double balance;
-    if (amount < 0)
-    {
-        throw std::exception{}; // Throw an exception if a negative amount is attempted to be added
-    }
-    if (currencies.count(type) == 0) // Check if the currency type already exists in the wallet
+    if (currency >= static_cast<int>(balances.size()))
     {
-        balance = 0; // Initialize balance to zero if currency type does not exist
+        balances.resize(currency + 1, Decimal{});
+        reserved.resize(currency + 1, Decimal{});
+        held.resize(currency + 1, false);
     }
-    else
+}
+
+// Inserts or adds to the currency amount in the wallet
+void Wallet::insertCurrency(const std::string& type, Decimal amount)
+{
+    if (amount < Decimal{})
     {
-        balance = currencies[type]; // Get the current balance if it exists
+        throw std::exception{}; // Throw an exception if a negative amount is attempted to be added
     }
-    balance += amount; // Add the specified amount to the balance
-    currencies[type] = balance; // Update the currency balance in the wallet
+    int currency = SymbolTable::currencyId(type);
+    reserveCurrency(currency);
+    balances[currency] += amount; // Add the specified amount to the balance, which starts at zero
+    held[currency] = true;
 }
 
 // Removes a specified amount of currency from the wallet
-bool Wallet::removeCurrency(std::string type, double amount)
+bool Wallet::removeCurrency(const std::string& type, Decimal amount)
 {
-    if (amount < 0)
+    if (amount < Decimal{})
     {
         return false; // Return false if trying to remove a negative amount (invalid operation)
     }
-    if (currencies.count(type) == 0) // Check if the currency exists in the wallet
+    int currency = SymbolTable::findCurrency(type);
+    if (currency == SymbolTable::none || currency >= static_cast<int>(held.size()) || !held[currency])
     {
         return false; // Return false if the currency does not exist
     }
-    else if (containsCurrency(type, amount)) // Check if the wallet contains enough of the currency
+    if (balances[currency] >= amount) // Check if the wallet contains enough of the currency
     {
-        currencies[type] -= amount; // Deduct the amount from the wallet
+        balances[currency] -= amount; // Deduct the amount from the wallet
         return true; // Return true indicating successful removal
     }
     return false; // Return false if there isn't enough currency to remove
 }
 
 // Checks if the wallet contains at least a certain amount of a currency
-bool Wallet::containsCurrency(std::string type, double amount)
+bool Wallet::containsCurrency(const std::string& type, Decimal amount) const
 {
-    if (currencies.count(type) == 0) // Check if the currency exists
+    int currency = SymbolTable::findCurrency(type);
+    if (currency == SymbolTable::none || currency >= static_cast<int>(held.size()) || !held[currency]) // Check if the currency exists
         return false;
-    return currencies[type] >= amount; // Check if the balance is greater than or equal to the amount needed
+    return balances[currency] >= amount; // Check if the balance is greater than or equal to the amount needed
+}
+
+Decimal Wallet::balance(const std::string& type) const
+{
+    int currency = SymbolTable::findCurrency(type);
+    if (currency == SymbolTable::none || currency >= static_cast<int>(held.size())) return Decimal{};
+    return balances[currency];
+}
+
+std::vector<std::pair<int, Decimal>> Wallet::holdings() const
+{
+    std::vector<std::pair<int, Decimal>> result;
+    for (size_t i = 0; i < held.size(); ++i)
+    {
+        if (held[i]) result.emplace_back(static_cast<int>(i), balances[i]);
+    }
+    return result;
 }
 
 // Returns a string representation of the wallet showing all currencies and their amounts
-std::string Wallet::toString()
+std::string Wallet::toString() const
 {
+    // List the held currencies by name, the order the old string-keyed map printed them in
+    std::vector<int> currencies;
+    for (size_t i = 0; i < held.size(); ++i)
+    {
+        if (held[i]) currencies.push_back(static_cast<int>(i));
+    }
+    std::sort(currencies.begin(), currencies.end(), [](int a, int b)
+    {
+        return SymbolTable::currencyName(a) < SymbolTable::currencyName(b);
+    });
+
     std::string s;
-    for (auto& pair : currencies)
+    for (int currency : currencies)
     {
-        s += pair.first + " : " + std::to_string(pair.second) + "\n"; // Format each currency type and amount into a string
+        s += SymbolTable::currencyName(currency) + " : " + std::to_string(balances[currency].toDouble()) + "\n"; // Format each currency type and amount into a string
     }
     return s;
 }
 
-// Determines if a particular order can be fulfilled based on the currency amounts in the wallet
-bool Wallet::canFulfillOrder(OrderBookEntry order)
+// Works out which currency an order spends and how much of it
+bool Wallet::orderCost(const OrderBookEntry& order, int& currency, Decimal& amount)
 {
-    std::vector<std::string> currs = CSVReader::tokenise(order.product, '/');
     if (order.orderType == OrderBookType::ask) // If the order is an ask
     {
-        double amount = order.amount;
-        std::string currency = currs[0];
-        return containsCurrency(currency, amount); // Check if there is enough currency to fulfill the ask
+        amount = order.amount;
+        currency = SymbolTable::baseCurrency(order.productId);
     }
     else if (order.orderType == OrderBookType::bid) // If the order is a bid
     {
-        double amount = order.amount * order.price;
-        std::string currency = currs[1];
-        return containsCurrency(currency, amount); // Check if there is enough currency to cover the bid price
+        amount = order.amount * order.price;
+        currency = SymbolTable::quoteCurrency(order.productId);
+    }
+    else
+    {
+        return false;
     }
-    return false;
+    return currency != SymbolTable::none;
 }
 
-// Processes a completed sale, adjusting the wallet's balances accordingly
-void Wallet::processSale(OrderBookEntry& sale)
+// The balance less whatever is held for orders
+Decimal Wallet::available(int currency) const
+{
+    if (currency < 0 || currency >= static_cast<int>(held.size()) || !held[currency])
+    {
+        return Decimal{};
+    }
+    return balances[currency] - reserved[currency];
+}
+
+// Determines if a particular order can be fulfilled based on the currency amounts in the wallet
+bool Wallet::canFulfillOrder(const OrderBookEntry& order) const
+{
+    int currency;
+    Decimal amount;
+    if (!orderCost(order, currency, amount) || currency >= static_cast<int>(held.size()) || !held[currency])
+    {
+        return false;
+    }
+    return available(currency) >= amount; // Check if there is enough currency to cover the order
+}
+
+// Holds the funds if they are there, so the next order can not spend them too
+bool Wallet::reserve(int currency, Decimal amount)
 {
-    std::vector<std::string> currs = CSVReader::tokenise(sale.product, '/');
-    if (sale.orderType == OrderBookType::asksale) // If the sale resulted from an ask
+    if (amount < Decimal{} || currency < 0 || currency >= static_cast<int>(held.size()) || !held[currency] ||
+        available(currency) < amount)
     {
-        double outgoingAmount = sale.amount;
-        std::string outgoingCurrency = currs[0];
-        double incomingAmount = sale.amount * sale.price;
-        std::string incomingCurrency = currs[1];
+        return false;
+    }
+    reserved[currency] += amount;
+    return true;
+}
+
+void Wallet::release(int currency, Decimal amount)
+{
+    if (currency < 0 || currency >= static_cast<int>(reserved.size())) return;
+    reserved[currency] -= amount;
+}
+
+// Checks the order, then prices it against the other side of the book
+bool Wallet::canFulfillOrder(const OrderBookEntry& order, const OrderBook& book, SizeQuote& impact) const
+{
+    OrderBookType otherSide = order.orderType == OrderBookType::ask ? OrderBookType::bid : OrderBookType::ask;
+    impact = book.getPriceForSize(otherSide, order.product(), order.timestamp, order.amount.toDouble());
+    return canFulfillOrder(order);
+}
+
+// Processes a completed sale, adjusting the wallet's balances accordingly
+void Wallet::processSale(const OrderBookEntry& sale)
+{
+    processSales(std::span<const OrderBookEntry>{&sale, 1});
+}
 
-        currencies[incomingCurrency] += incomingAmount; // Increase incoming currency
-        currencies[outgoingCurrency] -= outgoingAmount; // Decrease outgoing currency
+// Settles a batch of sales, resolving each product's currencies once per run of sales in that product
+void Wallet::processSales(std::span<const OrderBookEntry> sales)
+{
+    int lastProduct = SymbolTable::none;
+    int base = SymbolTable::none;
+    int quote = SymbolTable::none;
+    for (const OrderBookEntry& sale : sales)
+    {
+        if (sale.orderType != OrderBookType::asksale && sale.orderType != OrderBookType::bidsale)
+        {
+            continue; // Only sales move money
+        }
+        if (sale.productId != lastProduct)
+        {
+            base = SymbolTable::baseCurrency(sale.productId);
+            quote = SymbolTable::quoteCurrency(sale.productId);
+            lastProduct = sale.productId;
+        }
+        if (quote == SymbolTable::none) continue; // Not a BASE/QUOTE product, so there is no price currency to settle in
+        settle(sale.orderType, sale.price, sale.amount, base, quote);
     }
-    else if (sale.orderType == OrderBookType::bidsale) // If the sale resulted from a bid
+}
+
+// Settles the user's side of each fill, resolving currencies once per run of fills in one product
+void Wallet::processFills(std::span<const Fill> fills, uint32_t user)
+{
+    int lastProduct = SymbolTable::none;
+    int base = SymbolTable::none;
+    int quote = SymbolTable::none;
+    for (const Fill& fill : fills)
     {
-        double incomingAmount = sale.amount;
-        std::string incomingCurrency = currs[0];
-        double outgoingAmount = sale.amount * sale.price;
-        std::string outgoingCurrency = currs[1];
+        if (!fill.involves(user)) continue;
+        if (fill.productId != lastProduct)
+        {
+            base = SymbolTable::baseCurrency(fill.productId);
+            quote = SymbolTable::quoteCurrency(fill.productId);
+            lastProduct = fill.productId;
+        }
+        if (quote == SymbolTable::none) continue;
+        if (fill.buyer == user) settle(OrderBookType::bidsale, fill.price, fill.amount, base, quote);
+        if (fill.seller == user) settle(OrderBookType::asksale, fill.price, fill.amount, base, quote);
+    }
+}
 
-        currencies[incomingCurrency] += incomingAmount; // Increase incoming currency
-        currencies[outgoingCurrency] -= outgoingAmount; // Decrease outgoing currency
+// Moves the two currencies of one side of a trade
+void Wallet::settle(OrderBookType side, Decimal price, Decimal amount, int base, int quote)
+{
+    reserveCurrency(std::max(base, quote));
+    if (side == OrderBookType::asksale) // If the sale resulted from an ask
+    {
+        balances[quote] += amount * price; // Increase incoming currency
+        balances[base] -= amount; // Decrease outgoing currency
+    }
+    else // The sale resulted from a bid
+    {
+        balances[base] += amount; // Increase incoming currency
+        balances[quote] -= amount * price; // Decrease outgoing currency
     }
+    held[base] = true;
+    held[quote] = true;
 }
 
 // Overload of the output stream operator to print the wallet contents using Wallet::toString()
@@ -1,40 +1,85 @@
 #pragma once
 
 #include <string>
-#include <map>
+#include <vector>
+#include <span>
+#include <utility>
 #include "OrderBookEntry.h"
+#include "DepthLadder.h"
+#include "Fill.h"
 #include <iostream>
 
+class OrderBook;
+
 class Wallet 
 {
     public:
         Wallet();
         /** insert currency to the wallet */
-        void insertCurrency(std::string type, double amount);
+        void insertCurrency(const std::string& type, Decimal amount);
         /** remove currency from the wallet */
-        bool removeCurrency(std::string type, double amount);
+        bool removeCurrency(const std::string& type, Decimal amount);
         
         /** check if the wallet contains this much currency or more */
-        bool containsCurrency(std::string type, double amount);
-        /** checks if the wallet can cope with this ask or bid.*/
-        bool canFulfillOrder(OrderBookEntry order);
+        bool containsCurrency(const std::string& type, Decimal amount) const;
+        /** how much of the currency the wallet holds, 0 if none */
+        Decimal balance(const std::string& type) const;
+        /** every currency the wallet has an entry for, as SymbolTable ids with their balances */
+        std::vector<std::pair<int, Decimal>> holdings() const;
+        /** checks if the wallet can cope with this ask or bid from the
+         * funds not already reserved for other orders
+         */
+        bool canFulfillOrder(const OrderBookEntry& order) const;
+        /** same, also estimating the order's market impact from the book
+         * at the order's time: an ask sells into the bids, a bid buys
+         * from the asks.
+         */
+        bool canFulfillOrder(const OrderBookEntry& order, const OrderBook& book, SizeQuote& impact) const;
         /** update the contents of the wallet
          * assumes the order was made by the owner of the wallet
         */
-        void processSale(OrderBookEntry& sale);
+        void processSale(const OrderBookEntry& sale);
+        /** settle a batch of sales in one pass, in order.
+         * Same result as calling processSale on each of them.
+         */
+        void processSales(std::span<const OrderBookEntry> sales);
+        /** settle the user's side of each fill: bought as the buyer, sold as the seller */
+        void processFills(std::span<const Fill> fills, uint32_t user);
+
+        /** the currency and amount an order ties up: the base amount for
+         * an ask, amount * price of the quote currency for a bid. False if
+         * the order is neither or its product has no quote currency.
+         */
+        static bool orderCost(const OrderBookEntry& order, int& currency, Decimal& amount);
+        /** hold amount of a currency id for an order if the unreserved
+         * balance covers it; false, holding nothing, if it does not
+         */
+        bool reserve(int currency, Decimal amount);
+        /** give back funds held by reserve */
+        void release(int currency, Decimal amount);
+        /** move the currencies of one side of a trade in a product whose
+         * currencies are already resolved: an asksale sells amount of base
+         * for amount * price of quote, a bidsale buys
+         */
+        void settle(OrderBookType side, Decimal price, Decimal amount, int base, int quote);
 
 
         /** generate a string representation of the wallet */
-        std::string toString();
+        std::string toString() const;
         friend std::ostream& operator<<(std::ostream& os, Wallet& wallet);
 
         
     private:
-        std::map<std::string,double> currencies;
-
-};
+        /** make room for currency ids up to and including this one */
+        void reserveCurrency(int currency);
+        /** balance not reserved for an order, 0 for a currency never held */
+        Decimal available(int currency) const;
 
+        /** balance per SymbolTable currency id, exact to the last Decimal place */
+        std::vector<Decimal> balances;
+        /** part of each balance held for orders not matched yet */
+        std::vector<Decimal> reserved;
+        /** which currencies have an entry in the wallet, even a zero one */
+        std::vector<bool> held;
 
-
-	
-
+};
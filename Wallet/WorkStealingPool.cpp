@@ -0,0 +1,117 @@
+#include "WorkStealingPool.h"
+#include <algorithm>
+
+// Starts the workers; the caller of parallelFor makes up the last thread
+WorkStealingPool::WorkStealingPool(unsigned threads)
+{
+    if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+    for (unsigned i = 0; i < threads; ++i) queues.push_back(std::make_unique<Queue>());
+    for (unsigned i = 1; i < threads; ++i)
+    {
+        workers.emplace_back([this, i]() { workerLoop(i); });
+    }
+}
+
+// Wakes every worker to tell it to finish, then waits for them
+WorkStealingPool::~WorkStealingPool()
+{
+    {
+        std::lock_guard<std::mutex> lock{mutex};
+        stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread& worker : workers) worker.join();
+}
+
+// Deals the tasks out in contiguous shares, one per thread, and works on the caller's share
+void WorkStealingPool::parallelFor(size_t count, const std::function<void(size_t)>& _task)
+{
+    stolen = 0;
+    if (count == 0) return;
+    if (workers.empty() || count == 1)
+    {
+        for (size_t i = 0; i < count; ++i) _task(i); // Nobody to share with
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock{mutex};
+    const size_t threads = queues.size();
+    for (size_t t = 0; t < threads; ++t)
+    {
+        std::lock_guard<std::mutex> queueLock{queues[t]->mutex};
+        for (size_t i = count * t / threads; i < count * (t + 1) / threads; ++i) queues[t]->tasks.push_back(i);
+    }
+    task = &_task;
+    unfinished = count;
+    ++generation;
+    wake.notify_all();
+    lock.unlock();
+
+    work(0, _task);
+
+    lock.lock();
+    done.wait(lock, [this]() { return unfinished == 0 && busy == 0; });
+    task = nullptr;
+}
+
+// Pops from the front of its own queue, or else from the back of the others', nearest first
+bool WorkStealingPool::take(size_t self, size_t& next)
+{
+    {
+        Queue& own = *queues[self];
+        std::lock_guard<std::mutex> lock{own.mutex};
+        if (!own.tasks.empty())
+        {
+            next = own.tasks.front();
+            own.tasks.pop_front();
+            return true;
+        }
+    }
+    for (size_t step = 1; step < queues.size(); ++step)
+    {
+        Queue& victim = *queues[(self + step) % queues.size()];
+        std::lock_guard<std::mutex> lock{victim.mutex};
+        if (!victim.tasks.empty())
+        {
+            next = victim.tasks.back(); // The far end, so the owner and the thief are not after the same task
+            victim.tasks.pop_back();
+            ++stolen;
+            return true;
+        }
+    }
+    return false; // Tasks are only ever taken, never added, so empty everywhere means the job is all claimed
+}
+
+void WorkStealingPool::work(size_t self, const std::function<void(size_t)>& current)
+{
+    size_t next;
+    while (take(self, next))
+    {
+        current(next);
+        if (--unfinished == 0)
+        {
+            std::lock_guard<std::mutex> lock{mutex};
+            done.notify_all();
+        }
+    }
+}
+
+// Sleeps until a job arrives, helps with it, and goes back to sleep
+void WorkStealingPool::workerLoop(size_t self)
+{
+    std::unique_lock<std::mutex> lock{mutex};
+    size_t seen = 0;
+    while (true)
+    {
+        wake.wait(lock, [&]() { return stopping || generation != seen; });
+        if (stopping) return;
+        seen = generation;
+        if (task == nullptr) continue; // Woke after the job had already finished
+        const std::function<void(size_t)>& current = *task;
+        ++busy;
+        lock.unlock();
+        work(self, current);
+        lock.lock();
+        if (--busy == 0) done.notify_all();
+    }
+}
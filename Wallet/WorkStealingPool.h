@@ -0,0 +1,68 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/** A fixed set of worker threads for jobs whose tasks take very different
+ * times, such as backtests of different lengths. Each thread starts with
+ * its own share of the tasks and works through it front to back; a
+ * thread that runs out takes tasks from the back of another's share, so
+ * every thread stays busy until the last task is taken. The calling
+ * thread works on the job too, so a pool of one thread runs everything
+ * inline. Same interface as ThreadPool.
+ */
+class WorkStealingPool
+{
+    public:
+        /** threads = 0 means one per hardware thread */
+        WorkStealingPool(unsigned threads = 0);
+        ~WorkStealingPool();
+
+        WorkStealingPool(const WorkStealingPool&) = delete;
+        WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+        /** run task(i) for every i in [0, count) and return once all are done.
+         * Tasks may run in any order and on any thread.
+         */
+        void parallelFor(size_t count, const std::function<void(size_t)>& task);
+        /** number of threads working on a job, including the caller */
+        unsigned size() const { return static_cast<unsigned>(queues.size()); }
+        /** how many tasks of the last job ran on a thread other than the one they were dealt to */
+        size_t steals() const { return stolen.load(); }
+
+    private:
+        /** one thread's share of the tasks */
+        struct Queue
+        {
+            std::mutex mutex;
+            std::deque<size_t> tasks;
+        };
+
+        /** run tasks until every queue is empty: own ones first, then stolen ones */
+        void work(size_t self, const std::function<void(size_t)>& current);
+        /** the next task for thread self, false once there are none anywhere */
+        bool take(size_t self, size_t& task);
+        void workerLoop(size_t self);
+
+        /** queues[0] belongs to the caller of parallelFor, the rest to the workers */
+        std::vector<std::unique_ptr<Queue>> queues;
+        std::vector<std::thread> workers;
+        std::mutex mutex;
+        std::condition_variable wake;
+        std::condition_variable done;
+        /** the job being run, nullptr between jobs */
+        const std::function<void(size_t)>* task = nullptr;
+        std::atomic<size_t> unfinished{0};
+        std::atomic<size_t> stolen{0};
+        /** workers inside work(), so a job does not end while one still holds its task */
+        size_t busy = 0;
+        /** bumped for every job so sleeping workers can tell a new one has arrived */
+        size_t generation = 0;
+        bool stopping = false;
+};
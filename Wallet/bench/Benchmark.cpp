@@ -0,0 +1,459 @@
+// Benchmarks for the OrderBook hot paths.
+//
+//   benchmark [--min-orders N] [--max-orders N] [--min-time SECONDS]
+//
+// Runs every benchmark on synthetic days of 10^3 up to 10^7 orders (in powers
+// of ten) and prints one JSON document to stdout: ns/op, ops/sec and heap
+// allocations per op for each benchmark and size. Progress goes to stderr.
+
+#include "../AgentRegistry.h"
+#include "../Backtester.h"
+#include "../CandleEngine.h"
+#include "../CSVReader.h"
+#include "../Logger.h"
+#include "../MarketFeed.h"
+#include "../OrderBook.h"
+#include "../OrderBookEntry.h"
+#include "../OrderIntake.h"
+#include "../PriceKernels.h"
+#include "../SampleStrategies.h"
+#include "../Wallet.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <new>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Every heap allocation in the process goes through here so benchmarks can report allocations per op
+static std::atomic<size_t> allocationCount{0};
+
+void* operator new(size_t size)
+{
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size == 0 ? 1 : size)) return p;
+    throw std::bad_alloc{};
+}
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+
+namespace
+{
+    struct Result
+    {
+        std::string name;
+        size_t orders;
+        size_t ops;
+        double seconds;
+        size_t allocations;
+        size_t bytes; // input bytes per pass, 0 if not meaningful
+        size_t passes;
+    };
+
+    std::vector<Result> results;
+    double minTime = 0.2;
+    /** results that must not be optimised away */
+    volatile size_t sink = 0;
+
+    // Runs pass until at least minTime has gone by, recording the totals. pass returns the ops it did.
+    void measure(const std::string& name, size_t orders, size_t bytes, const std::function<size_t()>& pass)
+    {
+        Result r{name, orders, 0, 0, 0, bytes, 0};
+        do
+        {
+            size_t allocationsBefore = allocationCount.load(std::memory_order_relaxed);
+            auto start = std::chrono::steady_clock::now();
+            r.ops += pass();
+            r.seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            r.allocations += allocationCount.load(std::memory_order_relaxed) - allocationsBefore;
+            ++r.passes;
+        } while (r.seconds < minTime);
+        std::cerr << "  " << name << ": " << (r.seconds * 1e9 / std::max<size_t>(r.ops, 1)) << " ns/op" << std::endl;
+        results.push_back(r);
+    }
+
+    const char* productNames[] = {"BTC/USDT", "DOGE/BTC", "DOGE/USDT", "ETH/BTC", "ETH/USDT"};
+    const double midPrices[] = {5300.0, 0.00000031, 0.0017, 0.0219, 117.0};
+
+    // A day shaped like 20200317.csv: about 500 orders per timeframe, five products, prices near the mid to 8 places
+    std::string makeDay(size_t orders)
+    {
+        std::mt19937_64 random{42};
+        std::uniform_int_distribution<int> product(0, 4);
+        std::uniform_int_distribution<int> side(0, 1);
+        std::uniform_int_distribution<int> offset(-20, 20);
+        std::uniform_int_distribution<int> amount(1, 1000);
+        const int64_t start = OrderBookEntry::stringToTimestamp("2020/03/17 17:01:24.884492");
+
+        std::string text;
+        text.reserve(orders * 60);
+        char line[128];
+        std::string timestamp;
+        for (size_t i = 0; i < orders; ++i)
+        {
+            if (i % 500 == 0) timestamp = OrderBookEntry::timestampToString(start + static_cast<int64_t>(i / 500) * 5000000);
+            int p = product(random);
+            double price = midPrices[p] * (1 + offset(random) / 1000.0);
+            int n = std::snprintf(line, sizeof(line), "%s,%s,%s,%.8f,%.2f\n", timestamp.c_str(), productNames[p],
+                                  side(random) ? "ask" : "bid", price, amount(random) / 100.0);
+            text.append(line, n);
+        }
+        return text;
+    }
+
+    void runSize(size_t orders)
+    {
+        std::cerr << orders << " orders" << std::endl;
+        std::string text = makeDay(orders);
+        std::filesystem::path csvPath = std::filesystem::temp_directory_path() / ("merkel_bench_" + std::to_string(orders) + ".csv");
+        {
+            std::ofstream out{csvPath, std::ios::binary};
+            out << text;
+        }
+
+        measure("readCSV", orders, text.size(), [&]()
+        {
+            CSVReadSummary summary;
+            return CSVReader::readCSV(csvPath.string(), summary).size();
+        });
+
+        std::vector<std::string> lines;
+        for (size_t start = 0, end; start < text.size() && lines.size() < 100000; start = end + 1)
+        {
+            end = text.find('\n', start);
+            lines.push_back(text.substr(start, end - start));
+        }
+        measure("tokenise", orders, 0, [&]()
+        {
+            for (const std::string& line : lines) sink = sink + CSVReader::tokenise(line, ',').size();
+            return lines.size();
+        });
+        std::vector<std::string>{}.swap(lines);
+        std::string{}.swap(text);
+
+        Logger::setLevel(LogModule::csv, LogLevel::warn); // Keep the book's load message out of the JSON
+        OrderBook book{csvPath.string()};
+        Logger::setLevel(LogModule::csv, LogLevel::info);
+        std::vector<std::string> products = book.getKnownProducts();
+        std::vector<int64_t> times;
+        int64_t first = book.getEarliestTime();
+        int64_t t = first;
+        do
+        {
+            times.push_back(t);
+            t = book.getNextTime(t);
+        } while (t != first);
+
+        measure("getOrders", orders, 0, [&]()
+        {
+            size_t calls = 0;
+            for (int64_t time : times)
+            {
+                for (const std::string& p : products)
+                {
+                    sink = sink + book.getOrders(OrderBookType::ask, p, time).size();
+                    sink = sink + book.getOrders(OrderBookType::bid, p, time).size();
+                    calls += 2;
+                }
+            }
+            return calls;
+        });
+
+        measure("getPriceForSize", orders, 0, [&]()
+        {
+            size_t calls = 0;
+            for (int64_t time : times)
+            {
+                for (const std::string& p : products)
+                {
+                    sink = sink + static_cast<size_t>(book.getPriceForSize(OrderBookType::bid, p, time, 50).filled);
+                    ++calls;
+                }
+            }
+            return calls;
+        });
+
+        measure("getNextTime", orders, 0, [&]()
+        {
+            int64_t time = first;
+            for (size_t i = 0; i < times.size(); ++i) time = book.getNextTime(time);
+            sink = sink + static_cast<size_t>(time);
+            return times.size();
+        });
+
+        std::vector<Fill> sales;
+        measure("matchAsksToBids", orders, 0, [&]()
+        {
+            size_t calls = 0;
+            for (int64_t time : times)
+            {
+                for (const std::string& p : products)
+                {
+                    sales.clear();
+                    book.matchAsksToBids(p, time, sales);
+                    ++calls;
+                }
+            }
+            return calls;
+        });
+
+        // Settle every fill of the first timeframe, alternating which side the user was on
+        std::vector<OrderBookEntry> fills;
+        for (const std::string& p : products)
+        {
+            std::vector<OrderBookEntry> productFills = book.matchAsksToBids(p, first);
+            fills.insert(fills.end(), productFills.begin(), productFills.end());
+        }
+        for (size_t i = 0; i < fills.size(); ++i) fills[i].orderType = i % 2 ? OrderBookType::asksale : OrderBookType::bidsale;
+        AgentRegistry agents;
+        Wallet& wallet = agents.add(SymbolTable::simulatedUser);
+        for (const char* currency : {"BTC", "DOGE", "ETH", "USDT"}) wallet.insertCurrency(currency, Decimal::whole(1000000000));
+        measure("Wallet::processSale", orders, 0, [&]()
+        {
+            for (const OrderBookEntry& fill : fills) wallet.processSale(fill);
+            return fills.size();
+        });
+
+        // Put every fill of the first timeframe on a feed, as matching does with --feed; readers do not change the cost
+        FeedPublisher::Options feedOptions;
+        feedOptions.name = "merkel_bench_feed";
+        FeedPublisher feed{feedOptions};
+        std::vector<Fill> firstFills;
+        for (const std::string& p : products) book.matchAsksToBids(p, first, firstFills);
+        measure("FeedPublisher::publish", orders, 0, [&]()
+        {
+            FeedMessage trade;
+            for (const Fill& fill : firstFills)
+            {
+                trade.timestamp = fill.timestamp;
+                trade.productId = fill.productId;
+                trade.buyer = fill.buyer;
+                trade.seller = fill.seller;
+                trade.price = fill.price;
+                trade.amount = fill.amount;
+                feed.publish(trade);
+            }
+            return firstFills.size();
+        });
+
+        measure("gotoNextTimeframe sweep", orders, 0, [&]()
+        {
+            // What MerkelMain::gotoNextTimeframe does, minus the printing, for every timeframe of the day
+            size_t userSales = 0;
+            int64_t time = first;
+            for (size_t i = 0; i < times.size(); ++i)
+            {
+                for (const std::string& p : book.getKnownProducts())
+                {
+                    sales.clear();
+                    book.matchAsksToBids(p, time, sales);
+                    for (const Fill& sale : sales)
+                    {
+                        if (sale.involves(SymbolTable::simulatedUser)) ++userSales;
+                    }
+                    agents.settle(sales);
+                }
+                agents.release(time);
+                time = book.getNextTime(time);
+            }
+            sink = sink + userSales;
+            return times.size();
+        });
+
+        // Many agents trading with each other: reserve a timeframe's orders, settle fills between them, release
+        const size_t agentCount = 100000;
+        AgentRegistry crowd;
+        std::vector<OrderBookEntry> crowdOrders;
+        std::vector<Fill> crowdFills;
+        std::mt19937_64 dealer{11};
+        for (size_t a = 0; a < agentCount; ++a)
+        {
+            int user = SymbolTable::userId("agent" + std::to_string(a));
+            Wallet& agentWallet = crowd.add(user);
+            agentWallet.insertCurrency("BTC", Decimal::whole(10));
+            agentWallet.insertCurrency("ETH", Decimal::whole(100));
+            OrderBookType side = a % 2 ? OrderBookType::ask : OrderBookType::bid;
+            crowdOrders.emplace_back(Decimal::fromDouble(midPrices[3]), Decimal::fromDouble(0.5), first,
+                                     SymbolTable::productId("ETH/BTC"), side, user);
+        }
+        for (size_t i = 0; i < agentCount / 2; ++i)
+        {
+            Fill fill{Decimal::fromDouble(midPrices[3]), Decimal::fromDouble(0.25), first,
+                      crowdOrders[(dealer() % (agentCount / 2)) * 2].userId,
+                      crowdOrders[(dealer() % (agentCount / 2)) * 2 + 1].userId,
+                      crowdOrders[0].productId};
+            crowdFills.push_back(fill);
+            std::swap(fill.buyer, fill.seller); // Trade it back too, so repeated runs leave the balances where they were
+            crowdFills.push_back(fill);
+        }
+        std::vector<uint8_t> accepted;
+        measure("AgentRegistry timeframe", orders, 0, [&]()
+        {
+            sink = sink + crowd.reserve(crowdOrders, accepted);
+            crowd.settle(crowdFills);
+            crowd.release(first);
+            return crowdOrders.size();
+        });
+
+        // One strategy over the whole day through its own overlay, per timeframe
+        Backtester backtester{book, Backtester::Options{}};
+        measure("Backtester::run maker", orders, 0, [&]()
+        {
+            std::unique_ptr<Strategy> maker = StrategyFactory::create("maker:spread=0.001");
+            sink = sink + backtester.run(*maker).fills;
+            return times.size();
+        });
+
+        // The candle kernels over every order's price and amount as contiguous arrays
+        std::vector<Decimal> prices;
+        std::vector<Decimal> amounts;
+        for (int64_t time : times)
+        {
+            for (const std::string& p : products)
+            {
+                for (const OrderBookEntry& e : book.getOrders(OrderBookType::ask, p, time))
+                {
+                    prices.push_back(e.price);
+                    amounts.push_back(e.amount);
+                }
+            }
+        }
+        measure("PriceKernels::max", orders, prices.size() * sizeof(Decimal), [&]()
+        {
+            sink = sink + static_cast<size_t>(PriceKernels::max(prices.data(), prices.size()).units());
+            return prices.size();
+        });
+        measure("PriceKernels::dot", orders, prices.size() * 2 * sizeof(Decimal), [&]()
+        {
+            sink = sink + static_cast<size_t>(PriceKernels::dot(prices.data(), amounts.data(), prices.size()));
+            return prices.size();
+        });
+        measure("CandleEngine::addQuotes", orders, 0, [&]()
+        {
+            CandleEngine candles{60000000};
+            candles.addQuotes(book, OrderBookType::ask);
+            return prices.size();
+        });
+
+        // Orders through the intake ring and out again as one batch, as a matching thread would take them
+        OrderIntake intake;
+        std::vector<OrderBookEntry> intakeBatch;
+        intakeBatch.reserve(intake.capacity());
+        const OrderBookEntry intakeOrder{Decimal::fromDouble(midPrices[3]), Decimal::fromDouble(0.5), first, "ETH/BTC", OrderBookType::bid, "simuser"};
+        measure("OrderIntake push+drain", orders, 0, [&]()
+        {
+            const size_t pushes = 1000;
+            for (size_t i = 0; i < pushes; ++i) intake.push(intakeOrder);
+            intakeBatch.clear();
+            intake.drain(intakeBatch);
+            return pushes;
+        });
+        // Four threads pushing at once while this one drains; with fewer cores than threads they take turns
+        measure("OrderIntake 4 producers", orders, 0, [&]()
+        {
+            const size_t producers = 4;
+            const size_t pushes = 250000;
+            std::vector<std::thread> threads;
+            for (size_t t = 0; t < producers; ++t)
+            {
+                threads.emplace_back([&]()
+                {
+                    for (size_t i = 0; i < pushes; ++i) intake.push(intakeOrder);
+                });
+            }
+            size_t drained = 0;
+            while (drained < producers * pushes)
+            {
+                intakeBatch.clear();
+                size_t taken = intake.drain(intakeBatch);
+                drained += taken;
+                if (taken == 0) std::this_thread::yield();
+            }
+            for (std::thread& thread : threads) thread.join();
+            return drained;
+        });
+
+        // Inserting changes the book, so this goes last
+        std::mt19937_64 random{7};
+        measure("insertOrder", orders, 0, [&]()
+        {
+            const size_t inserts = 1000;
+            for (size_t i = 0; i < inserts; ++i)
+            {
+                OrderBookEntry order{Decimal::fromDouble(midPrices[3]), Decimal::fromDouble(0.5), times[random() % times.size()], "ETH/BTC", OrderBookType::bid, "simuser"};
+                book.insertOrder(order);
+            }
+            return inserts;
+        });
+        // Each round adds its own orders, then amends and cancels them by id
+        measure("insertOrder+amendOrder+cancelOrder", orders, 0, [&]()
+        {
+            const size_t inserts = 1000;
+            std::vector<uint64_t> ids;
+            ids.reserve(inserts);
+            for (size_t i = 0; i < inserts; ++i)
+            {
+                OrderBookEntry order{Decimal::fromDouble(midPrices[3]), Decimal::fromDouble(0.5), times[random() % times.size()], "ETH/BTC", OrderBookType::ask, "simuser"};
+                ids.push_back(book.insertOrder(order));
+            }
+            for (uint64_t id : ids) book.amendOrder(id, Decimal::fromDouble(0.25));
+            for (uint64_t id : ids) book.cancelOrder(id);
+            return inserts;
+        });
+
+        std::filesystem::remove(csvPath);
+    }
+
+    void printJson()
+    {
+        std::printf("{\n  \"benchmarks\": [\n");
+        for (size_t i = 0; i < results.size(); ++i)
+        {
+            const Result& r = results[i];
+            double ops = static_cast<double>(std::max<size_t>(r.ops, 1));
+            std::printf("    {\"name\": \"%s\", \"orders\": %zu, \"ops\": %zu, \"ns_per_op\": %.2f, "
+                        "\"ops_per_sec\": %.1f, \"allocs_per_op\": %.3f",
+                        r.name.c_str(), r.orders, r.ops, r.seconds * 1e9 / ops,
+                        r.seconds > 0 ? r.ops / r.seconds : 0.0, r.allocations / ops);
+            if (r.bytes > 0)
+            {
+                std::printf(", \"mb_per_sec\": %.1f", r.bytes * r.passes / r.seconds / 1e6);
+            }
+            std::printf("}%s\n", i + 1 < results.size() ? "," : "");
+        }
+        std::printf("  ]\n}\n");
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    size_t minOrders = 1000;
+    size_t maxOrders = 10000000;
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        std::string flag{argv[i]};
+        if (flag == "--min-orders") minOrders = std::stoull(argv[i + 1]);
+        else if (flag == "--max-orders") maxOrders = std::stoull(argv[i + 1]);
+        else if (flag == "--min-time") minTime = std::stod(argv[i + 1]);
+        else
+        {
+            std::cerr << "unknown option " << flag << std::endl;
+            return 1;
+        }
+    }
+
+    for (size_t orders = minOrders; orders <= maxOrders; orders *= 10)
+    {
+        runSize(orders);
+    }
+    printJson();
+    return 0;
+}
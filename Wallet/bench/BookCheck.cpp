@@ -0,0 +1,259 @@
+// Consistency check for OrderBook's incremental stats and depth.
+//
+//   bookcheck [--steps N] [--orders N] [--prices N] [--seed N]
+//
+// Loads a small day with bids on one product and then runs N random
+// inserts, batch inserts, cancels and amends on that product's one
+// timeframe, keeping about --orders orders on the book at --prices
+// distinct prices. After every step it recounts both sides from the
+// orders themselves and checks getStats (count, low, high and the median
+// the bucket steps one order at a time); now and then it checks
+// getDepth too, so several changes pile up between the lazy redos of the
+// running totals. The asks start empty and are emptied again now and
+// then. Prints what it ran and exits 1 on any fault.
+//
+// The "build book check" task builds it. Run it after changing OrderBook.
+
+#include "../Logger.h"
+#include "../OrderBook.h"
+#include "../OrderBookEntry.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace
+{
+    const std::string product = "ETH/BTC";
+
+    void usage()
+    {
+        std::cerr << "usage: bookcheck [--steps N] [--orders N] [--prices N] [--seed N]\n";
+    }
+
+    // Close enough for sums of the same doubles taken in another order
+    bool near(double a, double b)
+    {
+        return std::fabs(a - b) <= 1e-9 * std::max({1.0, std::fabs(a), std::fabs(b)});
+    }
+
+    // Every order on one side as the check keeps it, loaded ones included
+    struct Side
+    {
+        OrderBookType type;
+        /** order id -> order; loaded orders have ids from the top of the range, as the book gives them none */
+        std::map<uint64_t, OrderBookEntry> orders;
+    };
+
+    // Compares the book's stats, and its depth if asked, for one side against a recount; returns the faults
+    unsigned check(const OrderBook& book, const Side& side, int64_t timestamp, bool depth, size_t step)
+    {
+        unsigned faults = 0;
+        auto fault = [&](const char* what)
+        {
+            if (++faults <= 10)
+            {
+                std::fprintf(stderr, "bookcheck: step %zu, %s: %s wrong\n", step,
+                             side.type == OrderBookType::bid ? "bids" : "asks", what);
+            }
+        };
+
+        std::vector<double> prices;
+        std::map<double, double> levels; // price -> amount, cheapest first
+        double volume = 0;
+        for (const auto& [id, order] : side.orders)
+        {
+            prices.push_back(order.price.toDouble());
+            levels[order.price.toDouble()] += order.amount.toDouble();
+            volume += order.amount.toDouble();
+        }
+        std::sort(prices.begin(), prices.end());
+
+        OrderStats stats = book.getStats(side.type, product, timestamp);
+        if (stats.count != prices.size()) fault("count");
+        if (!prices.empty())
+        {
+            size_t n = prices.size();
+            double median = prices[(n - 1) / 2];
+            if (n % 2 == 0) median = (median + prices[n / 2]) / 2;
+            if (stats.median != median) fault("median");
+            if (stats.low != prices.front() || stats.high != prices.back()) fault("low or high");
+            if (!near(stats.volume, volume)) fault("volume");
+        }
+        if (!depth) return faults;
+
+        // Bids fill dearest first, so their ladder runs the other way
+        std::vector<std::pair<double, double>> expected(levels.begin(), levels.end());
+        if (side.type == OrderBookType::bid) std::reverse(expected.begin(), expected.end());
+        std::vector<DepthLevel> ladder = book.getDepth(side.type, product, timestamp);
+        if (ladder.size() != expected.size())
+        {
+            fault("number of depth levels");
+            return faults;
+        }
+        double cumulativeAmount = 0;
+        double cumulativeNotional = 0;
+        for (size_t i = 0; i < ladder.size(); ++i)
+        {
+            cumulativeAmount += expected[i].second;
+            cumulativeNotional += expected[i].first * expected[i].second;
+            if (ladder[i].price != expected[i].first || !near(ladder[i].amount, expected[i].second) ||
+                !near(ladder[i].cumulativeAmount, cumulativeAmount) ||
+                !near(ladder[i].cumulativeNotional, cumulativeNotional))
+            {
+                fault("depth level");
+                break;
+            }
+        }
+        return faults;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    size_t steps = 200000;
+    size_t target = 200;
+    unsigned priceCount = 40;
+    unsigned seed = 1;
+    try {
+        for (int i = 1; i < argc; ++i)
+        {
+            std::string arg{argv[i]};
+            bool hasValue = i + 1 < argc;
+            if (arg == "--steps" && hasValue) steps = std::stoul(argv[++i]);
+            else if (arg == "--orders" && hasValue) target = std::stoul(argv[++i]);
+            else if (arg == "--prices" && hasValue) priceCount = std::stoul(argv[++i]);
+            else if (arg == "--seed" && hasValue) seed = std::stoul(argv[++i]);
+            else
+            {
+                usage();
+                return 1;
+            }
+        }
+    } catch (const std::exception& e) {
+        usage();
+        return 1;
+    }
+    if (target < 1 || priceCount < 1)
+    {
+        usage();
+        return 1;
+    }
+
+    std::mt19937 random{seed};
+    const int64_t timestamp = OrderBookEntry::stringToTimestamp("2020/03/17 17:01:24.884492");
+    auto randomPrice = [&]() { return Decimal::fromDouble(0.02 + 0.0001 * (random() % priceCount)); };
+    auto randomAmount = [&]() { return Decimal::fromDouble(0.01 * (1 + random() % 500)); };
+
+    // Half the bids come from a file, so they go through the load's one sort and can never be cancelled
+    Side bids{OrderBookType::bid, {}};
+    Side asks{OrderBookType::ask, {}};
+    std::filesystem::path csvPath = std::filesystem::temp_directory_path() / "bookcheck.csv";
+    {
+        std::ofstream csv{csvPath};
+        for (size_t i = 0; i < target / 2; ++i)
+        {
+            OrderBookEntry order{randomPrice(), randomAmount(), timestamp, product, OrderBookType::bid};
+            csv << OrderBookEntry::timestampToString(timestamp) << ',' << product << ",bid,"
+                << order.price.toString() << ',' << order.amount.toString() << '\n';
+            bids.orders.emplace(UINT64_MAX - i, order);
+        }
+        if (!csv)
+        {
+            std::cerr << "bookcheck: could not write " << csvPath.string() << "\n";
+            return 1;
+        }
+    }
+    Logger::setLevel(LogModule::csv, LogLevel::warn);
+    OrderBook book{csvPath.string()};
+    std::filesystem::remove(csvPath);
+
+    size_t inserted = 0;
+    size_t cancelled = 0;
+    size_t amended = 0;
+    size_t depthChecks = 0;
+    unsigned faults = 0;
+    std::vector<uint64_t> live; // ids the book gave, still on it
+    for (size_t step = 0; step < steps; ++step)
+    {
+        unsigned roll = random() % 100;
+        bool grow = live.size() < target ? roll < 60 : roll < 25; // Batches add more than one, so grow less above the target
+        if (live.empty() || grow)
+        {
+            // Now and then a batch, which goes through insertOrders and the bucket's rebuild
+            size_t count = random() % 8 == 0 ? 1 + random() % 4 : 1;
+            std::vector<OrderBookEntry> batch;
+            for (size_t k = 0; k < count; ++k)
+            {
+                OrderBookType type = random() % 2 == 0 ? OrderBookType::bid : OrderBookType::ask;
+                batch.emplace_back(randomPrice(), randomAmount(), timestamp, product, type);
+            }
+            uint64_t first = count == 1 ? book.insertOrder(batch[0]) : book.insertOrders(batch);
+            for (size_t k = 0; k < count; ++k)
+            {
+                (batch[k].orderType == OrderBookType::bid ? bids : asks).orders.emplace(first + k, batch[k]);
+                live.push_back(first + k);
+            }
+            inserted += count;
+        }
+        else
+        {
+            size_t pick = random() % live.size();
+            uint64_t id = live[pick];
+            Side& side = bids.orders.count(id) ? bids : asks;
+            bool cancel = random() % 3 != 0;
+            Decimal amount = random() % 10 == 0 ? Decimal{} : randomAmount(); // Amending to zero cancels
+            if (cancel || amount <= Decimal{})
+            {
+                bool gone = cancel ? book.cancelOrder(id) : book.amendOrder(id, amount);
+                if (!gone) ++faults;
+                side.orders.erase(id);
+                live[pick] = live.back();
+                live.pop_back();
+                ++cancelled;
+            }
+            else
+            {
+                if (!book.amendOrder(id, amount)) ++faults;
+                side.orders.at(id).amount = amount;
+                ++amended;
+            }
+        }
+
+        // Empty the asks now and then, so the side is rebuilt from nothing
+        if (random() % 5000 == 0)
+        {
+            for (size_t k = 0; k < live.size();)
+            {
+                if (asks.orders.count(live[k]) == 0)
+                {
+                    ++k;
+                    continue;
+                }
+                if (!book.cancelOrder(live[k])) ++faults;
+                asks.orders.erase(live[k]);
+                live[k] = live.back();
+                live.pop_back();
+                ++cancelled;
+            }
+        }
+
+        bool depth = random() % 4 == 0;
+        depthChecks += depth;
+        faults += check(book, bids, timestamp, depth, step);
+        faults += check(book, asks, timestamp, depth, step);
+    }
+
+    std::printf("bookcheck: %zu steps, %zu inserted, %zu cancelled, %zu amended, %zu depth checks, "
+                "%zu bids and %zu asks left; %u faults\n",
+                steps, inserted, cancelled, amended, depthChecks, bids.orders.size(), asks.orders.size(), faults);
+    return faults == 0 ? 0 : 1;
+}
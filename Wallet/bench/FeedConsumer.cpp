@@ -0,0 +1,141 @@
+// Sample consumer of the market-data feed (myprogram --feed <name>).
+//
+//   feedconsumer [--name N] [--from-oldest] [--quiet] [--seconds S]
+//
+// Attaches to the feed, waiting up to 10 s for it to appear (then reading
+// it from the start, so nothing published meanwhile is missed), and
+// prints each trade and quote as a csv line:
+//
+//   sequence,trade,product,timestamp,price,amount,buyer,seller
+//   sequence,quote,product,timestamp,bid,bid amount,ask,ask amount
+//
+// With --quiet it prints a count once a second instead. It stops when the
+// publisher closes the feed or after S seconds, and reports what it read,
+// the gaps it saw in the sequence numbers and the messages they lost.
+// Any number of these can read one feed without slowing the publisher.
+
+#include "../MarketFeed.h"
+
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    void usage()
+    {
+        std::cerr << "usage: feedconsumer [--name N] [--from-oldest] [--quiet] [--seconds S]\n";
+    }
+
+    void print(const FeedSubscriber& feed, const FeedMessage& message)
+    {
+        std::string_view product = feed.productName(message.productId);
+        if (message.type == FeedMessage::Type::trade)
+        {
+            std::printf("%llu,trade,%.*s,%lld,%.8f,%.8f,%u,%u\n",
+                        static_cast<unsigned long long>(message.sequence), static_cast<int>(product.size()), product.data(),
+                        static_cast<long long>(message.timestamp), message.price.toDouble(), message.amount.toDouble(),
+                        message.buyer, message.seller);
+        }
+        else
+        {
+            std::printf("%llu,quote,%.*s,%lld,%.8f,%.8f,%.8f,%.8f\n",
+                        static_cast<unsigned long long>(message.sequence), static_cast<int>(product.size()), product.data(),
+                        static_cast<long long>(message.timestamp), message.price.toDouble(), message.amount.toDouble(),
+                        message.askPrice.toDouble(), message.askAmount.toDouble());
+        }
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    FeedSubscriber::Options options;
+    bool quiet = false;
+    double seconds = 0;
+    try {
+        for (int i = 1; i < argc; ++i)
+        {
+            std::string arg{argv[i]};
+            bool hasValue = i + 1 < argc;
+            if (arg == "--name" && hasValue) options.name = argv[++i];
+            else if (arg == "--from-oldest") options.fromOldest = true;
+            else if (arg == "--quiet") quiet = true;
+            else if (arg == "--seconds" && hasValue) seconds = std::stod(argv[++i]);
+            else
+            {
+                usage();
+                return 1;
+            }
+        }
+    } catch (const std::exception& e) {
+        usage();
+        return 1;
+    }
+
+    // The publisher may not be up yet, so keep trying for a while
+    std::unique_ptr<FeedSubscriber> feed;
+    const Clock::time_point attachBy = Clock::now() + std::chrono::seconds(10);
+    while (!feed)
+    {
+        try {
+            feed = std::make_unique<FeedSubscriber>(options);
+        } catch (const std::runtime_error& e) {
+            if (Clock::now() >= attachBy)
+            {
+                std::cerr << "feedconsumer: " << e.what() << "\n";
+                return 1;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            options.fromOldest = true;  // It was waiting first, so everything the feed has is news
+        }
+    }
+
+    uint64_t trades = 0;
+    uint64_t quotes = 0;
+    uint64_t gaps = 0;
+    uint64_t previous = 0;
+    unsigned idle = 0;
+    const Clock::time_point start = Clock::now();
+    Clock::time_point nextReport = start + std::chrono::seconds(1);
+    FeedMessage message;
+    while (true)
+    {
+        if (feed->next(message))
+        {
+            idle = 0;
+            if (previous != 0 && message.sequence != previous + 1) ++gaps;  // Fell a ring behind and skipped ahead
+            previous = message.sequence;
+            if (message.type == FeedMessage::Type::trade) ++trades;
+            else ++quotes;
+            if (!quiet) print(*feed, message);
+            continue;
+        }
+
+        // Nothing new: spin a little, then yield, then sleep, so an idle feed costs next to nothing
+        if (feed->closed()) break;
+        Clock::time_point now = Clock::now();
+        if (seconds > 0 && now - start >= std::chrono::duration<double>(seconds)) break;
+        if (quiet && now >= nextReport)
+        {
+            std::fprintf(stderr, "feedconsumer: %llu trades, %llu quotes, %llu lost\n", static_cast<unsigned long long>(trades),
+                         static_cast<unsigned long long>(quotes), static_cast<unsigned long long>(feed->lost()));
+            nextReport += std::chrono::seconds(1);
+        }
+        if (++idle < 100) continue;
+        if (idle < 1000) std::this_thread::yield();
+        else std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+
+    std::fflush(stdout);
+    std::fprintf(stderr, "feedconsumer: read %llu trades and %llu quotes up to sequence %llu; %llu gaps lost %llu messages\n",
+                 static_cast<unsigned long long>(trades), static_cast<unsigned long long>(quotes),
+                 static_cast<unsigned long long>(previous), static_cast<unsigned long long>(gaps),
+                 static_cast<unsigned long long>(feed->lost()));
+    return 0;
+}
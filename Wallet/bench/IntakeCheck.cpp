@@ -0,0 +1,136 @@
+// Ordering check for OrderIntake, to build with ThreadSanitizer too.
+//
+//   intakecheck [--producers N] [--orders N] [--capacity N] [--batch N]
+//
+// Starts N producer threads that each push their own run of orders,
+// numbered 0, 1, 2, ... in the timestamp and tagged with the producer in
+// the user id, mixing push, two-order batches and tryPush. One consumer
+// drains at most batch orders at a time and checks that every producer's
+// orders come out complete, once each and in the order that producer
+// pushed them. A small ring keeps the producers waiting on the consumer
+// most of the time. Prints what it read and exits 1 on any fault.
+//
+// The "build intake check" task builds it with -fsanitize=thread, so a
+// run also reports any data race in the ring.
+
+#include "../OrderIntake.h"
+
+#include <cstdio>
+#include <functional>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    void usage()
+    {
+        std::cerr << "usage: intakecheck [--producers N] [--orders N] [--capacity N] [--batch N]\n";
+    }
+
+    // Producer p's orders 0 to count - 1, each way of pushing in turn
+    void produce(OrderIntake& intake, int producer, int64_t count)
+    {
+        for (int64_t i = 0; i < count; ++i)
+        {
+            OrderBookEntry order{Decimal{}, Decimal{}, i, 0, OrderBookType::bid, producer};
+            if (i % 3 == 0)
+            {
+                while (!intake.tryPush(order)) std::this_thread::yield();
+            }
+            else if (i % 3 == 1 && i + 1 < count)
+            {
+                OrderBookEntry pair[2] = {order, order};
+                pair[1].timestamp = ++i;
+                intake.push(std::span<const OrderBookEntry>{pair, 2});
+            }
+            else
+            {
+                intake.push(order);
+            }
+        }
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    int producers = 4;
+    int64_t orders = 200000;
+    size_t capacity = 8;
+    size_t batch = 5;
+    try {
+        for (int i = 1; i < argc; ++i)
+        {
+            std::string arg{argv[i]};
+            bool hasValue = i + 1 < argc;
+            if (arg == "--producers" && hasValue) producers = std::stoi(argv[++i]);
+            else if (arg == "--orders" && hasValue) orders = std::stoll(argv[++i]);
+            else if (arg == "--capacity" && hasValue) capacity = std::stoul(argv[++i]);
+            else if (arg == "--batch" && hasValue) batch = std::stoul(argv[++i]);
+            else
+            {
+                usage();
+                return 1;
+            }
+        }
+    } catch (const std::exception& e) {
+        usage();
+        return 1;
+    }
+    if (producers < 1 || orders < 1 || capacity < 2 || batch < 1)  // A two-order batch has to fit the ring
+    {
+        usage();
+        return 1;
+    }
+
+    OrderIntake intake{capacity};
+    std::vector<std::thread> threads;
+    for (int p = 0; p < producers; ++p) threads.emplace_back(produce, std::ref(intake), p, orders);
+
+    // Each producer's next order number; anything else out of the ring is a fault
+    std::vector<int64_t> expected(producers, 0);
+    uint64_t faults = 0;
+    uint64_t drained = 0;
+    uint64_t drains = 0;
+    const uint64_t total = static_cast<uint64_t>(producers) * static_cast<uint64_t>(orders);
+    std::vector<OrderBookEntry> taken;
+    while (drained < total)
+    {
+        taken.clear();
+        if (intake.drain(taken, batch) == 0)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+        ++drains;
+        for (const OrderBookEntry& order : taken)
+        {
+            int producer = static_cast<int>(order.userId);
+            if (producer >= producers || order.timestamp != expected[producer])
+            {
+                if (++faults <= 10)
+                {
+                    std::fprintf(stderr, "intakecheck: order %lld of producer %d, expected %lld\n",
+                                 static_cast<long long>(order.timestamp), producer,
+                                 producer < producers ? static_cast<long long>(expected[producer]) : -1LL);
+                }
+                if (producer >= producers) continue;
+            }
+            expected[producer] = order.timestamp + 1;
+        }
+        drained += taken.size();
+    }
+    for (std::thread& thread : threads) thread.join();
+
+    for (int64_t next : expected)
+    {
+        if (next != orders) ++faults;  // A producer's run came out short
+    }
+    if (intake.pending() != 0) ++faults;
+    std::printf("intakecheck: %d producers, %llu orders in %llu drains through a ring of %zu; %llu faults, %zu left\n",
+                producers, static_cast<unsigned long long>(drained), static_cast<unsigned long long>(drains),
+                intake.capacity(), static_cast<unsigned long long>(faults), intake.pending());
+    return faults == 0 ? 0 : 1;
+}
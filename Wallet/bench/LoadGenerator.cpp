@@ -0,0 +1,290 @@
+// Load generator for the order-entry gateway (myprogram --serve <address>).
+//
+//   loadgen [--address A] [--clients N] [--window N] [--seconds S] [--product P] [--price X]
+//
+// Opens N client connections, logs each in as its own agent and keeps up to
+// window orders in flight on each: a new one goes out as each reply comes
+// back. Orders alternate bids and asks at random prices within 1% of price,
+// so some of them trade. After S seconds it stops sending, waits for the
+// replies still due and prints orders/sec and round-trip latency percentiles.
+
+#include "../Gateway.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    struct Options
+    {
+        std::string address = "7000";
+        size_t clients = 100;
+        size_t window = 1;
+        double seconds = 5;
+        std::string product = "ETH/BTC";
+        double price = 0.022;
+    };
+
+    struct Client
+    {
+        int fd = -1;
+        bool connected = false;
+        std::string input;
+        std::string output;
+        size_t outputStart = 0;
+        /** when each request still waiting for its reply was sent; the epoch for the login */
+        std::deque<Clock::time_point> inFlight;
+        uint64_t sent = 0;
+    };
+
+    struct Totals
+    {
+        uint64_t sent = 0;
+        uint64_t ok = 0;
+        uint64_t refused = 0;
+        /** round trips of orders, in nanoseconds */
+        std::vector<uint64_t> latencies;
+    };
+
+    void usage()
+    {
+        std::cerr << "usage: loadgen [--address A] [--clients N] [--window N] [--seconds S] [--product P] [--price X]\n"
+                  << "  address is unix:/path, host:port or port (default 7000)\n";
+    }
+
+    // Queues one order, alternating sides, to be written by the next flush
+    void queueOrder(Client& client, const Options& options, std::mt19937_64& random)
+    {
+        std::uniform_real_distribution<double> spread{0.99, 1.01};
+        char line[128];
+        int length = std::snprintf(line, sizeof(line), "%s,%s,%.8f,0.01\n",
+                                   client.sent % 2 == 0 ? "bid" : "ask", options.product.c_str(),
+                                   options.price * spread(random));
+        client.output.append(line, static_cast<size_t>(length));
+        client.inFlight.push_back(Clock::now());
+        ++client.sent;
+    }
+
+    // Writes what the socket takes; false on an error
+    bool flush(Client& client)
+    {
+        while (client.outputStart < client.output.size())
+        {
+            ssize_t n = ::send(client.fd, client.output.data() + client.outputStart,
+                               client.output.size() - client.outputStart, MSG_NOSIGNAL);
+            if (n < 0) return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+            client.outputStart += static_cast<size_t>(n);
+        }
+        client.output.clear();
+        client.outputStart = 0;
+        return true;
+    }
+
+    double percentile(std::vector<uint64_t>& values, double fraction)
+    {
+        if (values.empty()) return 0;
+        size_t at = std::min(values.size() - 1, static_cast<size_t>(fraction * values.size()));
+        std::nth_element(values.begin(), values.begin() + at, values.end());
+        return values[at] / 1000.0;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    Options options;
+    try {
+        for (int i = 1; i < argc; ++i)
+        {
+            std::string arg{argv[i]};
+            bool hasValue = i + 1 < argc;
+            if (arg == "--address" && hasValue) options.address = argv[++i];
+            else if (arg == "--clients" && hasValue) options.clients = std::stoul(argv[++i]);
+            else if (arg == "--window" && hasValue) options.window = std::stoul(argv[++i]);
+            else if (arg == "--seconds" && hasValue) options.seconds = std::stod(argv[++i]);
+            else if (arg == "--product" && hasValue) options.product = argv[++i];
+            else if (arg == "--price" && hasValue) options.price = std::stod(argv[++i]);
+            else
+            {
+                usage();
+                return 1;
+            }
+        }
+    } catch (const std::exception& e) {
+        usage();
+        return 1;
+    }
+    if (options.clients == 0 || options.window == 0)
+    {
+        usage();
+        return 1;
+    }
+
+    uint64_t fileLimit = Gateway::raiseFileLimit();
+    if (options.clients + 16 > fileLimit)
+    {
+        std::cerr << "loadgen: only " << fileLimit << " open files allowed, too few for " << options.clients << " clients\n";
+        return 1;
+    }
+
+    int epoll = ::epoll_create1(EPOLL_CLOEXEC);
+    std::vector<Client> clients(options.clients);
+    try {
+        for (size_t i = 0; i < clients.size(); ++i)
+        {
+            clients[i].fd = Gateway::connect(options.address);
+            epoll_event event{};
+            event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+            event.data.u64 = i;
+            ::epoll_ctl(epoll, EPOLL_CTL_ADD, clients[i].fd, &event);
+        }
+    } catch (const std::runtime_error& e) {
+        std::cerr << "loadgen: " << e.what() << "\n";
+        return 1;
+    }
+
+    std::mt19937_64 random{42};
+    Totals totals;
+    totals.latencies.reserve(1 << 20);
+    std::vector<char> buffer(64 * 1024);
+    std::vector<epoll_event> events(256);
+    size_t open = clients.size();
+
+    // Connect every client before the clock starts: a burst of connections
+    // can overflow the SYN queue, and a dropped SYN is only sent again a
+    // second later, which would swamp the latencies being measured
+    size_t connecting = clients.size();
+    const Clock::time_point connectBy = Clock::now() + std::chrono::seconds(30);
+    while (connecting > 0 && Clock::now() < connectBy)
+    {
+        int ready = ::epoll_wait(epoll, events.data(), static_cast<int>(events.size()), 100);
+        for (int e = 0; e < ready; ++e)
+        {
+            Client& client = clients[events[e].data.u64];
+            if (client.connected || client.fd < 0) continue;
+            int error = 0;
+            socklen_t length = sizeof(error);
+            ::getsockopt(client.fd, SOL_SOCKET, SO_ERROR, &error, &length);
+            if ((events[e].events & EPOLLERR) || error != 0)
+            {
+                ::close(client.fd);
+                client.fd = -1;
+                --open;
+                --connecting;
+            }
+            else if (events[e].events & EPOLLOUT)
+            {
+                client.connected = true;
+                --connecting;
+            }
+        }
+    }
+    if (open < clients.size()) std::fprintf(stderr, "loadgen: %zu of %zu clients could not connect\n", clients.size() - open, clients.size());
+
+    // Each client logs in as an agent of its own, then fills its window
+    size_t waiting = 0; // requests sent and not yet answered, over every client
+    const Clock::time_point start = Clock::now();
+    for (size_t i = 0; i < clients.size(); ++i)
+    {
+        Client& client = clients[i];
+        if (!client.connected) continue;
+        client.output += "login,loadgen" + std::to_string(i) + "\n";
+        client.inFlight.push_back(Clock::time_point{});
+        ++waiting;
+        for (size_t w = 0; w < options.window; ++w)
+        {
+            queueOrder(client, options, random);
+            ++waiting;
+        }
+        flush(client);
+    }
+    const Clock::time_point stopSending = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(options.seconds));
+    const Clock::time_point giveUp = stopSending + std::chrono::seconds(5);
+    Clock::time_point lastReply = start;
+
+    while (open > 0 && Clock::now() < giveUp && (Clock::now() < stopSending || waiting > 0))
+    {
+        int ready = ::epoll_wait(epoll, events.data(), static_cast<int>(events.size()), 100);
+        for (int e = 0; e < ready; ++e)
+        {
+            Client& client = clients[events[e].data.u64];
+            if (client.fd < 0) continue;
+            bool failed = (events[e].events & EPOLLERR) != 0;
+
+            // Read every reply there is, answering each with a new order while there is time
+            while (!failed)
+            {
+                ssize_t n = ::read(client.fd, buffer.data(), buffer.size());
+                if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) failed = true;
+                if (n <= 0) break;
+                client.input.append(buffer.data(), static_cast<size_t>(n));
+                size_t lineStart = 0;
+                size_t end;
+                Clock::time_point now = Clock::now();
+                while ((end = client.input.find('\n', lineStart)) != std::string::npos && !client.inFlight.empty())
+                {
+                    Clock::time_point sentAt = client.inFlight.front();
+                    client.inFlight.pop_front();
+                    --waiting;
+                    if (sentAt != Clock::time_point{})
+                    {
+                        totals.latencies.push_back(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(now - sentAt).count()));
+                        if (client.input.compare(lineStart, 3, "ok,") == 0) ++totals.ok;
+                        else ++totals.refused;
+                        if (now < stopSending)
+                        {
+                            queueOrder(client, options, random);
+                            ++waiting;
+                        }
+                    }
+                    lastReply = now;
+                    lineStart = end + 1;
+                }
+                client.input.erase(0, lineStart);
+            }
+            if (!failed) failed = !flush(client);
+            if (failed || (events[e].events & (EPOLLHUP | EPOLLRDHUP)))
+            {
+                waiting -= client.inFlight.size();
+                ::close(client.fd);
+                client.fd = -1;
+                --open;
+            }
+        }
+    }
+    double seconds = std::chrono::duration<double>(lastReply - start).count();
+    for (Client& client : clients)
+    {
+        totals.sent += client.sent;
+        if (client.fd >= 0) ::close(client.fd);
+    }
+    ::close(epoll);
+
+    uint64_t answered = totals.ok + totals.refused;
+    std::vector<uint64_t>& latencies = totals.latencies;
+    std::printf("clients %zu (%zu lost), window %zu, %.2f s\n", options.clients, options.clients - open, options.window, seconds);
+    std::printf("orders sent %llu, accepted %llu, refused %llu, unanswered %llu\n",
+                static_cast<unsigned long long>(totals.sent), static_cast<unsigned long long>(totals.ok),
+                static_cast<unsigned long long>(totals.refused), static_cast<unsigned long long>(totals.sent - answered));
+    std::printf("orders/sec %.0f\n", seconds > 0 ? answered / seconds : 0.0);
+    double p50 = percentile(latencies, 0.50);
+    double p90 = percentile(latencies, 0.90);
+    double p99 = percentile(latencies, 0.99);
+    double p999 = percentile(latencies, 0.999);
+    uint64_t slowest = latencies.empty() ? 0 : *std::max_element(latencies.begin(), latencies.end());
+    std::printf("round trip us: p50 %.1f  p90 %.1f  p99 %.1f  p99.9 %.1f  max %.1f\n", p50, p90, p99, p999, slowest / 1000.0);
+    return 0;
+}
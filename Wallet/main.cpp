@@ -1,12 +1,202 @@
 #include "Wallet.h" // Include the header file for the Wallet class
 #include <iostream> // Include the standard input/output stream library
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
 #include "MerkelMain.h" // Include the header file for the MerkelMain class
+#include "MarketSnapshot.h"
+#include "Logger.h"
+#include "SweepRunner.h"
+
+// Applies one --log setting, "level" or "module=level"; false if it makes no sense
+static bool applyLogSetting(std::string_view setting)
+{
+    LogLevel level;
+    size_t equals = setting.find('=');
+    if (equals == std::string_view::npos)
+    {
+        if (!Logger::parseLevel(setting, level)) return false;
+        Logger::setLevel(level);
+        return true;
+    }
+    LogModule module;
+    if (!Logger::parseModule(setting.substr(0, equals), module) ||
+        !Logger::parseLevel(setting.substr(equals + 1), level)) return false;
+    Logger::setLevel(module, level);
+    return true;
+}
+
+// Prints the command line usage
+static void printUsage()
+{
+    std::cout << "usage:\n"
+              << "  myprogram [datafile] [options]            interactive sim on a csv or snapshot file\n"
+              << "  myprogram --replay [datafile] [options]   run every timeframe once and print a summary\n"
+              << "  myprogram --backtest [datafile] [options] run strategies over every timeframe side by side\n"
+              << "  myprogram --sweep <grid> [options]        backtest every combination in a parameter grid\n"
+              << "  myprogram --serve <address> [datafile]    take orders from clients over a socket: unix:/path,\n"
+              << "                                            host:port or port (on 127.0.0.1)\n"
+              << "  myprogram --convert <csvfile> <snapfile>  write a snapshot of a csv file for fast startup\n"
+              << "options:\n"
+              << "  --script <file>         user asks and bids for --replay, in the data file format\n"
+              << "  --print-sales           print each sale during --replay or --serve\n"
+              << "  --threads <n>           csv loader threads, 0 for one per core (default 1)\n"
+              << "  --stream <n>            stream the csv file, holding n timeframes ahead\n"
+              << "  --match-threads <n>     threads matching products, 0 for one per core (default 1)\n"
+              << "  --candles <file>        write candles of the fills during --replay to a csv file\n"
+              << "  --candle-seconds <n>    candle length, 0 for one per timeframe (default 60)\n"
+              << "  --strategy <spec>       a strategy for --backtest, e.g. maker:spread=0.02,size=0.5;\n"
+              << "                          repeat for more (default maker and momentum)\n"
+              << "  --strategy-threads <n>  threads running strategies or sweep jobs, 0 for one per core (default 0)\n"
+              << "                          a --sweep grid takes lists and ranges, e.g. maker:spread=0.001..0.01/0.001,size=0.1|0.5;\n"
+              << "                          repeat for more grids\n"
+              << "  --day <file>            a data file for --sweep; repeat for more (default the datafile)\n"
+              << "  --out <file>            --sweep results, json for a .json file, else csv (default csv to stdout)\n"
+              << "  --timeframe-ms <n>      how often --serve moves on to the next timeframe (default 1000)\n"
+              << "  --journal <dir>         journal the interactive sim's orders and wallet to a directory,\n"
+              << "                          and carry on from it when started again\n"
+              << "  --snapshot-every <n>    timeframes between journal snapshots, 0 for none (default 100)\n"
+              << "  --feed <name>           publish fills and best bid/ask changes to shared memory /dev/shm/<name>\n"
+              << "  --log [module=]level    log level for every module or one of csv, book, matching, app;\n"
+              << "                          level is debug, info, warn, error or off (default info)\n";
+}
 
 // Main function: Entry point of the program
-int main()
+int main(int argc, char* argv[])
 {   
-    MerkelMain app{}; // Create an instance of the MerkelMain class
-    app.init(); // Initialize the application
+    if (argc == 4 && std::string{argv[1]} == "--convert")
+    {
+        try {
+            size_t rows = MarketSnapshot::convert(argv[2], argv[3]); // Convert once, then replay from the snapshot
+            std::cout << "Wrote " << rows << " rows to " << argv[3] << std::endl;
+        } catch (const std::runtime_error& e) {
+            std::cout << e.what() << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+
+    MerkelMain::Options options;
+    bool replay = false;
+    bool backtest = false;
+    bool serve = false;
+    Gateway::Options gateway;
+    std::vector<std::string> strategies;
+    SweepRunner::Options sweep;
+    bool printSales = false;
+    std::string scriptFile;
+    std::vector<std::string> logSettings;
+    try {
+        for (int i = 1; i < argc; ++i)
+        {
+            std::string arg{argv[i]};
+            bool hasValue = i + 1 < argc;
+            if (arg == "--replay") replay = true;
+            else if (arg == "--backtest") backtest = true;
+            else if (arg == "--serve" && hasValue)
+            {
+                serve = true;
+                gateway.address = argv[++i];
+            }
+            else if (arg == "--timeframe-ms" && hasValue) gateway.tickMillis = std::stoll(argv[++i]);
+            else if (arg == "--strategy" && hasValue) strategies.push_back(argv[++i]);
+            else if (arg == "--strategy-threads" && hasValue) options.strategyThreads = std::stoul(argv[++i]);
+            else if (arg == "--sweep" && hasValue) sweep.grids.push_back(argv[++i]);
+            else if (arg == "--day" && hasValue) sweep.days.push_back(argv[++i]);
+            else if (arg == "--out" && hasValue) sweep.output = argv[++i];
+            else if (arg == "--print-sales") printSales = true;
+            else if (arg == "--script" && hasValue) scriptFile = argv[++i];
+            else if (arg == "--log" && hasValue) logSettings.push_back(argv[++i]);
+            else if (arg == "--threads" && hasValue) options.loaderThreads = std::stoul(argv[++i]);
+            else if (arg == "--match-threads" && hasValue) options.matchThreads = std::stoul(argv[++i]);
+            else if (arg == "--journal" && hasValue) options.journalDir = argv[++i];
+            else if (arg == "--snapshot-every" && hasValue) options.snapshotEvery = std::stoul(argv[++i]);
+            else if (arg == "--feed" && hasValue) options.feedName = argv[++i];
+            else if (arg == "--candles" && hasValue) options.candleFile = argv[++i];
+            else if (arg == "--candle-seconds" && hasValue)
+            {
+                double seconds = std::stod(argv[++i]);
+                if (!(seconds >= 0 && seconds < 1e12)) throw std::invalid_argument{"--candle-seconds out of range"}; // Also NaN
+                options.candleInterval = static_cast<int64_t>(seconds * 1e6);
+            }
+            else if (arg == "--stream" && hasValue)
+            {
+                options.streaming = true;
+                options.lookahead = std::stoul(argv[++i]);
+            }
+            else if (arg.rfind("--", 0) != 0) options.dataFile = arg;
+            else
+            {
+                printUsage();
+                return 1;
+            }
+        }
+    } catch (const std::exception& e) {
+        printUsage(); // A number option was not a number, or not one it can take
+        return 1;
+    }
+
+    if ((replay || backtest || serve) && !printSales) Logger::setLevel(LogModule::matching, LogLevel::warn); // Sales are only shown on request
+    if (!sweep.grids.empty() && sweep.output == "") Logger::setLevel(LogLevel::warn); // Only the results go to stdout
+    for (const std::string& setting : logSettings)
+    {
+        if (!applyLogSetting(setting))
+        {
+            printUsage();
+            return 1;
+        }
+    }
+
+    if (!sweep.grids.empty())
+    {
+        if (sweep.days.empty()) sweep.days.push_back(options.dataFile);
+        sweep.threads = options.strategyThreads;
+        sweep.loaderThreads = options.loaderThreads;
+        std::ostream& report = sweep.output == "" ? std::cerr : std::cout; // Keep stdout for the results
+        try
+        {
+            SweepRunner::Summary summary = SweepRunner{sweep}.run();
+            Logger::flush();
+            report << "Sweep ran " << summary.jobs << " jobs (" << summary.failed << " failed) on "
+                   << summary.threads << " threads in " << summary.seconds << " s, "
+                   << summary.steals << " stolen" << std::endl;
+        }
+        catch (const std::invalid_argument& e)
+        {
+            report << e.what() << std::endl;
+            return 1;
+        }
+        catch (const std::runtime_error& e) // A day that could not be opened
+        {
+            report << e.what() << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+
+    std::unique_ptr<MerkelMain> app;
+    try {
+        app = std::make_unique<MerkelMain>(options); // Create an instance of the MerkelMain class
+    } catch (const std::runtime_error& e) {
+        std::cout << e.what() << std::endl; // The data file is a snapshot that can not be used
+        return 1;
+    }
+    if (backtest)
+    {
+        if (strategies.empty()) strategies = {"maker", "momentum"};
+        return app->backtest(strategies) ? 0 : 1;
+    }
+    if (serve)
+    {
+        return app->serve(gateway) ? 0 : 1;
+    }
+    if (replay)
+    {
+        app->replay(scriptFile); // Run headless from start to finish
+        return 0;
+    }
+    app->init(); // Initialize the application
     
     // Since there's no return statement, it implicitly returns 0, indicating successful completion
 }